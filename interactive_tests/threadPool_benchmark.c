@@ -0,0 +1,109 @@
+#include <unistd.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <time.h>
+#include <stdarg.h>
+#include <inttypes.h>
+
+#include "debug.h"
+#include "tIme.h"
+#include "define.h"
+#include "threadPool.h"
+
+/*  Run:
+
+   PO_SPEW_LEVEL=WARN ./threadPool_benchmark [NUM_WORKERS [NUM_TASKS]]
+
+*/
+
+/* Measures the rate that the pool runs many very short tasks with many
+ * worker threads, so that the time is mostly the pool overhead.  Each
+ * task submits a follow-up task, so that, with work stealing, the worker
+ * threads are all busy changing their own worker data at the same time.
+ * Compare the results, with 32 or more workers, with the library built
+ * as usual and built with CPPFLAGS=-DPO_NO_CACHELINE_LAYOUT, which packs
+ * the worker and pool data without cache line alignment, to see the cost
+ * of worker threads sharing cache lines. */
+
+
+static struct POThreadPool *pool;
+
+static uint32_t count;
+
+
+static void *followUp(void *ptr)
+{
+    __sync_fetch_and_add(&count, 1);
+    return NULL;
+}
+
+
+static void *task(void *ptr)
+{
+    __sync_fetch_and_add(&count, 1);
+    poThreadPool_runTask(pool, PO_LONGTIME, 0, followUp, 0);
+    return NULL;
+}
+
+
+static double run(uint32_t numWorkers, uint32_t numTasks,
+        uint32_t dequeLength)
+{
+    uint32_t i;
+    double t;
+
+    count = 0;
+
+    pool = poThreadPool_create(numWorkers /*maxNumThreads*/,
+            2*numTasks /*maxQueueLength*/,
+            10000 /*maxIdleTime milli-seconds 1s/1000*/);
+    if(dequeLength)
+        ASSERT(poThreadPool_setWorkStealing(pool, dequeLength) == 0);
+    poThreadPool_prespawn(pool, numWorkers);
+
+    t = poTime_getDouble();
+
+    for(i=0; i<numTasks; ++i)
+        ASSERT(poThreadPool_runTask(pool, PO_LONGTIME, 0, task, 0) == 0);
+
+    // This will block until all threads finish.
+    ASSERT(poThreadPool_tryDestroy(pool, PO_LONGTIME) == 0);
+
+    t = poTime_getDouble() - t;
+
+    ASSERT(count == 2*numTasks);
+
+    return t;
+}
+
+
+int main(int argc, char **argv)
+{
+    uint32_t numWorkers = 32, numTasks = 200000;
+
+    poDebugInit();
+
+    if(argc > 1)
+        numWorkers = strtoul(argv[1], 0, 10);
+    if(argc > 2)
+        numTasks = strtoul(argv[2], 0, 10);
+
+    double t;
+
+    t = run(numWorkers, numTasks, 0);
+    printf("%"PRIu32" workers WITHOUT work stealing: %"PRIu32
+            " tasks in %g seconds, %g tasks/second\n",
+            numWorkers, 2*numTasks, t, 2*numTasks/t);
+
+    t = run(numWorkers, numTasks, 256);
+    printf("%"PRIu32" workers with work stealing:    %"PRIu32
+            " tasks in %g seconds, %g tasks/second\n",
+            numWorkers, 2*numTasks, t, 2*numTasks/t);
+
+    return 0;
+}
@@ -54,12 +54,14 @@ int main(int argc, char **argv)
     usleep(900000); // microseconds sec/1,000,000
     usleep(900000); // microseconds sec/1,000,000
 
-    for(i=10; i>1; --i) // All threads should be idle now.
+    for(i=10; i>1; --i)
     {
+        // The idle threads timed out and exited by themselves, except
+        // the last one, so there are no idle threads to remove.
         bool ret;
         printf("poThreadPool_checkIdleThreadTimeout(p)=%"PRIu32"\n",
                 ret=poThreadPool_checkIdleThreadTimeout(p));
-        VASSERT(ret == true, "poThreadPool_checkIdleThreadTimeout(p) != true");
+        VASSERT(ret == false, "poThreadPool_checkIdleThreadTimeout(p) != false");
 
     }
 
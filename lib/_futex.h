@@ -0,0 +1,55 @@
+// These futex wrappers are used in the same way as the pthread wrappers
+// in _pthreadWrap.h.  We use them when a thread needs to wait for a word
+// to change without getting a mutex lock to do it.  Linux only.
+
+// Waits while *addr is val.  It can return without *addr changing, so
+// call it in a loop.
+static inline
+void futexWait(uint32_t *addr, uint32_t val)
+{
+    if(syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, NULL, NULL, 0)
+            == -1 && errno != EAGAIN && errno != EINTR)
+        VASSERT(0, "futex(FUTEX_WAIT) failed");
+}
+
+// Like futexWait() but with a relative time-out.  Returns ETIMEDOUT if
+// the time expired, else 0.
+static inline
+int futexTimedWait(uint32_t *addr, uint32_t val,
+        uint32_t timeOut /*milli-seconds = 1/1000 sec*/)
+{
+    struct timespec timeout;
+    // FUTEX_WAIT takes a relative time.
+    timeout.tv_sec = timeOut/1000;
+    timeout.tv_nsec = (timeOut%1000)*1000000;
+
+    if(syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, &timeout,
+                NULL, 0) == -1)
+    {
+        if(errno == ETIMEDOUT)
+            return ETIMEDOUT;
+        if(errno != EAGAIN && errno != EINTR)
+            VASSERT(0, "futex(FUTEX_WAIT) failed");
+    }
+    return 0;
+}
+
+// Wakes one thread that is waiting on addr.
+static inline
+void futexWake(uint32_t *addr)
+{
+    if(syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0)
+            == -1)
+        VASSERT(0, "futex(FUTEX_WAKE) failed");
+}
+
+// Wakes all the threads that are waiting on addr.  A waiter that did not
+// need to sleep may have already freed the memory at addr, so EFAULT is
+// not an error here.
+static inline
+void futexWakeAll(uint32_t *addr)
+{
+    if(syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, INT32_MAX,
+                NULL, NULL, 0) == -1 && errno != EFAULT)
+        VASSERT(0, "futex(FUTEX_WAKE) failed");
+}
@@ -8,7 +8,12 @@
 #include <string.h>
 #include <inttypes.h>
 #include <pthread.h>
+#include <sched.h>
 #include <stdarg.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
 
 
 // A tract is a group of associated tasks that run in order and do not run
@@ -16,9 +21,20 @@
 #include "debug.h"
 #include "tIme.h"
 #include "_pthreadWrap.h" // mutexInit() mutexLock() etc...
+#include "_futex.h" // futexWait() futexWake() etc...
 #include "threadPool.h"
 #include "define.h"
 
+// The per-thread and per-lock data starts on its own cache line, so that
+// worker threads do not share cache lines.  Building with
+// -DPO_NO_CACHELINE_LAYOUT packs it, to compare the two layouts with
+// interactive_tests/threadPool_benchmark.
+#ifdef PO_NO_CACHELINE_LAYOUT
+#  define PO_CACHELINE_ALIGNED
+#else
+#  define PO_CACHELINE_ALIGNED  __attribute__((aligned(64)))
+#endif
+
 /* This is a bunch of linked lists, queues and stacks, that may be singly
  * linked (simple stack) or doubly linked (because we need to pull from
  * any point in the list).  The doubly linked lists use a minimal amount
@@ -54,9 +70,88 @@ struct POThreadPool_task
     //          Unused
     //
     struct POThreadPool_task *next;
+    // In the General priority queues the list is doubly linked, so that
+    // a task can be cancelled without looking for it.
+    struct POThreadPool_task *prev;
+
+    // The queue this task is in, PO_TASK_GENERAL or PO_TASK_TRACT, or
+    // PO_TASK_UNUSED if it's not queued.
+    uint32_t queue;
+
+    // The General queue priority, and with deadline mode the index of
+    // the task in the heap, so that we can take it out of the General
+    // queue.
+    uint32_t priority, heapIndex;
+
+    // This is changed each time the task is put in the unused stack, so
+    // that a struct POThreadPool_taskHandle to a task that ran, or was
+    // cancelled, goes stale.
+    uint32_t generation;
+
+    // Called, with userData, if the task is cancelled.
+    void (*cancelCallback)(void *);
 
     // tract is set if this is part of a tract.
     struct POThreadPool_tract *tract;
+    // All the queued tasks in a tract, in the General queue or the tract
+    // queue, are in the doubly linked list at POThreadPool_tract::queued,
+    // so that they can all be cancelled.
+    struct POThreadPool_task *tractNext, *tractPrev;
+
+    // With deadline mode, set by poThreadPool_setDeadlineMode(), the
+    // General queue is a heap ordered by deadline and then seq.
+    // deadline is in seconds, as from poTime_getDouble(), and it's
+    // INFINITY for tasks with no deadline.  seq is the order the tasks
+    // where queued in, so tasks with the same deadline stay in order.
+    double deadline;
+    uint64_t seq;
+
+    // The time, from nanoTime(), that this task was added, if we are
+    // recording histograms.
+    uint64_t queueTime;
+
+    // If payloadSize is not zero, the task is from
+    // poThreadPool_runTaskCopy() and userData points to payload, which
+    // has a copy of the user's data.  The payload is copied to the
+    // worker when the task is run, so the task can be reused.
+    uint32_t payloadSize;
+    uint8_t payload[PO_THREADPOOL_PAYLOAD_SIZE]
+        __attribute__((aligned(16)));
+};
+
+
+// A tract in the pool owned tract slab.  See poThreadPool_setTractSlab().
+// The tract must be first, so that we can get the slot from a pointer
+// to the tract.
+struct POThreadPool_tractSlot
+{
+    struct POThreadPool_tract tract;
+
+    // The generation is in the handle with the index of the slot, so
+    // that handles to recycled tracts go stale.  It's never 0, so that 0
+    // is never a valid handle.
+    uint32_t generation;
+
+    // The user's references.  The tract is recycled when this is 0 and
+    // there are no queued or running tasks in the tract.
+    uint32_t refCount;
+
+    // Called, with drainedData, by the worker that finished the last
+    // task in the tract after the last reference is released.
+    void *(*drainedCallback)(void *);
+    void *drainedData;
+
+    // For the stack of unused slots.
+    struct POThreadPool_tractSlot *nextUnused;
+};
+
+
+// Memory for tasks that poThreadPool_resize() added to the queue.
+struct POThreadPool_taskChunk
+{
+    struct POThreadPool_taskChunk *next;
+    uint32_t length;
+    struct POThreadPool_task task[];
 };
 
 
@@ -66,8 +161,9 @@ struct POThreadPool_tasks
     // There are 3 kinds of task lists
     //
     //   General: General Queue Waiting to be run. Kept in back and front
-    //            here in this structure.  There is just one list like
-    //            this. New tasks go in the back.  This queue is used when
+    //            here in this structure.  There is one list like this
+    //            for each priority level, PO_THREADPOOL_NUM_PRIORITIES.
+    //            New tasks go in the back.  This queue is used when
     //            we have p->maxNumThreads worker threads busy and we
     //            get call to poThreadPool_runTask(), so long as we have
     //            not used all the queue memory in p->tasks.
@@ -100,8 +196,11 @@ struct POThreadPool_tasks
     // task requests are added to the back and the front is where we get
     // the next task to act on.  The nag at the counter says: "Start at
     // the back of the line PLEASE!"
-    struct POThreadPool_task *back, *front, // General queue
-        // back->next == NULL
+    //
+    // back[0] and front[0] is the highest priority General queue.
+    struct POThreadPool_task *back[PO_THREADPOOL_NUM_PRIORITIES],
+        *front[PO_THREADPOOL_NUM_PRIORITIES], // General queues
+        // back[i]->next == NULL
 
         // The unused task structs for this queue.  Keeps tabs on the
         // memory that is not counted in the list in "front" and "back" or
@@ -109,10 +208,146 @@ struct POThreadPool_tasks
         *unused; // this is a stack top
     // Others lists for in each tract
 
+    // The number of tasks in all the General queues.  If it's zero the
+    // General queues are empty.
+    uint32_t queueLength;
+
+    // The number of times that a task was popped from a higher priority
+    // General queue while there where tasks in this priority General
+    // queue.  See generalQueuePop().
+    uint32_t passedOver[PO_THREADPOOL_NUM_PRIORITIES];
+
+    // With deadline mode, the General queue is this binary heap of
+    // queueLength tasks, with the earliest deadline in heap[0], and the
+    // priority queues above are not used.  It has room for all
+    // numAllocated tasks.  heap is NULL without deadline mode.
+    struct POThreadPool_task **heap;
+    // The seq of the next task put in the heap.
+    uint64_t seq;
+
+    // The number of task structs that we have allocated, which is
+    // maxQueueLength plus the tasks that are not used any more after
+    // poThreadPool_resize() made the queue shorter.  Tasks that are
+    // not used any more are in the retired stack.  numToRetire is the
+    // number of tasks that will be retired as they are put back in the
+    // unused stack, after the queue was made shorter when they where in
+    // use.
+    uint32_t numAllocated, numToRetire;
+    struct POThreadPool_task *retired;
+
 #ifdef DEBUG
-    // These lengths must add to maxQueueLength
-    uint32_t queueLength, unusedLength; 
+    // These lengths, plus the tract queue lengths, must add to
+    // maxQueueLength
+    uint32_t unusedLength; 
+#endif
+};
+
+
+// A task that waited in a lower priority General queue while this many
+// tasks where taken from higher priority General queues is taken next,
+// so that low priority tasks are not starved.
+#ifndef PO_THREADPOOL_STARVATION_LIMIT
+#  define PO_THREADPOOL_STARVATION_LIMIT  (16)
+#endif
+
+
+// The adaptive concurrency controller does not count a change in
+// throughput that is smaller than this fraction as better, so that noise
+// in the measurement does not walk the thread limit up.
+#ifndef PO_THREADPOOL_ADAPTIVE_THRESHOLD
+#  define PO_THREADPOOL_ADAPTIVE_THRESHOLD  (0.05)
 #endif
+
+
+// The state of the adaptive concurrency controller that the spawner
+// thread runs.  See poThreadPool_setAdaptiveConcurrency().
+struct POThreadPool_adaptive
+{
+    // The controller is off if period, in milliseconds, is zero.
+    uint32_t period;
+    // The lowest thread limit that the controller will set.
+    uint32_t floor;
+
+    // The direction that the controller last moved the thread limit,
+    // 1 or -1.
+    int32_t step;
+
+    // The time, from poTime_getDouble(), and the counter values at the
+    // start of this period.
+    double lastTime;
+    uint64_t lastTasksRun, lastFullWaits;
+
+    // Tasks finished per second in the last period, or less than zero
+    // if we have nothing to compare with.
+    double lastThroughput;
+};
+
+
+// Values of POThreadPool_task::queue
+enum
+{
+    PO_TASK_UNUSED  = 0, // not queued
+    PO_TASK_GENERAL = 1, // in the General queue
+    PO_TASK_TRACT   = 2  // in the tract queue of its tract
+};
+
+
+// An entry in a worker's local deque.  Tasks in a local deque are never
+// part of a tract.
+struct POThreadPool_dequeEntry
+{
+    void *(*userCallback)(void *);
+    void *userData;
+    uint64_t queueTime; // like in POThreadPool_task
+};
+
+
+// With work stealing turned on, via poThreadPool_setWorkStealing(), each
+// worker has a bounded local deque of tasks.  Only the worker's own
+// thread pushes tasks on it, when it calls poThreadPool_runTask() from a
+// task callback.  The worker pops from the back, last in first out, and
+// other workers steal from the front, first in first out.  This has its
+// own mutex so that workers do not need the pool mutex to get tasks that
+// they queued themselves.
+struct POThreadPool_deque
+{
+    pthread_mutex_t mutex;
+
+    // POThreadPool::dequeLength entries
+    struct POThreadPool_dequeEntry *entry;
+
+    // The entries in use are entry[front % dequeLength] up to, but not
+    // including, entry[back % dequeLength].  These wrap, so back - front
+    // is the number of entries in use.  Readers without the deque mutex
+    // just use them as a hint.
+    uint32_t front, back;
+};
+
+
+// Statistics counters that only the worker's own thread changes, without
+// the pool mutex.  Each worker has its own cache line of counters so
+// that counting does not make the worker threads share cache lines.
+// poThreadPool_getStats() reads them with relaxed atomic loads.
+struct POThreadPool_workerStats
+{
+    uint64_t tasksRun, tasksStolen;
+} PO_CACHELINE_ALIGNED;
+
+
+// Statistics counters that are changed with the pool mutex lock, but
+// read by poThreadPool_getStats() with relaxed atomic loads.
+struct POThreadPool_poolStats
+{
+    uint64_t numRejected, numFullWaits, fullWaitNanoseconds, numExpired;
+};
+
+
+// Values of POThreadPool_worker::handoff
+enum
+{
+    PO_WORKER_IDLE = 1, // in the idle list waiting
+    PO_WORKER_RUN  = 2, // popped off the idle list with a task to run
+    PO_WORKER_EXIT = 3  // popped off the idle list to exit
 };
 
 
@@ -140,25 +375,82 @@ struct POThreadPool_worker
     // Used to measure timeouts like: idle thread time out.
     double lastWorkTime;
 
-    // Used to control the thread by the master thread.
-    pthread_cond_t cond;
-
     // associated tract (if present)
     struct POThreadPool_tract *tract;
 
+    // Local task deque used with work stealing.  It's on its own cache
+    // line since other worker threads lock it to steal from it.
+    struct POThreadPool_deque deque PO_CACHELINE_ALIGNED;
+
     // isWorking is set when this worker struct has a running thread that
     // is working on a user task and not in the idle thread list or the
     // unused worker list.  There is no list of working threads. The
     // working threads manage themselves.
     bool isWorking;
-};
+
+    // handoff is the futex word that an idle worker waits on.  It is
+    // PO_WORKER_IDLE while this worker is in the idle worker list.  The
+    // thread that pops it off of the idle list sets it to PO_WORKER_RUN,
+    // after setting userCallback and userData, or PO_WORKER_EXIT, and
+    // wakes the worker.  The worker sets it back to 0 when it wakes.
+    uint32_t handoff;
+
+    // This worker's counters in POThreadPool::workerStats
+    struct POThreadPool_workerStats *stats;
+
+    // If we are recording histograms, the time that the task that this
+    // worker is about to run was added, and the histograms of its tract
+    // if it has them.  Set with the task.
+    uint64_t queueTime;
+    struct POThreadPool_histograms *tractHistograms;
+
+    // The number of tasks this worker has run in a row from its tract
+    // since it got the tract.  See POThreadPool::tractQuantum.
+    uint32_t tractRuns;
+
+    // Where the payload of a task from poThreadPool_runTaskCopy() is
+    // while this worker runs the task.
+    uint8_t payload[PO_THREADPOOL_PAYLOAD_SIZE]
+        __attribute__((aligned(16)));
+
+    // With the watchdog on, see poThreadPool_setWatchdog(), working
+    // workers are in the working list, in POThreadPool_workers, with
+    // these links.  workingSince is the nanoTime() that the worker was
+    // put at the back of the list, so the list is ordered by it.
+    struct POThreadPool_worker *workingNext, *workingPrev;
+    bool inWorkingList;
+    uint64_t workingSince;
+
+    // The task that this worker is running, and the nanoTime() that it
+    // started, or 0 if it's not running a task.  The worker thread sets
+    // these without the pool mutex, and the watchdog reads them with
+    // atomic loads.
+    void *(*taskCallback)(void *);
+    void *taskUserData;
+    uint64_t taskStart;
+
+    // The taskStart of the task that the watchdog hook was last called
+    // for, so the hook is called once for a task.  Only the spawner
+    // thread uses this.
+    uint64_t hungStart;
+
+    // The number of poThreadPool_blockingBegin() calls, less the
+    // poThreadPool_blockingEnd() calls, in the task that this worker is
+    // running.  Only the worker's own thread uses this.
+    uint32_t blocking;
+} PO_CACHELINE_ALIGNED;
+// Each worker starts on its own cache line, so worker threads changing
+// their own worker do not make the cache lines of the workers next to
+// them bounce between cores.
 
 
 struct POThreadPool_workers
 {
-    // There are three kinds of workers in worker[] array:
+    // There are four kinds of workers in worker[] array:
     //    - idle (has a pthread that is blocked),
-    //    - unused (have no thread or task), and
+    //    - unused (have no thread or task),
+    //    - spawning (has a task, and is waiting for the spawner thread
+    //          to create its thread), and
     //    - working (has a thread and is working on a task)
     //          and is not in a POThreadPool_workers list,
     //          but is part of the POThreadPool_worker array
@@ -172,35 +464,182 @@ struct POThreadPool_workers
         // idleFront->next = NULL and idleBack->prev = NULL
         // We get fresher workers from the back of the line, and old
         // workers in the front get retired first.
-        *unused;
-
-        // The working workers are not keep in a list ... yet.  We may
-        // need them listed so we can detect hung threads without doing a
-        // O(N) search.  We'd order the working threads from shortest time
-        // working to longest time working.
+        *unused,
+        // A singly linked queue of workers, using next, that the
+        // spawner thread will create threads for.  They already have a
+        // task and are counted in POThreadPool::numThreads.
+        *spawnFront, *spawnBack,
+        // With the watchdog on, a doubly linked list of the working
+        // workers, using workingNext and workingPrev, with the worker
+        // that started working the longest time ago at the front.  A
+        // worker moves to the back each time it gets a task with the
+        // pool mutex lock, so the watchdog finds the hung tasks without
+        // looking at all the workers.
+        *workingFront, *workingBack;
+
+    // The number of workers in the idle list.  This is read without the
+    // pool mutex by worker threads pushing to their local deque, so it's
+    // changed with atomic operations, but only with the pool mutex lock.
+    uint32_t idleLength;
 
 #ifdef DEBUG
     // maxNumThreads = 
     // unusedLength + idleLength + "working threads" =
     // unusedLength + POThreadPool::numThreads
-    uint32_t idleLength, unusedLength;
+    // (spawning workers are counted in numThreads)
+    uint32_t unusedLength;
 #endif
 };
 
 
+// The pool is laid out so that the read-mostly configuration, the
+// data that is changed with the pool mutex lock, and the statistics are
+// on separate cache lines.  Worker threads read the configuration
+// without the mutex, so it should not share cache lines with the
+// mutex and the lists that all the threads write.
 struct POThreadPool
 {
+    /////////////////////////////////////////////////////////////////
+    // Read-mostly configuration.  Set in poThreadPool_create(), or in
+    // the setters before the first task, and not changed after that.
+    /////////////////////////////////////////////////////////////////
+
 #ifdef DEBUG
     // The thread that calls poThreadPool_create() is the only thread
-    // that may call poThreadPool_runTask()
+    // that may call poThreadPool_tryDestroy().  Any thread may call
+    // poThreadPool_runTask().
     pthread_t master; // The thread that called poThreadPool_create().
 #endif
 
+    // We have maxNumThreads worker structs.  The limits that can change
+    // while the pool runs, threadLimit and maxQueueLength, are with the
+    // data that is changed with the pool mutex lock below.
+    uint32_t maxNumThreads, maxIdleTime;
+
+    struct POThreadPool_task *task; // allocated memory for tasks
+    struct POThreadPool_worker *worker; // allocated memory for workers
+
+    // dequeLength is the number of entries in each worker's local deque,
+    // if work stealing is on, else it's 0.
+    uint32_t dequeLength;
+    // allocated memory for all the worker deque entries
+    struct POThreadPool_dequeEntry *dequeEntry;
+
+    // With deadline mode, a task that is past its deadline when a worker
+    // gets it runs this in place of its callback, with its callback
+    // data.  If this is NULL expired tasks are dropped.
+    void *(*expiredCallback)(void *);
+
+    // workerStats is an array of maxNumThreads cache line aligned
+    // counters, one for each worker, for poThreadPool_getStats().
+    struct POThreadPool_workerStats *workerStats;
+
+    // If not NULL, an array of maxNumThreads histograms, one for each
+    // worker, that only the worker thread writes to.  See
+    // poThreadPool_setHistograms().
+    struct POThreadPool_histograms *histograms;
+
+    // If tractQuantum is not zero, a worker that has run tractQuantum
+    // tasks in a row from its tract, when there is other work, gives up
+    // the tract by putting it in the back of the ready tract list,
+    // readyFront to readyBack linked by POThreadPool_tract::nextReady.
+    // Ready tracts have tasks in their tract queue and no worker.
+    // Workers alternate between the ready tracts and the General queue
+    // when both have work, using readyTurn.
+    uint32_t tractQuantum;
+
+    // If numTractSlots is not zero we have an array of tract slots that
+    // the user gets tracts from with poThreadPool_tractAlloc().  The
+    // unused slots are in a stack at unusedTractSlot.
+    uint32_t numTractSlots;
+    struct POThreadPool_tractSlot *tractSlot;
+
+    // If watchdogThreshold, in nanoseconds, is not zero the spawner
+    // thread looks for tasks that have run longer than that every
+    // watchdogThreshold/2 and calls watchdogHook, if it's set, for each
+    // new one.  hungTask is an array of maxNumThreads for the spawner
+    // thread to keep them in while it calls the hook.  See
+    // poThreadPool_setWatchdog().
+    uint64_t watchdogThreshold;
+    void (*watchdogHook)(struct POThreadPool *p,
+            const struct POThreadPool_hungTask *hungTask, void *hookData);
+    void *watchdogData;
+    struct POThreadPool_hungTask *hungTask;
+
+    // If numCpus is not zero, the worker thread of worker[i] is pinned
+    // to CPU cpu[i % numCpus].  See poThreadPool_setAffinity().
+    uint32_t numCpus;
+    uint32_t *cpu;
+
+    // poThreadPool_runTask() waits if queues are full, otherwise not.
+    bool waitIfFull;
+
+    // The spawner thread calls pthread_create() for the workers in the
+    // workers spawn queue, so that poThreadPool_runTask() does not wait
+    // for threads to be created.  It waits on spawnCond with the pool
+    // mutex, and it returns when spawnerExit is set and there are no
+    // more workers to spawn.
+    pthread_t spawner;
+
+
+    /////////////////////////////////////////////////////////////////
+    // Changed with the pool mutex lock.  Starts on a new cache line.
+    /////////////////////////////////////////////////////////////////
+
+    // protects POThreadPool data structures
+    pthread_mutex_t mutex PO_CACHELINE_ALIGNED;
+    pthread_cond_t cond; // Used with mutex above.
+
+    // Used with mutex above by the threads that are blocking in
+    // poThreadPool_runTask() because there is no task room in the
+    // General or tracts queues.  We keep this separate from cond so that
+    // a worker freeing a task can't wake the master in
+    // poThreadPool_tryDestroy() by mistake.
+    pthread_cond_t taskCond;
+
+    pthread_cond_t spawnCond;
+    bool spawnerExit;
+
+    // Only the spawner thread and poThreadPool_setAdaptiveConcurrency()
+    // use this.
+    struct POThreadPool_adaptive adaptive;
+
+    // The nanoTime() that the spawner thread last ran the watchdog.
+    uint64_t watchdogLastTime;
+
+    // flag for when main (master) thread is blocking
+    // i.e. when calling pthread_cond_wait()
+    bool cleanup; // blocking in poThreadPool_tryDestroy()
+
+    // Set by poThreadPool_drain().  New tasks are rejected, except the
+    // tasks that the worker threads of this pool add.
+    bool draining;
+
+    // The number of threads may not be more than threadLimit, which is
+    // maxNumThreads unless it's changed by poThreadPool_resize() or the
+    // adaptive concurrency controller.  maxQueueLength is changed by
+    // poThreadPool_resize(), and the task memory that it adds is in the
+    // taskChunks list.
+    uint32_t threadLimit, maxQueueLength;
+    struct POThreadPool_taskChunk *taskChunks;
+
+    // The idle thread time-out does not remove idle worker threads if
+    // that would leave fewer than minIdleThreads idle threads.  See
+    // poThreadPool_setMinIdleThreads().
+    uint32_t minIdleThreads;
+
     uint32_t numThreads; // number of pthreads that now exist
-    // numThreads = (idle threads) + (working threads)
+    // numThreads = (idle threads) + (working threads) +
+    //   (spawning workers that will have a thread soon)
+
+    // The number of working threads that are in a blocking region, from
+    // poThreadPool_blockingBegin() to poThreadPool_blockingEnd().  The
+    // pool may have this many threads more than threadLimit, up to
+    // maxNumThreads, so that the CPUs are kept busy while they block.
+    // See threadCap().
+    uint32_t numBlocking;
 
     struct POThreadPool_tasks tasks; // lists of tasks
-    struct POThreadPool_task *task; // allocated memory for tasks
 
     // Their are three kinds of workers in worker[] array:
     // idle, unused, and working.
@@ -208,23 +647,32 @@ struct POThreadPool
     // List of unused worker structs that have no thread in existence.
     // idle and unused list
     struct POThreadPool_workers workers;
-    struct POThreadPool_worker *worker; // allocated memory for tasks
     // and working threads are not in a list since they have threads
     // that will act for them when they finish.
 
+    // The number of threads in poThreadPool_runTask() that are calling
+    // pthread_cond_wait() on taskCond because there is no task room
+    // in the General or tracts queues.  Any number of threads may be
+    // submitting tasks.
+    uint32_t numTaskWaiters;
 
-    pthread_mutex_t mutex; // protects POThreadPool data structures
-    pthread_cond_t cond; // Used with mutex above.
+    // The worker index that the next steal starts looking at, so that
+    // we do not always rob the same worker.
+    uint32_t stealIndex;
 
-    // flag for when main (master) thread is blocking
-    // i.e. when calling pthread_cond_wait()
-    bool cleanup; // blocking in poThreadPool_tryDestroy()
+    // The ready tract list.  See tractQuantum above.
+    struct POThreadPool_tract *readyFront, *readyBack;
+    bool readyTurn;
+
+    // The top of the stack of unused tract slots.
+    struct POThreadPool_tractSlot *unusedTractSlot;
+
+
+    /////////////////////////////////////////////////////////////////
+    // Counters for poThreadPool_getStats(), that are changed with the
+    // pool mutex lock, but read without it.  Starts on a new cache
+    // line.
+    /////////////////////////////////////////////////////////////////
 
-    // flag masks that poThreadPool_runTask() is calling
-    // pthread_cond_wait() because there is no task room
-    // in the General or tracts queues.
-    bool taskWaitingToBeRun,
-        // poThreadPool_runTask() waits if queues are full, otherwise not.
-        waitIfFull;
-    uint32_t maxQueueLength, maxNumThreads, maxIdleTime;
+    struct POThreadPool_poolStats stats PO_CACHELINE_ALIGNED;
 };
@@ -2,6 +2,14 @@
  * and poThreadPool_runTask() */
 #define PO_ERROR_TIMEOUT  (1)
 
+/** Error return value of poThreadPool_runTask() and the other task
+ * adding functions when the pool is draining.  See poThreadPool_drain() */
+#define PO_ERROR_DRAINING  (2)
+
+/** Error return value of poThreadPool_runTaskCopy() when the arguments
+ * can never be accepted, so trying again will not help */
+#define PO_ERROR_INVALID  (3)
+
 /** Macro for infinite timeout used in poThreadPool_tryDestroy()
  * and poThreadPool_runTask() */
 #define PO_LONGTIME 0xFFFFFFFF
@@ -3,11 +3,77 @@
 // Note: Reading and writing errno is thread safe.  errno is a magic CPP
 // macro that looks like a global variable.
 
+// The worker that is running in this thread, if this is a worker
+// thread, else NULL.
+static __thread struct POThreadPool_worker *currentWorker = NULL;
+
+static void *spawnerPthreadCallback(struct POThreadPool *p);
+static void adaptThreadLimit(struct POThreadPool *p, double t);
+static void watchdog(struct POThreadPool *p, uint64_t t);
+
+
+// Add to a statistics counter that has only one thread writing to it,
+// the worker thread that owns it or a thread with the pool mutex lock,
+// so we do not need an atomic read-modify-write.  The counter is read
+// by poThreadPool_getStats() without a lock.
+static inline void statAdd(uint64_t *counter, uint64_t n)
+{
+    __atomic_store_n(counter, *counter + n, __ATOMIC_RELAXED);
+}
+
+
+// Returns the monotonic clock time in nanoseconds.
+static inline uint64_t nanoTime(void)
+{
+    struct timespec t;
+    ASSERT(clock_gettime(CLOCK_MONOTONIC, &t) == 0);
+    return ((uint64_t) t.tv_sec)*1000000000 + t.tv_nsec;
+}
+
+
+// Returns the bucket index in a struct POThreadPool_histogram for the
+// time t in nanoseconds.
+static inline uint32_t histogramIndex(uint64_t t)
+{
+    const uint32_t subBits = PO_THREADPOOL_HISTOGRAM_SUB_BITS;
+
+    if(t < (1 << subBits))
+        return t;
+
+    uint32_t shift;
+    // The highest bit set minus subBits
+    shift = 63 - __builtin_clzll(t) - subBits;
+
+    return ((shift + 1) << subBits) +
+        ((t >> shift) & ((1 << subBits) - 1));
+}
+
+
+// Record time t in nanoseconds in the histogram.  Only one thread at a
+// time may record in a histogram.
+static inline
+void histogramRecord(struct POThreadPool_histogram *h, uint64_t t)
+{
+    statAdd(&h->count[histogramIndex(t)], 1);
+}
+
+
+// Returns callbackData, or if payloadSize is not zero, copies the
+// payload that callbackData points to to dest and returns dest.
+static inline
+void *payloadCopy(void *dest, void *callbackData, uint32_t payloadSize)
+{
+    if(payloadSize)
+        return memcpy(dest, callbackData, payloadSize);
+    return callbackData;
+}
+
+
+// Allocate s bytes starting on a cache line.
 static inline void *alloc(size_t s)
 {
-    void *ret;
-    ret = malloc(s);
-    if(ASSERT(ret)) return NULL;
+    void *ret = NULL;
+    if(ASSERT(posix_memalign(&ret, 64, s) == 0)) return NULL;
     // By initializing all the data to zero, we will have the correct
     // initialization for many struct POThreadPool variables.
     memset(ret, 0, s);
@@ -17,7 +83,7 @@ static inline void *alloc(size_t s)
 
 struct POThreadPool *poThreadPool_create(
         uint32_t maxNumThreads, uint32_t maxQueueLength,
-        uint32_t maxIdleTime/*micro-seconds*/)
+        uint32_t maxIdleTime/*milli-seconds*/)
 {
     struct POThreadPool *p;
 
@@ -29,11 +95,20 @@ struct POThreadPool *poThreadPool_create(
     if(maxQueueLength)
         p->task = alloc(sizeof(*p->task)*maxQueueLength);
     if(maxNumThreads)
+    {
         p->worker = alloc(sizeof(*p->worker)*maxNumThreads);
+        // The worker counters each get a cache line.
+        ASSERT(posix_memalign((void **) &p->workerStats,
+                    sizeof(*p->workerStats),
+                    sizeof(*p->workerStats)*maxNumThreads) == 0);
+        memset(p->workerStats, 0, sizeof(*p->workerStats)*maxNumThreads);
+    }
 
     p->maxQueueLength = maxQueueLength;
     p->maxNumThreads = maxNumThreads;
+    p->threadLimit = maxNumThreads;
     p->maxIdleTime = maxIdleTime;
+    p->tasks.numAllocated = maxQueueLength;
 
 #ifdef DEBUG
     p->master = pthread_self();
@@ -67,11 +142,11 @@ struct POThreadPool *poThreadPool_create(
         {
             worker[i].pool = p;
             worker[i].next = &worker[i+1];
-            condInit(&worker[i].cond);
+            worker[i].stats = &p->workerStats[i];
         }
         worker[i].pool = p;
         worker[i].next = NULL;
-        condInit(&worker[i].cond);
+        worker[i].stats = &p->workerStats[i];
 #ifdef DEBUG
         p->workers.unusedLength = maxNumThreads;
 #endif
@@ -79,6 +154,12 @@ struct POThreadPool *poThreadPool_create(
 
     mutexInit(&p->mutex);
     condInit(&p->cond);
+    condInit(&p->taskCond);
+    condInit(&p->spawnCond);
+
+    if(maxNumThreads)
+        ASSERT((errno = pthread_create(&p->spawner, NULL,
+                (void *(*)(void *)) spawnerPthreadCallback, p)) == 0);
 
     INFO("Created threadPool with queue length %d, "
         "%d available threads",
@@ -122,19 +203,71 @@ void workerOldIdlePopSignal(struct POThreadPool *p, double t)
     }
     worker->next = NULL;
 
-#ifdef DEBUG
-    --p->workers.idleLength;
+    __atomic_sub_fetch(&p->workers.idleLength, 1, __ATOMIC_SEQ_CST);
     DASSERT(p->maxNumThreads >= p->numThreads);
-#endif
 
-    // Wake up this worker.
-    ASSERT((errno = pthread_cond_signal(&worker->cond)) == 0);
+    // Wake up this worker so that it exits.
+    DASSERT(worker->handoff == PO_WORKER_IDLE);
+    __atomic_store_n(&worker->handoff, PO_WORKER_EXIT, __ATOMIC_RELEASE);
+    futexWake(&worker->handoff);
 
     INFO("signaled thread %ld idle %.2lf seconds",
         (unsigned long) worker->pthread, t - worker->lastWorkTime);
 }
 
 
+// Put a task that is done with in the unused task stack, unless the
+// queue was made shorter, in which case it's retired.  We must have the
+// pool mutex lock to call this.
+static inline
+void taskUnusedPush(struct POThreadPool *p, struct POThreadPool_task *task)
+{
+    // Handles to this use of the task go stale.
+    ++task->generation;
+    task->queue = PO_TASK_UNUSED;
+
+    if(p->tasks.numToRetire)
+    {
+        --p->tasks.numToRetire;
+        task->next = p->tasks.retired;
+        p->tasks.retired = task;
+        return;
+    }
+    task->next = p->tasks.unused;
+    p->tasks.unused = task;
+#ifdef DEBUG
+    ++p->tasks.unusedLength;
+#endif
+}
+
+
+// The number of threads that the pool may have now.  That's the thread
+// limit plus the threads that are blocking, see
+// poThreadPool_blockingBegin(), but not more than maxNumThreads.  We
+// must have the pool mutex lock to call this.
+static inline
+uint32_t threadCap(const struct POThreadPool *p)
+{
+    uint32_t cap = p->threadLimit + p->numBlocking;
+    if(cap > p->maxNumThreads)
+        cap = p->maxNumThreads;
+    return cap;
+}
+
+
+// The number of tasks that all the workers have finished, read without
+// locks.
+static inline
+uint64_t tasksRunTotal(struct POThreadPool *p)
+{
+    uint64_t n = 0;
+    uint32_t i;
+    for(i = 0; i < p->maxNumThreads; ++i)
+        n += __atomic_load_n(&p->workerStats[i].tasksRun, __ATOMIC_RELAXED);
+    return n;
+}
+
+
 // We need a threadPool mutex lock to call this.
 //
 // Return the number of tasks that need to finish running,
@@ -152,8 +285,7 @@ uint32_t _poThreadPool_tryDestroy(struct POThreadPool *p,
     while(p->workers.idleFront)
     {
         // The General queue should be empty.
-        DASSERT(!p->tasks.front);
-        DASSERT(!p->tasks.back);
+        DASSERT(!p->tasks.queueLength);
 
         // We have idle workers waiting.
         workerOldIdlePopSignal(p, t);
@@ -202,7 +334,7 @@ uint32_t _poThreadPool_tryDestroy(struct POThreadPool *p,
          * okay given this is a destructor, transient call.  We prefer
          * this to using more memory in the threadPool data structures.
          */
-        uint32_t remainingTasks;
+        uint32_t remainingTasks, i;
         struct POThreadPool_worker *w;
 
         DASSERT(p->numThreads <= p->maxNumThreads);
@@ -212,8 +344,7 @@ uint32_t _poThreadPool_tryDestroy(struct POThreadPool *p,
         if(p->workers.idleFront)
         {
             // We should have nothing in the General Task Queue
-            DASSERT(!p->tasks.back);
-            DASSERT(!p->tasks.front);
+            DASSERT(!p->tasks.queueLength);
 
             // We have idle worker threads.
             DASSERT(p->workers.idleBack);
@@ -230,33 +361,46 @@ uint32_t _poThreadPool_tryDestroy(struct POThreadPool *p,
             // a wrapped passed zero int is a Large int.
             DASSERT(remainingTasks <= p->maxNumThreads);
         }
-        else if(p->tasks.front)
-        {
+        else
             // Add the General Queue Tasks to remainingTasks count.
-            DASSERT(p->tasks.back);
-            DASSERT(!p->tasks.back->next);
-            struct POThreadPool_task *t;
-            for(t = p->tasks.front; t; t = t->next)
-                ++remainingTasks;
-        }
+            remainingTasks += p->tasks.queueLength;
+
+        // Add the tasks in the worker local deques.
+        if(p->dequeLength)
+            for(i = 0; i < p->maxNumThreads; ++i)
+            {
+                struct POThreadPool_deque *d;
+                d = &p->worker[i].deque;
+                mutexLock(&d->mutex);
+                remainingTasks += d->back - d->front;
+                mutexUnlock(&d->mutex);
+            }
 
-        DASSERT(remainingTasks <= p->maxNumThreads + p->maxQueueLength);
+        DASSERT(remainingTasks <= p->maxNumThreads +
+                p->tasks.numAllocated + p->maxNumThreads * p->dequeLength);
 
         // There may be tasks in a tract queues which MUST be blocked by
         // working threads in the same tract. These tract queues start in
         // thread workers which are currently not in a list so we must
         // look at all the worker array.
-        uint32_t i = 0;
-        for(w = p->worker; i < p->maxNumThreads; ++i)
+        for(i = 0, w = p->worker; i < p->maxNumThreads; ++i, ++w)
             if(w->isWorking && w->tract)
             {
-                // This tract better have some tasks listed
-                DASSERT(w->tract->firstTask);
-                DASSERT(w->tract->lastTask);
                 struct POThreadPool_task *t;
                 for(t = w->tract->firstTask; t; t = t->next)
                     ++remainingTasks;
             }
+
+        // And the tract queues of the tracts that are waiting for a
+        // worker.
+        struct POThreadPool_tract *tract;
+        for(tract = p->readyFront; tract; tract = tract->nextReady)
+        {
+            struct POThreadPool_task *t;
+            DASSERT(tract->firstTask);
+            for(t = tract->firstTask; t; t = t->next)
+                ++remainingTasks;
+        }
  
         NOTICE("There are %"PRIu32" uncompleted tasks remaining", remainingTasks);
 
@@ -266,15 +410,63 @@ uint32_t _poThreadPool_tryDestroy(struct POThreadPool *p,
     DASSERT(!p->cleanup); // debug sanity check 
 
     // The General Queue should be empty now.
-    DASSERT(!p->tasks.front);
-    DASSERT(!p->tasks.back);
+    DASSERT(!p->tasks.queueLength);
+    DASSERT(p->numThreads == 0);
+    DASSERT(!p->workers.spawnFront);
+
+    return 0; // success
+}
+
+
+// Frees all the pool memory.  There must be no worker threads and no
+// spawner thread to call this.  We do not use the pool mutex, it gets
+// destroyed.
+static
+void freePool(struct POThreadPool *p)
+{
     DASSERT(p->numThreads == 0);
 
+    if(p->dequeLength)
+    {
+        uint32_t i;
+        for(i = 0; i < p->maxNumThreads; ++i)
+            mutexDestroy(&p->worker[i].deque.mutex);
+        free(p->dequeEntry);
+    }
+
+    mutexDestroy(&p->mutex);
+    condDestroy(&p->cond);
+    condDestroy(&p->taskCond);
+    condDestroy(&p->spawnCond);
+
+    // The tasks that poThreadPool_resize() added.
+    uint32_t numTasks = p->tasks.numAllocated;
+    while(p->taskChunks)
+    {
+        struct POThreadPool_taskChunk *chunk = p->taskChunks;
+        p->taskChunks = chunk->next;
+        numTasks -= chunk->length;
+        free(chunk);
+    }
+
 #ifdef DEBUG
-    memset(p->task, 0, sizeof(*p->task)*p->maxQueueLength);
+    memset(p->task, 0, sizeof(*p->task)*numTasks);
     memset(p->worker, 0, sizeof(*p->worker)*p->maxNumThreads);
 #endif
 
+    if(p->tasks.heap)
+        free(p->tasks.heap);
+    if(p->cpu)
+        free(p->cpu);
+    if(p->workerStats)
+        free(p->workerStats);
+    if(p->histograms)
+        free(p->histograms);
+    if(p->tractSlot)
+        free(p->tractSlot);
+    if(p->hungTask)
+        free(p->hungTask);
+
     free(p->task);
     free(p->worker);
 
@@ -283,8 +475,6 @@ uint32_t _poThreadPool_tryDestroy(struct POThreadPool *p,
 #endif
 
     free(p);
-
-    return 0; // success
 }
 
 
@@ -302,9 +492,82 @@ uint32_t poThreadPool_tryDestroy(struct POThreadPool *p,
     uint32_t ret;
     ret = _poThreadPool_tryDestroy(p, timeOut);
 
+    if(ret == 0 && p->maxNumThreads)
+    {
+        // All the worker threads are gone, so we stop the spawner
+        // thread.
+        p->spawnerExit = true;
+        ASSERT((errno = pthread_cond_signal(&p->spawnCond)) == 0);
+    }
+
     mutexUnlock(&p->mutex);
 
-    return ret;
+    if(ret) return ret;
+
+    if(p->maxNumThreads)
+        ASSERT((errno = pthread_join(p->spawner, NULL)) == 0);
+
+    freePool(p);
+
+    return 0; // success
+}
+
+
+uint32_t poThreadPool_drain(struct POThreadPool *p, uint32_t timeOut,
+        void (*progress)(uint32_t numRemaining, void *userData),
+        void *userData)
+{
+    DASSERT(p);
+    DASSERT(pthread_equal(pthread_self(), p->master));
+
+    mutexLock(&p->mutex);
+
+    if(!p->draining)
+    {
+        p->draining = true;
+        if(p->numTaskWaiters)
+            // The threads waiting for queue room get rejected now.
+            ASSERT((errno = pthread_cond_broadcast(&p->taskCond)) == 0);
+        INFO("threadPool draining with %"PRIu32" threads and %"PRIu32
+                " queued tasks", p->numThreads, p->tasks.queueLength);
+    }
+
+    mutexUnlock(&p->mutex);
+
+    // We wait in poThreadPool_tryDestroy() in steps, so that we can tell
+    // the user how it's going.  The worker threads exit as they run out
+    // of work, and poThreadPool_tryDestroy() frees the pool, in this
+    // thread, once they have all finished.
+    double end = 0.0;
+    if(timeOut != PO_LONGTIME)
+        end = poTime_getDouble() + timeOut/1000.0;
+
+    while(true)
+    {
+        uint32_t step = PO_THREADPOOL_DRAIN_STEP, ret;
+
+        if(timeOut != PO_LONGTIME)
+        {
+            double left = end - poTime_getDouble();
+            if(left <= 0.0)
+                step = 0;
+            else if(left*1000.0 < step)
+                step = (uint32_t) (left*1000.0) + 1;
+        }
+
+        if(!(ret = poThreadPool_tryDestroy(p, step)))
+            return 0; // The pool is gone.
+
+        if(progress)
+            progress(ret, userData);
+
+        if(timeOut != PO_LONGTIME && poTime_getDouble() >= end)
+        {
+            NOTICE("timed out draining with %"PRIu32" tasks remaining",
+                    ret);
+            return ret;
+        }
+    }
 }
 
 
@@ -317,6 +580,9 @@ bool _poThreadPool_checkIdleThreadTimeout(struct POThreadPool *p)
 
     if(p->numThreads <= 1) return false; // keep at least one thread
 
+    // Keep the floor of idle threads that the user asked for.
+    if(p->workers.idleLength <= p->minIdleThreads) return false;
+
     // Remove a timed-out thread. We just remove one worker thread.
     // Removing many threads at once may cause problems in many apps.  We
     // are assuming that this function is called regularly.
@@ -355,29 +621,26 @@ bool tractHasRunningWorker(struct POThreadPool *p,
 
         return true;
     }
+    if(tract && tract->firstTask)
+        // This tract is in the ready tract list waiting for a worker.
+        // Its queued tasks must run first, so it's as if it had a
+        // running worker.
+        return true;
     return false; // No running worker.
 }
 
 
 
-// This pops a young worker off the back of the idle stack (list) of
-// workers.  The idle list is doubly linked so that we may remove the
+// We must have the threadPool mutex lock to call this.
+//
+// This pops the youngest worker off the back of the idle list and
+// returns it.  The idle list is doubly linked so that we may remove the
 // older workers from the front as they time-out due to having no work for
-// a long time.  This also makes the worker ready to work (run) its'
-// thread.  Finally the idle worker threads are signaled here to go back
-// to work.  We assume (code is correct) that the worker is blocking on a
-// call to pthread_cond_wait(), condWait() being a wrapper of
-// pthread_cond_wait().
+// a long time.
 static inline
-int workerIdleYoungPop(struct POThreadPool *p,
-        struct POThreadPool_tract *tract,
-        void *(*callback)(void *), void *callbackData)
+struct POThreadPool_worker *workerIdleBackPop(struct POThreadPool *p)
 {
     struct POThreadPool_worker *worker;
-    // If we have idle worker threads we should not have any queued
-    // tasks:
-    DASSERT(!p->tasks.back);
-    DASSERT(!p->tasks.front);
 
     DASSERT(p->workers.idleFront);
     DASSERT(p->workers.idleBack);
@@ -404,15 +667,91 @@ int workerIdleYoungPop(struct POThreadPool *p,
         p->workers.idleFront = NULL;
         // The idle worker list is empty.
     }
+    DASSERT(worker->handoff == PO_WORKER_IDLE);
 
-#ifdef DEBUG
-    --p->workers.idleLength;
+    __atomic_sub_fetch(&p->workers.idleLength, 1, __ATOMIC_SEQ_CST);
     DASSERT(!p->workers.idleFront || p->workers.idleLength); 
-#endif
+
+    return worker;
+}
+
+
+// We must have the threadPool mutex lock to call this.
+//
+// Take the worker out of the working list, if it's in it.
+static inline
+void workingRemove(struct POThreadPool *p,
+        struct POThreadPool_worker *worker)
+{
+    if(!worker->inWorkingList)
+        return;
+
+    if(worker->workingPrev)
+        worker->workingPrev->workingNext = worker->workingNext;
+    else
+    {
+        DASSERT(p->workers.workingFront == worker);
+        p->workers.workingFront = worker->workingNext;
+    }
+    if(worker->workingNext)
+        worker->workingNext->workingPrev = worker->workingPrev;
+    else
+    {
+        DASSERT(p->workers.workingBack == worker);
+        p->workers.workingBack = worker->workingPrev;
+    }
+    worker->workingNext = NULL;
+    worker->workingPrev = NULL;
+    worker->inWorkingList = false;
+}
+
+
+// We must have the threadPool mutex lock to call this.
+//
+// With the watchdog on, this is called when a worker gets a task with
+// the pool mutex lock.  The worker goes to the back of the working list,
+// so the list stays ordered by workingSince.
+static inline
+void workingPush(struct POThreadPool *p, struct POThreadPool_worker *worker)
+{
+    workingRemove(p, worker);
+
+    worker->workingSince = nanoTime();
+    worker->workingPrev = p->workers.workingBack;
+    if(p->workers.workingBack)
+        p->workers.workingBack->workingNext = worker;
+    else
+        p->workers.workingFront = worker;
+    p->workers.workingBack = worker;
+    worker->inWorkingList = true;
+}
+
+
+// This pops a young worker off the back of the idle stack (list) of
+// workers.  This also makes the worker ready to work (run) its' thread.
+// Finally the idle worker thread is woken here to go back to work.  We
+// hand the task to the worker in its worker struct, so it starts the
+// task without getting the pool mutex lock.  We assume (code is correct)
+// that the worker is waiting on its handoff futex word, or is about to.
+static inline
+int workerIdleYoungPop(struct POThreadPool *p,
+        struct POThreadPool_tract *tract,
+        void *(*callback)(void *), void *callbackData,
+        uint32_t payloadSize, uint64_t queueTime)
+{
+    struct POThreadPool_worker *worker;
+    // If we have idle worker threads we should not have any queued
+    // tasks:
+    DASSERT(!p->tasks.queueLength);
+
+    worker = workerIdleBackPop(p);
 
     // Crack the whip.  Work on this slave!
     worker->userCallback = callback;
-    worker->userData = callbackData;
+    worker->userData = payloadCopy(worker->payload, callbackData,
+            payloadSize);
+    worker->queueTime = queueTime;
+    worker->tractHistograms = tract?tract->histograms:NULL;
     if(tract)
     {
         // This worker is working on a particular tract.  We are
@@ -424,15 +763,17 @@ int workerIdleYoungPop(struct POThreadPool *p,
         DASSERT(!worker->tract);
         tract->worker = worker;
         worker->tract = tract;
+        worker->tractRuns = 1;
     }
+    worker->isWorking = true;
+    if(p->watchdogThreshold)
+        workingPush(p, worker);
 
-    // This thread exists and it waiting on a condition variable; so
-    // lets put it back to work.  ASSERT() is not removed if not
-    // DEBUG.
-    ASSERT((errno = pthread_cond_signal(&worker->cond)) == 0);
-
-    // Check and remove extra old unemployed threads.
-    _poThreadPool_checkIdleThreadTimeout(p);
+    // This thread exists and it waiting on a futex; so lets put it back
+    // to work.  The release store makes the task data above visible to
+    // the worker before it sees PO_WORKER_RUN.
+    __atomic_store_n(&worker->handoff, PO_WORKER_RUN, __ATOMIC_RELEASE);
+    futexWake(&worker->handoff);
 
     return 0; // Success.
 }
@@ -449,17 +790,19 @@ void tractQueueTask(struct POThreadPool *p,
     // We have a worker thread running with this tract and nothing in
     // the General task queue, or this task just popped off the General
     // task queue, so we make a "blocked" (waiting) task that is kept by
-    // the worker that is currently busy on another task.
+    // the worker that is currently busy on another task, or by the
+    // tract in the ready tract list.
 
     struct POThreadPool_tract *tract;
     DASSERT(task);
     tract = task->tract;
     DASSERT(tract);
-    DASSERT(tract->worker);
-    DASSERT(tract->worker->tract == tract);
+    DASSERT(tract->worker || tract->firstTask);
+    DASSERT(!tract->worker || tract->worker->tract == tract);
 
     // put task in worker/tract queue
     task->next = NULL;
+    task->queue = PO_TASK_TRACT;
 
     if(tract->lastTask)
     {
@@ -476,667 +819,3291 @@ void tractQueueTask(struct POThreadPool *p,
 }
 
 
-typedef void *(*_poThreadPool_callback_t)(void *);
-
-// Find a task for a running thread
-// We much have the threadPool mutex lock to call this.
-// This is called by a worker in the pool, a working worker thread.
+// Returns true if task a should run before task b in deadline mode.
 static inline
-_poThreadPool_callback_t lookForWork(struct POThreadPool *p,
-        struct POThreadPool_worker *worker,
-        void **userData)
+bool heapBefore(const struct POThreadPool_task *a,
+        const struct POThreadPool_task *b)
 {
-    // We can find tasks from 3 kinds of sources.
-    DSPEW();
+    return a->deadline < b->deadline ||
+        (a->deadline == b->deadline && a->seq < b->seq);
+}
 
-    DASSERT(worker >= p->worker);
-    DASSERT(worker <= &p->worker[
-                p->maxNumThreads-1]);
 
-    // 1. Worker has work in the worker struct
-    // The worker was assigned work already.
-    // This work came from a call to poThreadPool_runTask().
-    //
-    // This worker must have been idle and this work is considered
-    // owned by this worker and is not in a list any more, and
-    // there is no associated taskCount.
-    if(worker->userCallback)
+// We must have a threadPool mutex lock to call this.
+//
+// Move the task at index i in the heap up to where it belongs.
+static inline
+void heapUp(struct POThreadPool_task **heap, uint32_t i)
+{
+    struct POThreadPool_task *task;
+    task = heap[i];
+
+    while(i)
     {
-        DASSERT(!worker->tract || worker->tract->worker == worker);
-        *userData = worker->userData;
-        return worker->userCallback;
+        uint32_t parent;
+        parent = (i - 1)/2;
+        if(!heapBefore(task, heap[parent]))
+            break;
+        heap[i] = heap[parent];
+        heap[i]->heapIndex = i;
+        i = parent;
     }
+    heap[i] = task;
+    task->heapIndex = i;
+}
 
-    // 2. Tract Queue
-    // This has priority over the General Queue (3) below, for this was
-    // added before when there was nothing in the General Queue.
-    if(worker->tract && worker->tract->firstTask)
-    {
-        struct POThreadPool_task *task;
-        struct POThreadPool_tract *tract;
-        tract = worker->tract;
-        DASSERT(tract->lastTask);
-        DASSERT(tract->worker == worker);
-        DASSERT(worker->tract == tract);
 
+// We must have a threadPool mutex lock to call this.
+//
+// Move the task at index i in the heap of length n down to where it
+// belongs.
+static inline
+void heapDown(struct POThreadPool_task **heap, uint32_t n, uint32_t i)
+{
+    struct POThreadPool_task *task;
+    task = heap[i];
 
-        // Pop from the tract task queue
-        task = tract->firstTask;
+    while(true)
+    {
+        uint32_t child;
+        child = 2*i + 1;
+        if(child >= n)
+            break;
+        if(child + 1 < n && heapBefore(heap[child + 1], heap[child]))
+            ++child;
+        if(!heapBefore(heap[child], task))
+            break;
+        heap[i] = heap[child];
+        heap[i]->heapIndex = i;
+        i = child;
+    }
+    heap[i] = task;
+    task->heapIndex = i;
+}
 
-        DASSERT(task >= p->task);
-        DASSERT(task <= &p->task[p->maxQueueLength-1]);
 
-        tract->firstTask = task->next;
-        if(!tract->firstTask)
-            tract->lastTask = NULL;
+// We must have a threadPool mutex lock to call this.
+//
+// Returns true if the task is past its deadline.  We only read the
+// clock for tasks that have a deadline.
+static inline
+bool taskIsExpired(struct POThreadPool *p, struct POThreadPool_task *task)
+{
+    return p->tasks.heap && task->deadline != INFINITY &&
+        task->deadline < poTime_getDouble();
+}
 
-        // Put task on the unused tasks queue
-        task->next = p->tasks.unused;
-        p->tasks.unused = task;
 
-        DASSERT(task->userCallback);
+// We must have a threadPool mutex lock to call this.
+//
+// Put the task, that is not in any list, in the back of the General
+// queue with the given priority, or in the heap in deadline mode.
+static inline
+void generalQueuePush(struct POThreadPool *p,
+        struct POThreadPool_task *task, uint32_t priority)
+{
+    DASSERT(priority < PO_THREADPOOL_NUM_PRIORITIES);
 
-        DASSERT(tract->taskCount > 0);
-        DASSERT(tract->taskCount <= p->maxQueueLength);
-        --tract->taskCount;
-        
-        *userData = task->userData;
-        return task->userCallback;
+    task->next = NULL;
+    task->queue = PO_TASK_GENERAL;
+    task->priority = priority;
+
+    if(p->tasks.heap)
+    {
+        DASSERT(p->tasks.queueLength < p->tasks.numAllocated);
+        task->seq = p->tasks.seq++;
+        p->tasks.heap[p->tasks.queueLength] = task;
+        heapUp(p->tasks.heap, p->tasks.queueLength);
+        ++p->tasks.queueLength;
+        return;
     }
 
-    // 3. General Queue
-    if(p->tasks.front)
+    task->prev = p->tasks.back[priority];
+    if(p->tasks.back[priority])
     {
-        struct POThreadPool_task *task;
-        DASSERT(p->tasks.back);
-        // Pop a task off of tasks General queue front
-        task = p->tasks.front;
-        DASSERT(task >= p->task);
-        DASSERT(task <= &p->task[p->maxQueueLength-1]);
+        DASSERT(p->tasks.front[priority]);
+        p->tasks.back[priority]->next = task;
+    }
+    else
+    {
+        DASSERT(!p->tasks.front[priority]);
+        p->tasks.front[priority] = task;
+    }
+    p->tasks.back[priority] = task;
 
-        p->tasks.front = task->next;
+    ++p->tasks.queueLength;
+}
+
+
+// We must have a threadPool mutex lock to call this.
+//
+// Pop the task off the front of the highest priority General queue that
+// is not empty, unless a lower priority General queue has been passed
+// over PO_THREADPOOL_STARVATION_LIMIT times, in which case we pop from
+// it.  There must be a task in the General queue.
+static inline
+struct POThreadPool_task *generalQueuePop(struct POThreadPool *p)
+{
+    struct POThreadPool_task *task;
+    uint32_t i, j;
 
-        if(!p->tasks.front)
+    DASSERT(p->tasks.queueLength);
+
+    if(p->tasks.heap)
+    {
+        // Earliest deadline first.
+        task = p->tasks.heap[0];
+        --p->tasks.queueLength;
+        if(p->tasks.queueLength)
         {
-            // We got the last task in the queue.
-            DASSERT(task == p->tasks.back);
-            p->tasks.back = NULL;
+            p->tasks.heap[0] = p->tasks.heap[p->tasks.queueLength];
+            heapDown(p->tasks.heap, p->tasks.queueLength, 0);
         }
-#ifdef DEBUG
-        --p->tasks.queueLength;
-#endif
+        return task;
+    }
 
-        DASSERT(task->userCallback);
+    // Find the highest priority queue with a task.
+    for(i = 0; !p->tasks.front[i]; ++i)
+        DASSERT(i < PO_THREADPOOL_NUM_PRIORITIES - 1);
 
-        if(task->tract)
+    // Look for a lower priority queue that we must not pass over again.
+    for(j = i + 1; j < PO_THREADPOOL_NUM_PRIORITIES; ++j)
+        if(p->tasks.front[j] &&
+                p->tasks.passedOver[j] >= PO_THREADPOOL_STARVATION_LIMIT)
         {
-            if(task->tract->worker)
-            {
-                // We already have a worker working on this tract.
-                // Add this task to the Tract task queue.
-                // We'll run it as soon as there is no worker
-                // running a task in that same tract.
-                tractQueueTask(p, task);
+            i = j;
+            break;
+        }
 
-                // Try again, there may be other tasks
-                // we can do in the General queue.
-                return lookForWork(p, worker, userData);
-            }
-            else
+    // Count the lower priority queues with tasks that we pass over.
+    for(j = i + 1; j < PO_THREADPOOL_NUM_PRIORITIES; ++j)
+        if(p->tasks.front[j])
+            ++p->tasks.passedOver[j];
+    p->tasks.passedOver[i] = 0;
+
+    task = p->tasks.front[i];
+    DASSERT(task);
+
+    p->tasks.front[i] = task->next;
+
+    if(p->tasks.front[i])
+        p->tasks.front[i]->prev = NULL;
+    else
+    {
+        // We got the last task in this queue.
+        DASSERT(task == p->tasks.back[i]);
+        p->tasks.back[i] = NULL;
+    }
+
+    --p->tasks.queueLength;
+
+    return task;
+}
+
+
+// We must have a threadPool mutex lock to call this.
+//
+// Take the task out of the General queue, from any point in it.
+static inline
+void generalQueueRemove(struct POThreadPool *p,
+        struct POThreadPool_task *task)
+{
+    DASSERT(task->queue == PO_TASK_GENERAL);
+    DASSERT(p->tasks.queueLength);
+
+    --p->tasks.queueLength;
+
+    if(p->tasks.heap)
+    {
+        struct POThreadPool_task **heap, *last;
+        uint32_t i, n;
+        heap = p->tasks.heap;
+        n = p->tasks.queueLength;
+        i = task->heapIndex;
+        DASSERT(i <= n && heap[i] == task);
+        if(i == n)
+            return; // It was at the end.
+        // Put the last task where this task was, and move it up or down
+        // to where it belongs.
+        last = heap[n];
+        heap[i] = last;
+        last->heapIndex = i;
+        if(i && heapBefore(last, heap[(i - 1)/2]))
+            heapUp(heap, i);
+        else
+            heapDown(heap, n, i);
+        return;
+    }
+
+    if(task->prev)
+        task->prev->next = task->next;
+    else
+    {
+        DASSERT(p->tasks.front[task->priority] == task);
+        p->tasks.front[task->priority] = task->next;
+    }
+    if(task->next)
+        task->next->prev = task->prev;
+    else
+    {
+        DASSERT(p->tasks.back[task->priority] == task);
+        p->tasks.back[task->priority] = task->prev;
+    }
+}
+
+
+// Add a task to the front of the list of queued tasks in its tract.
+static inline
+void tractQueuedPush(struct POThreadPool_tract *tract,
+        struct POThreadPool_task *task)
+{
+    task->tractPrev = NULL;
+    task->tractNext = tract->queued;
+    if(tract->queued)
+        tract->queued->tractPrev = task;
+    tract->queued = task;
+}
+
+
+// Remove a task from the list of queued tasks in its tract, when it's
+// no longer queued.  This and the decrement of tract->taskCount go
+// together.
+static inline
+void tractQueuedRemove(struct POThreadPool_tract *tract,
+        struct POThreadPool_task *task)
+{
+    if(task->tractPrev)
+        task->tractPrev->tractNext = task->tractNext;
+    else
+    {
+        DASSERT(tract->queued == task);
+        tract->queued = task->tractNext;
+    }
+    if(task->tractNext)
+        task->tractNext->tractPrev = task->tractPrev;
+    task->tractNext = NULL;
+    task->tractPrev = NULL;
+}
+
+
+typedef void *(*_poThreadPool_callback_t)(void *);
+
+
+// Push a task on the back of the worker's local deque.  Only the worker's
+// own thread may call this, and it must not have the pool mutex lock.
+//
+// Returns true if the task was queued in the deque, or false if the
+// deque is full or there are idle workers that should get the task via
+// the pool mutex instead.
+static inline
+bool dequePush(struct POThreadPool *p, struct POThreadPool_worker *worker,
+        void *(*callback)(void *), void *callbackData)
+{
+    struct POThreadPool_deque *d;
+    d = &worker->deque;
+
+    if(__atomic_load_n(&p->workers.idleLength, __ATOMIC_SEQ_CST))
+        // An idle worker can run this task now.
+        return false;
+
+    mutexLock(&d->mutex);
+    if(d->back - d->front == p->dequeLength)
+    {
+        // It's full.
+        mutexUnlock(&d->mutex);
+        return false;
+    }
+    struct POThreadPool_dequeEntry *e;
+    e = &d->entry[d->back % p->dequeLength];
+    e->userCallback = callback;
+    e->userData = callbackData;
+    if(p->histograms)
+        e->queueTime = nanoTime();
+    __atomic_store_n(&d->back, d->back + 1, __ATOMIC_RELAXED);
+    mutexUnlock(&d->mutex);
+
+    // A worker may have gone idle after we checked above, and before it
+    // could see this task.  See the other side of this in
+    // workerPthreadCallback().
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    if(!__atomic_load_n(&p->workers.idleLength, __ATOMIC_SEQ_CST))
+        return true; // It will get run by us or stolen.
+
+    // There is an idle worker now, so we take the task back, if no one
+    // stole it, and give it to an idle worker.  Thieves take from the
+    // front, so if our task, at the back, was stolen the deque is
+    // empty.
+    bool ret = true;
+    mutexLock(&d->mutex);
+    if(d->back != d->front)
+    {
+        __atomic_store_n(&d->back, d->back - 1, __ATOMIC_RELAXED);
+        ret = false;
+    }
+    mutexUnlock(&d->mutex);
+    return ret;
+}
+
+
+// Pop a task off the back of the worker's local deque.  Only the
+// worker's own thread may call this.
+static inline
+_poThreadPool_callback_t dequePop(struct POThreadPool *p,
+        struct POThreadPool_worker *worker, void **userData)
+{
+    struct POThreadPool_deque *d;
+    void *(*callback)(void *) = NULL;
+    d = &worker->deque;
+
+    // Only we push on this deque, so if it looks empty it is empty.
+    if(d->back == __atomic_load_n(&d->front, __ATOMIC_RELAXED))
+        return NULL;
+
+    mutexLock(&d->mutex);
+    if(d->back != d->front)
+    {
+        struct POThreadPool_dequeEntry *e;
+        __atomic_store_n(&d->back, d->back - 1, __ATOMIC_RELAXED);
+        e = &d->entry[d->back % p->dequeLength];
+        callback = e->userCallback;
+        *userData = e->userData;
+        worker->queueTime = e->queueTime;
+        worker->tractHistograms = NULL;
+    }
+    mutexUnlock(&d->mutex);
+
+    return callback;
+}
+
+
+// We must have the threadPool mutex lock to call this.
+//
+// Steal a task from the front of another worker's local deque.  We look
+// at the deques without their lock first, so that we do not have to lock
+// all the deques that are empty.
+static inline
+_poThreadPool_callback_t dequeSteal(struct POThreadPool *p,
+        struct POThreadPool_worker *worker, void **userData)
+{
+    uint32_t i, n;
+    n = p->maxNumThreads;
+
+    for(i = 0; i < n; ++i)
+    {
+        struct POThreadPool_worker *w;
+        struct POThreadPool_deque *d;
+        w = &p->worker[(p->stealIndex + i) % n];
+        d = &w->deque;
+
+        if(w == worker || __atomic_load_n(&d->back, __ATOMIC_RELAXED) ==
+                __atomic_load_n(&d->front, __ATOMIC_RELAXED))
+            continue;
+
+        void *(*callback)(void *) = NULL;
+
+        mutexLock(&d->mutex);
+        if(d->back != d->front)
+        {
+            struct POThreadPool_dequeEntry *e;
+            e = &d->entry[d->front % p->dequeLength];
+            callback = e->userCallback;
+            *userData = e->userData;
+            worker->queueTime = e->queueTime;
+            worker->tractHistograms = NULL;
+            __atomic_store_n(&d->front, d->front + 1, __ATOMIC_RELAXED);
+        }
+        mutexUnlock(&d->mutex);
+
+        if(callback)
+        {
+            statAdd(&worker->stats->tasksStolen, 1);
+            // Start at the next worker the next time.
+            p->stealIndex = (p->stealIndex + i + 1) % n;
+            return callback;
+        }
+    }
+
+    return NULL;
+}
+
+// Returns the tract slot if the tract is in the pool tract slab, else
+// NULL.
+static inline
+struct POThreadPool_tractSlot *tractSlot(struct POThreadPool *p,
+        struct POThreadPool_tract *tract)
+{
+    struct POThreadPool_tractSlot *slot;
+    slot = (struct POThreadPool_tractSlot *) tract;
+    if(slot >= p->tractSlot && slot < p->tractSlot + p->numTractSlots)
+        return slot;
+    return NULL;
+}
+
+
+// Returns true if the tract has no queued or running tasks.
+// We must have the pool mutex lock to call this.
+static inline
+bool tractIsDrained(struct POThreadPool_tract *tract)
+{
+    return (!tract->worker && !tract->taskCount && !tract->firstTask);
+}
+
+
+// Put a drained slab tract with no references back in the unused stack.
+// The handles to it go stale.  We must have the pool mutex lock to call
+// this.
+static inline
+void tractSlotRecycle(struct POThreadPool *p,
+        struct POThreadPool_tractSlot *slot)
+{
+    uint32_t generation;
+    DASSERT(!slot->refCount);
+    DASSERT(tractIsDrained(&slot->tract));
+
+    memset(&slot->tract, 0, sizeof(slot->tract));
+    slot->drainedCallback = NULL;
+    slot->drainedData = NULL;
+
+    generation = slot->generation + 1;
+    if(!generation)
+        generation = 1;
+    // poThreadPool_tractGet() reads this without the mutex.
+    __atomic_store_n(&slot->generation, generation, __ATOMIC_RELEASE);
+
+    slot->nextUnused = p->unusedTractSlot;
+    p->unusedTractSlot = slot;
+}
+
+
+// We must have a threadPool mutex lock to call this.
+//
+// After we cancel tasks in a pool owned tract, or drop its expired
+// tasks, it may be drained with no references, so we recycle it as a
+// worker or poThreadPool_tractRelease() would.  Returns its drained
+// callback, if it has one, which the caller calls without the pool
+// mutex lock.
+static inline
+_poThreadPool_callback_t cancelTractDrained(struct POThreadPool *p,
+        struct POThreadPool_tract *tract, void **data)
+{
+    struct POThreadPool_tractSlot *slot;
+    void *(*callback)(void *);
+
+    slot = tractSlot(p, tract);
+    if(!slot || slot->refCount || !tractIsDrained(tract))
+        return NULL;
+
+    callback = slot->drainedCallback;
+    *data = slot->drainedData;
+    tractSlotRecycle(p, slot);
+    return callback;
+}
+
+
+// In deadline mode without an expired callback, this removes all the
+// expired tasks from the General queue heap, so their task structs can
+// be used again.  Returns the number of tasks removed.  The tasks that
+// drained a released slab tract are not put in the unused stack, they
+// are put in the list at drained, linked by next, with the drained
+// callback of the tract in place of their callback.  The caller calls
+// them with drainedFinish() without the pool mutex lock.
+static
+uint32_t heapPurgeExpired(struct POThreadPool *p,
+        struct POThreadPool_task **drained)
+{
+    struct POThreadPool_task **heap;
+    uint32_t i, n, numRemoved;
+    double t;
+
+    DASSERT(p->tasks.heap);
+    DASSERT(!p->expiredCallback);
+
+    heap = p->tasks.heap;
+    n = p->tasks.queueLength;
+    t = poTime_getDouble();
+
+    // Keep the tasks that are not expired at the start of the array.
+    for(i = 0, numRemoved = 0; i < n; ++i)
+    {
+        struct POThreadPool_task *task;
+        task = heap[i];
+        if(task->deadline != INFINITY && task->deadline < t)
+        {
+            ++numRemoved;
+            if(task->tract)
             {
-                // We have no worker on this tract yet, so
-                // this will become a tract bound worker.
-                if(worker->tract)
+                void *(*drainedCallback)(void *), *drainedData;
+                DASSERT(task->tract->taskCount > 0);
+                --task->tract->taskCount;
+                tractQueuedRemove(task->tract, task);
+                drainedCallback = cancelTractDrained(p, task->tract,
+                        &drainedData);
+                if(drainedCallback)
                 {
-                    // This worker will lose this tract and
-                    // switch to new task->tract, this tract
-                    // has an empty tract queue now.
-                    DASSERT(worker->tract != task->tract);
-                    DASSERT(worker->tract->worker == worker);
-                    DASSERT(!worker->tract->firstTask);
-                    DASSERT(!worker->tract->lastTask);
-                    worker->tract->worker = NULL;
-                    //worker->tract = NULL;// set below
+                    task->queue = PO_TASK_UNUSED;
+                    task->tract = NULL;
+                    task->userCallback = drainedCallback;
+                    task->userData = drainedData;
+                    task->next = *drained;
+                    *drained = task;
+                    continue;
                 }
+            }
+            taskUnusedPush(p, task);
+        }
+        else
+        {
+            heap[i - numRemoved] = task;
+            task->heapIndex = i - numRemoved;
+        }
+    }
 
-                DASSERT(!task->tract->worker);
-                worker->tract = task->tract;
-                worker->tract->worker = worker;
+    if(!numRemoved)
+        return 0;
 
-                DASSERT(worker->tract->taskCount > 0);
-                DASSERT(worker->tract->taskCount <= p->maxQueueLength);
-                --worker->tract->taskCount;
+    n -= numRemoved;
+    p->tasks.queueLength = n;
+
+    // Rebuild the heap.
+    for(i = n/2; i > 0; --i)
+        heapDown(heap, n, i - 1);
+
+    statAdd(&p->stats.numExpired, numRemoved);
+
+    INFO("dropped %"PRIu32" expired tasks", numRemoved);
+
+    return numRemoved;
+}
+
+
+// Put the tasks in the list linked by next in the unused stack, and wake
+// the submitting threads that are waiting for room.  We must not have
+// the pool mutex lock to call this.  The tasks are not in any list, so
+// no other thread touched them while we did not have the lock.
+static
+void taskListUnusedPush(struct POThreadPool *p,
+        struct POThreadPool_task *list)
+{
+    struct POThreadPool_task *task;
+
+         /////////////////////////////////////////////////|
+        ////////////// ACCESSING POOL DATA ////////////////|
+       /////////////////////////////////////////////////////|
+      /////                                              \///|
+     /*-*/              mutexLock(&p->mutex);             ////|
+    /////                                                  \///|
+
+    while((task = list))
+    {
+        list = task->next;
+        taskUnusedPush(p, task);
+    }
+
+    if(p->numTaskWaiters)
+        // There is room for the waiting submitting threads now.
+        ASSERT((errno = pthread_cond_broadcast(&p->taskCond)) == 0);
+
+    ////|                                                  /////
+     /*-*/             mutexUnlock(&p->mutex);            /////
+      /////                                              /////
+       //////////////////////////////////////////////////////
+        /////////// FINISHED ACCESSING POOL DATA ///////////
+         //////////////////////////////////////////////////
+}
+
+
+// Call the drained callbacks in the list from heapPurgeExpired(), without
+// the pool mutex lock, and then put the tasks in the unused stack.
+static
+void drainedFinish(struct POThreadPool *p, struct POThreadPool_task *drained)
+{
+    struct POThreadPool_task *task;
+
+    for(task = drained; task; task = task->next)
+        task->userCallback(task->userData);
+
+    taskListUnusedPush(p, drained);
+}
+
+
+// Find a task for a running thread
+// We much have the threadPool mutex lock to call this.
+// This is called by a worker in the pool, a working worker thread.
+static inline
+_poThreadPool_callback_t lookForWork(struct POThreadPool *p,
+        struct POThreadPool_worker *worker,
+        void **userData)
+{
+    // We can find tasks from 3 kinds of sources.  Tasks that are handed
+    // to an idle worker directly, by workerIdleYoungPop(), do not come
+    // through here.
+    DSPEW();
+
+    DASSERT(worker >= p->worker);
+    DASSERT(worker <= &p->worker[
+                p->maxNumThreads-1]);
+
+    // 0. Drained Slab Tract
+    // If this worker ran the last task of a pool owned tract that the
+    // user has released, we recycle the tract and run its drained
+    // callback.
+    if(worker->tract && p->numTractSlots)
+    {
+        struct POThreadPool_tractSlot *slot;
+        slot = tractSlot(p, worker->tract);
+
+        if(slot && !slot->refCount && !slot->tract.taskCount &&
+                !slot->tract.firstTask)
+        {
+            void *(*callback)(void *);
+            DASSERT(slot->tract.worker == worker);
+            slot->tract.worker = NULL;
+            worker->tract = NULL;
+            callback = slot->drainedCallback;
+            *userData = slot->drainedData;
+            tractSlotRecycle(p, slot);
+
+            if(callback)
+            {
+                worker->queueTime = p->histograms?nanoTime():0;
+                worker->tractHistograms = NULL;
+                return callback;
+            }
+        }
+    }
+
+    // 1. Tract Queue
+    // This has priority over the General Queue (2) below, for this was
+    // added before when there was nothing in the General Queue, unless
+    // this worker used up its tract quantum.
+    if(worker->tract && worker->tract->firstTask &&
+            p->tractQuantum && worker->tractRuns >= p->tractQuantum &&
+            (p->tasks.queueLength || p->readyFront))
+    {
+        // There is other work waiting, so we give up this tract and put
+        // it in the back of the ready tract list.
+        struct POThreadPool_tract *tract;
+        tract = worker->tract;
+        DASSERT(tract->worker == worker);
+        tract->worker = NULL;
+        worker->tract = NULL;
+
+        tract->nextReady = NULL;
+        if(p->readyBack)
+            p->readyBack->nextReady = tract;
+        else
+            p->readyFront = tract;
+        p->readyBack = tract;
+    }
+
+    // 1b. Ready Tracts
+    // When there is work in the General queue too, we take turns.
+    if(p->readyFront && (!p->tasks.queueLength || p->readyTurn))
+    {
+        struct POThreadPool_tract *tract;
+        p->readyTurn = false;
+
+        // Pop the tract off the front of the ready tract list.
+        tract = p->readyFront;
+        p->readyFront = tract->nextReady;
+        if(!p->readyFront)
+            p->readyBack = NULL;
+        tract->nextReady = NULL;
+
+        DASSERT(!tract->worker);
+        DASSERT(tract->firstTask);
+
+        if(worker->tract)
+        {
+            // This worker loses its old tract, which has an empty
+            // tract queue.
+            DASSERT(worker->tract->worker == worker);
+            DASSERT(!worker->tract->firstTask);
+            worker->tract->worker = NULL;
+        }
+        worker->tract = tract;
+        tract->worker = worker;
+        worker->tractRuns = 0;
+    }
+    else if(p->readyFront)
+        // The General queue this time, and the ready tracts next time.
+        p->readyTurn = true;
+
+    if(worker->tract && worker->tract->firstTask)
+    {
+        struct POThreadPool_task *task;
+        struct POThreadPool_tract *tract;
+        tract = worker->tract;
+        DASSERT(tract->lastTask);
+        DASSERT(tract->worker == worker);
+        DASSERT(worker->tract == tract);
+
+        ++worker->tractRuns;
+
+        // Pop from the tract task queue
+        task = tract->firstTask;
+
+        DASSERT(task);
+
+        tract->firstTask = task->next;
+        if(!tract->firstTask)
+            tract->lastTask = NULL;
+
+        // Put task on the unused tasks queue.  We are done with it
+        // after we copy from it below, and no other thread can get it
+        // before we release the pool mutex.
+        taskUnusedPush(p, task);
+
+        DASSERT(task->userCallback);
+
+        DASSERT(tract->taskCount > 0);
+        DASSERT(tract->taskCount <= p->tasks.numAllocated);
+        --tract->taskCount;
+        tractQueuedRemove(tract, task);
+
+        *userData = payloadCopy(worker->payload, task->userData,
+                task->payloadSize);
+        worker->queueTime = task->queueTime;
+        worker->tractHistograms = tract->histograms;
+
+        if(taskIsExpired(p, task))
+        {
+            statAdd(&p->stats.numExpired, 1);
+            if(p->expiredCallback)
+                return p->expiredCallback;
+            // Drop it and look again.
+            return lookForWork(p, worker, userData);
+        }
+
+        return task->userCallback;
+    }
+
+    // 2. General Queue
+    if(p->tasks.queueLength)
+    {
+        struct POThreadPool_task *task;
+        // Pop a task off of tasks General queue front, by priority
+        task = generalQueuePop(p);
+
+        DASSERT(task->userCallback);
+
+        if(taskIsExpired(p, task))
+        {
+            statAdd(&p->stats.numExpired, 1);
+            if(p->expiredCallback)
+            {
+                // Run the expired callback in place of the task, in the
+                // same tract order as the task would have.
+                task->userCallback = p->expiredCallback;
+                task->deadline = INFINITY;
+            }
+            else
+            {
+                // Drop it and look again.
+                void *(*drainedCallback)(void *) = NULL;
+                if(task->tract)
+                {
+                    DASSERT(task->tract->taskCount > 0);
+                    --task->tract->taskCount;
+                    tractQueuedRemove(task->tract, task);
+                    drainedCallback = cancelTractDrained(p, task->tract,
+                            userData);
+                }
+                taskUnusedPush(p, task);
+                if(drainedCallback)
+                {
+                    // That drained a released slab tract, so this
+                    // worker runs its drained callback next, without
+                    // the pool mutex lock, like in 0. above.
+                    worker->queueTime = p->histograms?nanoTime():0;
+                    worker->tractHistograms = NULL;
+                    return drainedCallback;
+                }
+                return lookForWork(p, worker, userData);
+            }
+        }
+
+        if(task->tract)
+        {
+            if(task->tract->worker || task->tract->firstTask)
+            {
+                // We already have a worker working on this tract, or
+                // the tract is waiting in the ready tract list.
+                // Add this task to the Tract task queue.
+                // We'll run it as soon as there is no worker
+                // running a task in that same tract.
+                tractQueueTask(p, task);
+
+                // Try again, there may be other tasks
+                // we can do in the General queue.
+                return lookForWork(p, worker, userData);
+            }
+            else
+            {
+                // We have no worker on this tract yet, so
+                // this will become a tract bound worker.
+                if(worker->tract)
+                {
+                    // This worker will lose this tract and
+                    // switch to new task->tract, this tract
+                    // has an empty tract queue now.
+                    DASSERT(worker->tract != task->tract);
+                    DASSERT(worker->tract->worker == worker);
+                    DASSERT(!worker->tract->firstTask);
+                    DASSERT(!worker->tract->lastTask);
+                    worker->tract->worker = NULL;
+                    //worker->tract = NULL;// set below
+                }
+
+                DASSERT(!task->tract->worker);
+                worker->tract = task->tract;
+                worker->tract->worker = worker;
+                worker->tractRuns = 1;
+
+                DASSERT(worker->tract->taskCount > 0);
+                DASSERT(worker->tract->taskCount <=
+                        p->tasks.numAllocated);
+                --worker->tract->taskCount;
+                tractQueuedRemove(worker->tract, task);
+            }
+        }
+
+        // Task is moved to the unused stack
+        taskUnusedPush(p, task);
+
+
+        *userData = payloadCopy(worker->payload, task->userData,
+                task->payloadSize);
+        worker->queueTime = task->queueTime;
+        worker->tractHistograms = task->tract?task->tract->histograms:NULL;
+        return task->userCallback;
+    }
+
+
+    // At this point there is no work, except work that is bound to
+    // another worker, but not this worker.
+
+    if(worker->tract)
+    {
+        DSPEW("no work for tract(%p)", worker->tract);
+        // This worker was working on a tract, but now there is no work
+        // available now.  The tract still exists for the user, but
+        // there is no need to bind this worker to this particular tract
+        // anymore.
+
+        // An Idle worker should not be bound to a tract so that we can
+        // have other tracts use the idle worker.
+        DASSERT(worker->tract->worker == worker);
+        DASSERT(!worker->tract->firstTask);
+        DASSERT(!worker->tract->lastTask);
+
+        // Unbind this worker from the tract.
+        worker->tract->worker = NULL;
+        worker->tract = NULL;
+    }
+
+    // 3. Other workers' local deques
+    // With work stealing we take tasks that other workers queued for
+    // themselves.  These tasks have no tract, so this worker stays
+    // unbound.
+    if(p->dequeLength)
+        return dequeSteal(p, worker, userData);
+
+    // Sorry worker, you are unemployed with no tract.
+    return NULL;
+}
+
+
+static inline
+bool lastWorkerSignalCleanup(struct POThreadPool *p)
+{
+    if(p->cleanup)
+    {
+        // cleanup is set by the master when it is waiting.
+        if(p->numThreads == 1)
+        {
+            // This is the last thread.  Signal the master
+            // on the way out.
+            ASSERT((errno = pthread_cond_signal(&p->cond)) == 0);
+#ifdef DEBUG
+            p->cleanup = false; // sanity check
+#endif
+        }
+        return true;
+    }
+    return false;
+}
+
+
+// This is called by an idle worker thread, without the pool mutex lock,
+// after it waited maxIdleTime on its futex word.  If the worker may
+// retire it removes itself from the idle list and sets its handoff word
+// to PO_WORKER_EXIT, just as workerOldIdlePopSignal() would.  Returns
+// false if the worker must stay idle however long it waits, so that it
+// should wait without a time-out, or else true.
+static inline
+bool workerIdleTimeOut(struct POThreadPool *p,
+        struct POThreadPool_worker *worker)
+{
+         /////////////////////////////////////////////////|
+        ////////////// ACCESSING POOL DATA ////////////////|
+       /////////////////////////////////////////////////////|
+      /////                                              \///|
+     /*-*/              mutexLock(&p->mutex);             ////|
+    /////                                                  \///|
+
+    if(worker->handoff == PO_WORKER_IDLE && (
+            // keep at least one thread
+            p->numThreads <= 1 ||
+            // Keep the floor of idle threads that the user asked for.
+            p->workers.idleLength <= p->minIdleThreads))
+    {
+        // We need to stay until we are given work, or the floor is
+        // lowered by poThreadPool_setMinIdleThreads() which wakes us.
+        // Waiting with a time-out again would just spin if maxIdleTime
+        // is small.
+        mutexUnlock(&p->mutex);
+        return false;
+    }
+
+    if(worker->handoff != PO_WORKER_IDLE ||
+            poTime_getDouble() - worker->lastWorkTime <
+                p->maxIdleTime/1000.0)
+    {
+        // We where popped off the idle list while we got the lock, or
+        // we have not been idle long enough.
+        mutexUnlock(&p->mutex);
+        return true;
+    }
+
+    // Remove this worker from the idle list.  The idle list is doubly
+    // linked so we can do this from any point in it.  Going in the next
+    // direction is going to the older idle workers at the front.
+    if(worker->next)
+        worker->next->prev = worker->prev;
+    else
+    {
+        DASSERT(p->workers.idleFront == worker);
+        p->workers.idleFront = worker->prev;
+    }
+    if(worker->prev)
+        worker->prev->next = worker->next;
+    else
+    {
+        DASSERT(p->workers.idleBack == worker);
+        p->workers.idleBack = worker->next;
+    }
+    worker->next = NULL;
+    worker->prev = NULL;
+
+    __atomic_sub_fetch(&p->workers.idleLength, 1, __ATOMIC_SEQ_CST);
+
+    __atomic_store_n(&worker->handoff, PO_WORKER_EXIT, __ATOMIC_RELEASE);
+
+    INFO("thread %ld idle timed out", (unsigned long) worker->pthread);
+
+    ////|                                                  /////
+     /*-*/             mutexUnlock(&p->mutex);            /////
+      /////                                              /////
+       //////////////////////////////////////////////////////
+        /////////// FINISHED ACCESSING POOL DATA ///////////
+         //////////////////////////////////////////////////
+
+    return true;
+}
+
+
+// Run the user task callback in the worker thread, without the pool
+// mutex lock, and count it.  If we are recording histograms, we record
+// how long the task waited and how long it ran.
+static inline
+void workerRunTask(struct POThreadPool *p,
+        struct POThreadPool_worker *worker,
+        void *(*userCallback)(void *), void *userData)
+{
+    if(p->watchdogThreshold)
+    {
+        // The watchdog may read these at any time.
+        __atomic_store_n(&worker->taskCallback, userCallback,
+                __ATOMIC_RELAXED);
+        __atomic_store_n(&worker->taskUserData, userData,
+                __ATOMIC_RELAXED);
+        __atomic_store_n(&worker->taskStart, nanoTime(), __ATOMIC_RELEASE);
+    }
+
+    if(p->histograms)
+    {
+        struct POThreadPool_histograms *h, *th;
+        uint64_t start, queueTime;
+        h = &p->histograms[worker - p->worker];
+        th = worker->tractHistograms;
+        queueTime = worker->queueTime;
+
+        start = nanoTime();
+        userCallback(userData); // working callback
+        uint64_t end = nanoTime();
+
+        histogramRecord(&h->queueWait, start - queueTime);
+        histogramRecord(&h->run, end - start);
+        if(th)
+        {
+            // Only one worker at a time works on a tract, so only one
+            // thread at a time records in the tract histograms.
+            histogramRecord(&th->queueWait, start - queueTime);
+            histogramRecord(&th->run, end - start);
+        }
+    }
+    else
+        userCallback(userData); // working callback
+
+    if(p->watchdogThreshold)
+        __atomic_store_n(&worker->taskStart, 0, __ATOMIC_RELEASE);
+
+    if(worker->blocking)
+    {
+        WARN("task callback %p returned in a blocking region",
+                userCallback);
+        worker->blocking = 1;
+        poThreadPool_blockingEnd(p);
+    }
+
+    statAdd(&worker->stats->tasksRun, 1);
+}
+
+
+static void
+*workerPthreadCallback(struct POThreadPool_worker *worker)
+{
+    DASSERT(worker);
+    DASSERT(worker->pool);
+    struct POThreadPool *p;
+    pthread_mutex_t *pmutex /*pool mutex*/;
+    p = worker->pool;
+    pmutex = &p->mutex;
+
+    currentWorker = worker;
+    worker->pthread = pthread_self();
+
+    // This worker here now is not in any threadPool worker list.  It was
+    // counted in p->numThreads and given its task, by workerUnusedPop(),
+    // before the spawner thread created this thread, so we do not need
+    // the pool mutex to start working.
+
+    void *(*userCallback)(void *);
+    void *userData;
+
+    // Copy data to the stack in case things change while we did not
+    // have the pmutex lock while we were calling the user callback.
+
+    userCallback = worker->userCallback;
+    userData = worker->userData;
+
+    DASSERT(worker->isWorking);
+
+    while(true)
+    {
+        // We do not have the pool mutex lock here, and we have a task,
+        // unless this thread was pre-spawned without a task.
+
+        DSPEW("starting task tract(%p)", worker->tract);
+
+        //////////////// go to work on the task ///////////////////
+        if(userCallback)
+            workerRunTask(p, worker, userCallback, userData);
+        ////////////////// finished work on task //////////////////
+
+        // With work stealing, we work on the tasks that we queued in our
+        // own deque without getting the pool mutex.
+        while(p->dequeLength &&
+                (userCallback = dequePop(p, worker, &userData)))
+            workerRunTask(p, worker, userCallback, userData);
+
+        DSPEW("finished task");
+
+
+             /////////////////////////////////////////////////|
+            ////////////// ACCESSING POOL DATA ////////////////|
+           /////////////////////////////////////////////////////|
+          /////                                              \///|
+         /*-*/              mutexLock(pmutex);                ////|
+        /////                                                  \///|
+
+        DASSERT(!worker->tract ||
+            (worker->tract->worker == worker));
+
+        if(p->numTaskWaiters)
+        {
+            ASSERT((errno = pthread_cond_signal(&p->taskCond)) == 0);
+            // We'll get this waiting task after the submitting
+            // thread starts running again, but not while
+            // we hold this mutex lock.
+        }
+
+        if((userCallback = lookForWork(p, worker, &userData)))
+        {
+            if(p->watchdogThreshold)
+                workingPush(p, worker);
+            mutexUnlock(pmutex); // FINISHED ACCESSING POOL DATA
+            continue;
+        }
+
+        if(lastWorkerSignalCleanup(p))
+            break;
+
+        if(p->numThreads > threadCap(p))
+            // poThreadPool_resize() lowered the number of threads, or a
+            // blocking region ended, so this thread exits in place of
+            // going idle.
+            break;
+
+        // This worker may not be assigned to a tract, otherwise
+        // lookForWork() would have found work.
+        DASSERT(!worker->tract);
+
+        worker->isWorking = false;
+        workingRemove(p, worker);
+
+        worker->lastWorkTime = poTime_getDouble();
+
+        // Put this worker in the idle worker list so that the managing
+        // thread can signal it to put it back to work or make it return.
+        DASSERT(!worker->prev);
+        DASSERT(!worker->next);
+        worker->next = p->workers.idleBack;
+        if(p->workers.idleBack)
+        {
+            DASSERT(p->workers.idleFront);
+            p->workers.idleBack->prev = worker;
+        }
+        else
+        {
+            DASSERT(!p->workers.idleFront);
+            p->workers.idleFront = worker;
+        }
+        p->workers.idleBack = worker;
+        DASSERT(!worker->handoff);
+        worker->handoff = PO_WORKER_IDLE;
+        __atomic_add_fetch(&p->workers.idleLength, 1, __ATOMIC_SEQ_CST);
+
+        if(p->dequeLength)
+        {
+            // A worker thread may have pushed a task on its local deque
+            // before it could see that we are idle.  It checks
+            // idleLength after pushing and we check the deques after
+            // adding to idleLength, so one of us will see the other.
+            __atomic_thread_fence(__ATOMIC_SEQ_CST);
+            if((userCallback = dequeSteal(p, worker, &userData)))
+            {
+                // We are still at the back of the idle list, given that
+                // we have not released the pool mutex.
+                DASSERT(p->workers.idleBack == worker);
+                workerIdleBackPop(p);
+                worker->handoff = 0;
+                worker->isWorking = true;
+                if(p->watchdogThreshold)
+                    workingPush(p, worker);
+                mutexUnlock(pmutex); // FINISHED ACCESSING POOL DATA
+                continue;
+            }
+        }
+
+        ////|                                                  /////
+         /*-*/             mutexUnlock(pmutex);               /////
+          /////                                              /////
+           //////////////////////////////////////////////////////
+            /////////// FINISHED ACCESSING POOL DATA ///////////
+             //////////////////////////////////////////////////
+
+        ///////////////////////////////////////////////////////////////
+        ////////////////////// IDLE WORKER SLEEP //////////////////////
+        ///////////////////////////////////////////////////////////////
+        // We wait on our futex word until a thread pops this worker off
+        // the idle list and changes it.  We do not need the pool mutex
+        // to wait, or to start a task that is handed to us.  If we wait
+        // maxIdleTime we may retire ourself, so idle threads are removed
+        // without the user calling into the pool.  If we may not retire
+        // we wait with no time-out, until we are woken.
+        uint32_t handoff;
+        bool timed = true;
+        while((handoff = __atomic_load_n(&worker->handoff,
+                        __ATOMIC_ACQUIRE)) == PO_WORKER_IDLE)
+        {
+            if(!timed)
+            {
+                futexWait(&worker->handoff, PO_WORKER_IDLE);
+                timed = true;
+            }
+            else if(futexTimedWait(&worker->handoff, PO_WORKER_IDLE,
+                        p->maxIdleTime) == ETIMEDOUT)
+                timed = workerIdleTimeOut(p, worker);
+        }
+        // Note: a thread can sit here an arbitrary amount of time,
+        // even if it is woken.
+        ///////////////////////////////////////////////////////////////
+
+        // We are not in the idle list any more, so this is ours now.
+        worker->handoff = 0;
+
+        if(handoff == PO_WORKER_RUN)
+        {
+            // The thread that popped us off the idle list handed us a
+            // task, and set worker->tract and worker->isWorking for us,
+            // before it changed the handoff word.
+            userCallback = worker->userCallback;
+            userData = worker->userData;
+            continue;
+        }
+
+        // We where popped off the idle list so that we exit.
+        DASSERT(handoff == PO_WORKER_EXIT);
+
+             /////////////////////////////////////////////////|
+            ////////////// ACCESSING POOL DATA ////////////////|
+           /////////////////////////////////////////////////////|
+          /////                                              \///|
+         /*-*/              mutexLock(pmutex);                ////|
+        /////                                                  \///|
+
+        if((userCallback = lookForWork(p, worker, &userData)))
+        {
+            worker->isWorking = true;
+            if(p->watchdogThreshold)
+                workingPush(p, worker);
+            mutexUnlock(pmutex); // FINISHED ACCESSING POOL DATA
+            continue;
+        }
+
+        lastWorkerSignalCleanup(p);
+
+        break; // this thread will exit
+
+    } ///////////////////////////// while(true) loop
+
+
+    --p->numThreads;
+
+    INFO("removing thread, there are now %"PRIu32" idle or working threads",
+                p->numThreads);
+
+    // put this worker in the unused worker stack
+    worker->isWorking = false;
+    workingRemove(p, worker);
+    worker->next = p->workers.unused;
+    p->workers.unused = worker;
+
+#ifdef DEBUG
+    ++p->workers.unusedLength;
+    DASSERT(p->maxNumThreads > p->numThreads);
+#endif
+
+    ////|                                                  /////
+     /*-*/             mutexUnlock(pmutex);               /////
+      /////                                              /////
+       //////////////////////////////////////////////////////
+        /////////// FINISHED ACCESSING POOL DATA ///////////
+         //////////////////////////////////////////////////
+
+#ifdef PO_THREADPOOL_DETACH
+    ASSERT((errno = pthread_detach(pthread_self())) == 0);
+#endif
+
+    return NULL;
+}
+
+
+// Only the spawner thread calls this, and without the threadPool mutex
+// lock, so that no thread holds the pool mutex while the thread is being
+// created.  We do not wait for the new thread to run.
+static inline
+void launchWorkerThread(struct POThreadPool *p,
+        struct POThreadPool_worker *worker)
+{
+    pthread_attr_t attr;
+    pthread_t pthread;
+
+    ASSERT((errno = pthread_attr_init(&attr)) == 0);
+
+#if 0 // For Debugging stack size.
+    size_t stackSize;
+    ASSERT((errno = pthread_attr_getstacksize(&attr, &stackSize)) == 0);
+    ERROR("stacksize= %zu MBytes", stackSize/(1024*1024));
+#endif
+
+#ifdef PO_THREADPOOL_STACKSIZE
+    ASSERT((errno = pthread_attr_setstacksize(&attr,
+            PO_THREADPOOL_STACKSIZE)) == 0);
+#endif
+
+    if(p->numCpus)
+    {
+        // Pin the worker threads round-robin to the CPUs, by worker
+        // index, so a worker always runs on the same CPU.
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(p->cpu[(worker - p->worker) % p->numCpus], &cpus);
+        ASSERT((errno = pthread_attr_setaffinity_np(&attr,
+                sizeof(cpus), &cpus)) == 0);
+    }
+
+    // The new thread sets worker->pthread itself, so that it is set
+    // before the worker can be seen in the idle list.
+    ASSERT((errno = pthread_create(&pthread, &attr,
+            (void *(*)(void *)) workerPthreadCallback, worker)) == 0);
+
+    ASSERT((errno = pthread_attr_destroy(&attr)) == 0);
+}
+
+
+// The spawner thread creates the worker threads for the workers that
+// workerUnusedPop() puts in the spawn queue.  With adaptive concurrency
+// it also runs the controller, adaptThreadLimit(), once every period,
+// and with a watchdog hook it runs watchdog() every half of the watchdog
+// threshold.
+static
+void *spawnerPthreadCallback(struct POThreadPool *p)
+{
+    DASSERT(p);
+
+         /////////////////////////////////////////////////|
+        ////////////// ACCESSING POOL DATA ////////////////|
+       /////////////////////////////////////////////////////|
+      /////                                              \///|
+     /*-*/              mutexLock(&p->mutex);             ////|
+    /////                                                  \///|
+
+    while(true)
+    {
+        struct POThreadPool_worker *worker;
+        double wait = 0.0; // seconds to the next controller or watchdog
+
+        if(p->adaptive.period && !p->cleanup)
+        {
+            double t = poTime_getDouble();
+            wait = p->adaptive.lastTime + p->adaptive.period/1000.0 - t;
+            if(wait <= 0.0)
+            {
+                adaptThreadLimit(p, t);
+                wait = p->adaptive.period/1000.0;
+            }
+        }
+
+        if(p->watchdogHook && !p->cleanup)
+        {
+            uint64_t t = nanoTime();
+            uint64_t period = p->watchdogThreshold/2 + 1;
+            double w;
+            if(t - p->watchdogLastTime >= period)
+            {
+                p->watchdogLastTime = t;
+                // This may release the pool mutex while it calls the
+                // hook.
+                watchdog(p, t);
+                w = period*1.0e-9;
+            }
+            else
+                w = (period - (t - p->watchdogLastTime))*1.0e-9;
+            if(wait <= 0.0 || w < wait)
+                wait = w;
+        }
+
+        if(!(worker = p->workers.spawnFront))
+        {
+            if(p->spawnerExit)
+                break;
+            if(wait > 0.0)
+                condTimedWait(&p->spawnCond, &p->mutex,
+                        (uint32_t) (wait*1000.0) + 1);
+            else
+                condWait(&p->spawnCond, &p->mutex);
+            continue;
+        }
+
+        // Pop the worker off the front of the spawn queue.
+        p->workers.spawnFront = worker->next;
+        if(!worker->next)
+        {
+            DASSERT(p->workers.spawnBack == worker);
+            p->workers.spawnBack = NULL;
+        }
+        worker->next = NULL;
+
+        mutexUnlock(&p->mutex);
+
+        launchWorkerThread(p, worker);
+
+        mutexLock(&p->mutex);
+    }
+
+    ////|                                                  /////
+     /*-*/             mutexUnlock(&p->mutex);            /////
+      /////                                              /////
+       //////////////////////////////////////////////////////
+        /////////// FINISHED ACCESSING POOL DATA ///////////
+         //////////////////////////////////////////////////
+
+    return NULL;
+}
+
+
+// Launch a thread with an unused worker
+// We must have the threadPool mutex lock to call this.
+//
+// We do not create the thread here.  The worker is counted as having a
+// thread now, and it's queued for the spawner thread, so the caller does
+// not wait for the thread to be created.
+//
+// If callback is NULL the new worker thread has no task and it will look
+// for work and go idle, as when it finishes a task.
+static inline
+int workerUnusedPop(struct POThreadPool *p,
+        struct POThreadPool_tract *tract,
+        void *(*callback)(void *), void *callbackData,
+        uint32_t payloadSize, uint64_t queueTime)
+{
+    struct POThreadPool_worker *worker;
+    DASSERT(p->workers.unused);
+    // Grab an unused worker by popping the unused worker stack
+    worker = p->workers.unused;
+    DASSERT(worker >= p->worker);
+    DASSERT(worker <= &p->worker[
+                p->maxNumThreads-1]);
+    DASSERT(!worker->prev);
+    p->workers.unused = worker->next;
+    worker->next = NULL;
+
+#ifdef DEBUG
+    --p->workers.unusedLength;
+#endif
+
+    // There should be no General queued tasks, unless we are starting a
+    // thread with no task for them, after poThreadPool_resize().
+    DVASSERT(!callback || !p->tasks.queueLength,
+            "p->tasks.queueLength=%d", p->tasks.queueLength);
+
+    worker->userCallback = callback;
+    worker->userData = payloadCopy(worker->payload, callbackData,
+            payloadSize);
+    worker->queueTime = queueTime;
+    worker->tractHistograms = tract?tract->histograms:NULL;
+    if(tract)
+    {
+        DASSERT(!tract->worker);
+        DASSERT(!worker->tract);
+        // We are starting or restarting work on a tract and
+        // there is no current worker working on this tract.
+        tract->worker = worker;
+        worker->tract = tract;
+        worker->tractRuns = 1;
+    }
+    // This worker is working now, as far as the rest of the pool can
+    // tell; it's not in the idle or unused worker lists.
+    worker->isWorking = true;
+    if(callback && p->watchdogThreshold)
+        workingPush(p, worker);
+
+    ++p->numThreads;
+    DASSERT(p->numThreads <= p->maxNumThreads);
+
+    // extra spaces to line up with other print below
+    INFO("adding thread, there are now %"PRIu32" idle or working threads",
+            p->numThreads);
+
+    // Put the worker in the back of the spawn queue and wake the spawner
+    // thread.
+    if(p->workers.spawnBack)
+        p->workers.spawnBack->next = worker;
+    else
+        p->workers.spawnFront = worker;
+    p->workers.spawnBack = worker;
+
+    ASSERT((errno = pthread_cond_signal(&p->spawnCond)) == 0);
+
+    return 0; // success
+}
+
+
+// We must have the threadPool mutex lock to call this.
+//
+// If payloadSize is not zero, callbackData points to a payload that we
+// copy into the task or worker.
+static
+int _poThreadPool_runTask(struct POThreadPool *p,
+        uint32_t timeOut/*milliseconds = (1/1000) sec*/,
+        uint32_t priority, double deadline,
+        struct POThreadPool_tract *tract,
+        void *(*callback)(void *), void *callbackData,
+        uint32_t payloadSize, struct POThreadPool_task **queuedTask)
+{
+    DASSERT(p);
+    DASSERT(callback);
+
+    // queuedTask is set to the task struct if the task is queued, so
+    // that it can be cancelled.
+    if(queuedTask)
+        *queuedTask = NULL;
+
+    // The time the task was added, for the queue wait histograms, which
+    // includes time waiting for room in the queue.
+    uint64_t queueTime = 0;
+    if(p->histograms)
+        queueTime = nanoTime();
+
+tryAgain:
+
+    DASSERT(p->numThreads <= p->maxNumThreads);
+
+    if(p->draining && !(currentWorker && currentWorker->pool == p))
+    {
+        // We are not taking new work.  The tasks that are running may
+        // add tasks, since that's part of the work we are finishing.
+        DSPEW("rejecting task, the pool is draining");
+        return PO_ERROR_DRAINING;
+    }
+
+    bool hasTractWorker;
+    hasTractWorker = tractHasRunningWorker(p, tract);
+    // hasTractWorker is set if we have a tract with a worker that has a
+    // running thread, so it will block running a thread for this request.
+    // A tract is defined by having only one worker thread working on it
+    // at a time.  The tract is like a baton that is must be held by
+    // the worker that is currently working on the tract.
+
+
+    // Can we try to put a thread to work on this new task now.
+    
+    if(p->workers.idleFront && !hasTractWorker)
+    {
+        //
+        // ### CASE 1:  we have idle worker threads ready to work
+        //
+        // There should be no tasks in the General Queue
+        DASSERT(!p->tasks.queueLength);
+
+        // We use an idle worker thread in this case.
+        return workerIdleYoungPop(p, tract, callback, callbackData,
+                payloadSize, queueTime);
+        // returns 0 == success
+    }
+
+    if(p->workers.unused && p->numThreads < threadCap(p) &&
+            !hasTractWorker)
+    {
+        //
+        // ### CASE 2:  we have unused workers that can be working threads
+        //
+        // Launch a new thread with an unused worker
+        return workerUnusedPop(p, tract, callback, callbackData,
+                payloadSize, queueTime);
+        // returns 0 == success
+    }
+
+
+
+    // The rest are queuing or blocking cases.
+
+
+    if(!p->tasks.unused)
+    {
+        //
+        // ### CASE 3:  we need to queue this, but the queues are full
+        //
+        // We have no tasks to queue with, i.e. the queues are full.
+
+        // In deadline mode, expired tasks that would just be dropped
+        // are taking up the queue.  Drop them now.
+        struct POThreadPool_task *drained = NULL;
+        if(p->tasks.heap && !p->expiredCallback &&
+                heapPurgeExpired(p, &drained))
+        {
+            if(drained)
+            {
+                // Some slab tracts where drained by dropping their
+                // expired tasks.  We call their drained callbacks
+                // without the pool mutex lock.
+                mutexUnlock(&p->mutex);
+                drainedFinish(p, drained);
+                mutexLock(&p->mutex);
+            }
+            goto tryAgain;
+        }
+
+        if(timeOut == 0)
+        {
+            // We are out of time.
+            statAdd(&p->stats.numRejected, 1);
+            return PO_ERROR_TIMEOUT; // fail
+        }
+
+        // Next try we may have a free task struct to queue with or a
+        // free worker thread to run with, unless another submitting
+        // thread beat us to it.
+        INFO(
+#ifdef DEBUG
+                "Using all %d tasks "
+                "and general queue with %d tasks, waiting now",
+                p->maxQueueLength,
+                p->tasks.queueLength
+#else
+                "We ran out of tasks using all %d queued tasks, "
+                "waiting now",
+                p->maxQueueLength
+#endif
+                );
+
+
+        uint64_t t;
+        t = nanoTime();
+
+        ++p->numTaskWaiters;
+        if(timeOut == PO_LONGTIME)
+            condWait(&p->taskCond, &p->mutex);
+        else
+        {
+            condTimedWait(&p->taskCond, &p->mutex, timeOut);
+            // Try again, with no timeOut.  It does not matter if
+            // we timed out or not, either way we just do this:
+            timeOut = 0;
+        }
+        DASSERT(p->numTaskWaiters);
+        --p->numTaskWaiters;
+
+        statAdd(&p->stats.numFullWaits, 1);
+        statAdd(&p->stats.fullWaitNanoseconds, nanoTime() - t);
+
+        // Try again.  The pool may have changed in any way while we
+        // waited, tract workers included, so we start from the top.
+        goto tryAgain;
+    }
+
+    if(tract)
+    {
+        // All the queued tasks in a tract get the same priority, so that
+        // the tract tasks stay in order.
+        if(tract->taskCount)
+        {
+            priority = tract->priority;
+            if(deadline < tract->deadline)
+                deadline = tract->deadline;
+        }
+        else
+            tract->priority = priority;
+        tract->deadline = deadline;
+
+        // Add to the tract task Count because this will be queued
+        // somewhere.
+        ++tract->taskCount;
+    }
+
+
+    if(p->tasks.queueLength || !hasTractWorker)
+    {
+        //
+        // ### CASE 4:  we put this task in the General queue
+        //
+        // General Queue
+        // We can put this "task" in the regular General queue.
+        // The General queue should be used so tasks stay 
+        struct POThreadPool_task *task;
+
+        // pop a task off the unused task stack.
+        task = p->tasks.unused;
+        p->tasks.unused = task->next;
+
+#ifdef DEBUG
+        --p->tasks.unusedLength;
+#endif
+        task->userCallback = callback;
+        task->userData = payloadCopy(task->payload, callbackData,
+                payloadSize);
+        task->payloadSize = payloadSize;
+        task->tract = tract;
+        task->deadline = deadline;
+        task->queueTime = queueTime;
+        task->cancelCallback = NULL;
+        if(tract)
+            tractQueuedPush(tract, task);
+        if(queuedTask)
+            *queuedTask = task;
+
+        // Put this task in back of the General task queue with this
+        // priority.
+        generalQueuePush(p, task, priority);
+
+        return 0; // success, it's queued in the General queue.
+    }
+
+
+    // ### CASE 5:  we have a tract worker thread running and there
+    //              are no tasks in the General queue, so we may add
+    //              this task to tract task queue.
+
+    DASSERT(!p->tasks.queueLength);
+    DASSERT(hasTractWorker);
+    DASSERT(tract);
+
+    struct POThreadPool_task *task;
+
+    // pop the task from unused
+    task = p->tasks.unused;
+    p->tasks.unused = task->next;
+
+    task->userCallback = callback;
+    task->userData = payloadCopy(task->payload, callbackData, payloadSize);
+    task->payloadSize = payloadSize;
+    task->tract = tract;
+    task->deadline = deadline;
+    task->queueTime = queueTime;
+    task->cancelCallback = NULL;
+    tractQueuedPush(tract, task);
+    if(queuedTask)
+        *queuedTask = task;
+#ifdef DEBUG
+    --p->tasks.unusedLength;
+#endif
+
+    tractQueueTask(p, task);
+
+    // Now it should be run by the working thread after all
+    // the other tasks in the worker tract task list.  It's
+    // in a "Blocked" tract task queue which is kept in the
+    // particular worker/tract tract data structure.
+    return 0;
+}
+
+
+/* Add a task to the thread pool.
+ *
+ * If tract is NULL no tract is used.
+ *
+ * This may be called from any thread, including from the worker threads
+ * in the pool while they are running a task callback.
+ */
+int poThreadPool_runTask(struct POThreadPool *p,
+        uint32_t timeOut /*milliseconds is units of seconds/1000*/,
+        struct POThreadPool_tract *tract,
+        void *(*callback)(void *), void *callbackData)
+{
+    return poThreadPool_runTaskPriority(p, timeOut,
+            PO_THREADPOOL_PRIORITY_DEFAULT, tract, callback, callbackData);
+}
+
+
+int poThreadPool_runTaskPriority(struct POThreadPool *p,
+        uint32_t timeOut /*milliseconds is units of seconds/1000*/,
+        uint32_t priority,
+        struct POThreadPool_tract *tract,
+        void *(*callback)(void *), void *callbackData)
+{
+    DASSERT(p);
+    DASSERT(callback);
+
+    if(priority >= PO_THREADPOOL_NUM_PRIORITIES)
+        priority = PO_THREADPOOL_NUM_PRIORITIES - 1;
+
+    // The local deques do not have priorities, so only tasks with the
+    // default priority may go in them.
+    if(p->dequeLength && !tract &&
+            priority == PO_THREADPOOL_PRIORITY_DEFAULT && currentWorker &&
+            currentWorker->pool == p &&
+            dequePush(p, currentWorker, callback, callbackData))
+        // This is a worker thread of this pool and we queued the task in
+        // its local deque without the pool mutex.
+        return 0;
+
+    mutexLock(&p->mutex);
+
+    DSPEW();
+
+    int ret;
+    ret = _poThreadPool_runTask(p, timeOut, priority, INFINITY, tract,
+            callback, callbackData, 0, NULL);
+
+    mutexUnlock(&p->mutex);
+
+    return ret;
+}
+
+
+int poThreadPool_runTaskDeadline(struct POThreadPool *p,
+        uint32_t timeOut /*milliseconds is units of seconds/1000*/,
+        double deadline,
+        struct POThreadPool_tract *tract,
+        void *(*callback)(void *), void *callbackData)
+{
+    DASSERT(p);
+    DASSERT(callback);
+
+    mutexLock(&p->mutex);
+
+    DSPEW("deadline=%.3lf", deadline);
+
+    int ret;
+    ret = _poThreadPool_runTask(p, timeOut, PO_THREADPOOL_PRIORITY_DEFAULT,
+            deadline, tract, callback, callbackData, 0, NULL);
+
+    mutexUnlock(&p->mutex);
+
+    return ret;
+}
+
+
+int poThreadPool_runTaskCopy(struct POThreadPool *p,
+        uint32_t timeOut /*milliseconds is units of seconds/1000*/,
+        struct POThreadPool_tract *tract,
+        void *(*callback)(void *payload),
+        const void *payload, uint32_t payloadSize)
+{
+    DASSERT(p);
+    DASSERT(callback);
+    DASSERT(payload);
+
+    if(!payloadSize || payloadSize > PO_THREADPOOL_PAYLOAD_SIZE)
+    {
+        ERROR("task payload size %"PRIu32" is not from 1 to %d",
+                payloadSize, PO_THREADPOOL_PAYLOAD_SIZE);
+        return PO_ERROR_INVALID; // fail
+    }
+
+    mutexLock(&p->mutex);
+
+    DSPEW("payloadSize=%"PRIu32, payloadSize);
+
+    int ret;
+    ret = _poThreadPool_runTask(p, timeOut, PO_THREADPOOL_PRIORITY_DEFAULT,
+            INFINITY, tract, callback, (void *) payload, payloadSize,
+            NULL);
+
+    mutexUnlock(&p->mutex);
+
+    return ret;
+}
+
+
+/* Add many tasks to the thread pool with one pool mutex lock.
+ *
+ * Returns the number of tasks that where accepted.
+ */
+uint32_t poThreadPool_runTasks(struct POThreadPool *p,
+        uint32_t timeOut /*milliseconds is units of seconds/1000*/,
+        const struct POThreadPool_taskEntry *entries, uint32_t numEntries)
+{
+    DASSERT(p);
+    DASSERT(entries || !numEntries);
+
+    uint32_t i;
+
+    if(!numEntries) return 0;
+
+    mutexLock(&p->mutex);
+
+    DSPEW("%"PRIu32" tasks", numEntries);
+
+    // Each task is given to an idle worker, a new worker, or queued just
+    // as in poThreadPool_runTask(), so we wake just one idle worker for
+    // each task that does not get queued.  We stop at the first task that
+    // can't be run or queued in the time given, so that the tasks that
+    // are accepted keep their order.
+    for(i = 0; i < numEntries; ++i)
+        if(_poThreadPool_runTask(p, timeOut,
+                    PO_THREADPOOL_PRIORITY_DEFAULT, INFINITY,
+                    entries[i].tract,
+                    entries[i].callback, entries[i].callbackData, 0,
+                    NULL))
+            break;
+
+    mutexUnlock(&p->mutex);
+
+    return i;
+}
+
+
+int poThreadPool_runTaskCancelable(struct POThreadPool *p,
+        uint32_t timeOut /*milliseconds is units of seconds/1000*/,
+        struct POThreadPool_tract *tract,
+        void *(*callback)(void *), void *callbackData,
+        void (*cancelCallback)(void *callbackData),
+        struct POThreadPool_taskHandle *handle)
+{
+    struct POThreadPool_task *task;
+    DASSERT(p);
+    DASSERT(callback);
+
+    // We do not use the local deques, since the tasks in them can't be
+    // cancelled.
+    mutexLock(&p->mutex);
+
+    DSPEW();
+
+    int ret;
+    ret = _poThreadPool_runTask(p, timeOut, PO_THREADPOOL_PRIORITY_DEFAULT,
+            INFINITY, tract, callback, callbackData, 0, &task);
+
+    if(task)
+        task->cancelCallback = cancelCallback;
+
+    if(handle)
+    {
+        handle->task = task;
+        handle->generation = task?task->generation:0;
+    }
+
+    mutexUnlock(&p->mutex);
+
+    return ret;
+}
+
+
+// We must have a threadPool mutex lock to call this.
+//
+// Remove the tract from the ready tract list.  This is O(the number of
+// ready tracts), but only cancelling the last task in the tract queue of
+// a tract that is waiting for a worker gets here.
+static inline
+void readyTractRemove(struct POThreadPool *p,
+        struct POThreadPool_tract *tract)
+{
+    struct POThreadPool_tract *t, *prev = NULL;
+
+    for(t = p->readyFront; t != tract; t = t->nextReady)
+    {
+        DASSERT(t);
+        prev = t;
+    }
+
+    if(prev)
+        prev->nextReady = tract->nextReady;
+    else
+        p->readyFront = tract->nextReady;
+    if(p->readyBack == tract)
+        p->readyBack = prev;
+    tract->nextReady = NULL;
+}
+
+
+// We must have a threadPool mutex lock to call this.
+//
+// Take a queued task out of the tract queue of its tract.  We have to
+// look for it, since the tract queue is singly linked.
+static inline
+void tractQueueRemove(struct POThreadPool *p,
+        struct POThreadPool_task *task)
+{
+    struct POThreadPool_tract *tract;
+    struct POThreadPool_task *t, *prev = NULL;
+    tract = task->tract;
+    DASSERT(tract);
+    DASSERT(task->queue == PO_TASK_TRACT);
+
+    for(t = tract->firstTask; t != task; t = t->next)
+    {
+        DASSERT(t);
+        prev = t;
+    }
+
+    if(prev)
+        prev->next = task->next;
+    else
+        tract->firstTask = task->next;
+    if(tract->lastTask == task)
+        tract->lastTask = prev;
+
+    if(!tract->firstTask && !tract->worker)
+        // The tract was waiting for a worker in the ready tract list,
+        // and has nothing to run now.
+        readyTractRemove(p, tract);
+}
+
+
+// Call the cancel callbacks of the cancelled tasks in the list linked by
+// next, without the pool mutex lock, and then put the tasks in the
+// unused stack.  The cancelled tasks are not in any list, so no other
+// thread will touch them until we put them back.
+static
+void cancelFinish(struct POThreadPool *p, struct POThreadPool_task *cancelled)
+{
+    struct POThreadPool_task *task;
+
+    for(task = cancelled; task; task = task->next)
+        if(task->cancelCallback)
+            task->cancelCallback(task->userData);
+
+    taskListUnusedPush(p, cancelled);
+}
+
+
+int poThreadPool_cancelTask(struct POThreadPool *p,
+        const struct POThreadPool_taskHandle *handle)
+{
+    struct POThreadPool_task *task;
+    struct POThreadPool_tract *tract;
+    void *(*drainedCallback)(void *) = NULL;
+    void *drainedData = NULL;
+
+    DASSERT(p);
+    DASSERT(handle);
+
+    if(!(task = handle->task))
+        return 1; // It was not queued.
+
+    mutexLock(&p->mutex);
+
+    if(task->generation != handle->generation ||
+            task->queue == PO_TASK_UNUSED)
+    {
+        // It's running, or it ran or was cancelled and the task struct
+        // may be used for another task now.
+        mutexUnlock(&p->mutex);
+        return 1;
+    }
+
+    if(task->queue == PO_TASK_GENERAL)
+        generalQueueRemove(p, task);
+    else
+        tractQueueRemove(p, task);
+    task->queue = PO_TASK_UNUSED;
+    task->next = NULL;
+
+    if((tract = task->tract))
+    {
+        DASSERT(tract->taskCount > 0);
+        --tract->taskCount;
+        tractQueuedRemove(tract, task);
+        drainedCallback = cancelTractDrained(p, tract, &drainedData);
+    }
+
+    mutexUnlock(&p->mutex);
+
+    cancelFinish(p, task);
+
+    if(drainedCallback)
+        drainedCallback(drainedData);
+
+    return 0; // success
+}
+
+
+uint32_t poThreadPool_cancelTract(struct POThreadPool *p,
+        struct POThreadPool_tract *tract)
+{
+    struct POThreadPool_task *task, *cancelled = NULL;
+    void *(*drainedCallback)(void *) = NULL;
+    void *drainedData = NULL;
+    uint32_t n = 0;
+
+    DASSERT(p);
+    DASSERT(tract);
+
+    mutexLock(&p->mutex);
+
+    // The tract queue goes all at once.
+    if(tract->firstTask)
+    {
+        if(!tract->worker)
+            // It's in the ready tract list.
+            readyTractRemove(p, tract);
+        for(task = tract->firstTask; task; task = task->next)
+            task->queue = PO_TASK_UNUSED;
+        tract->firstTask = NULL;
+        tract->lastTask = NULL;
+    }
+
+    // The rest of the queued tasks are in the General queue.  They are
+    // listed newest first, so the cancelled stack is oldest first.
+    while((task = tract->queued))
+    {
+        if(task->queue == PO_TASK_GENERAL)
+            generalQueueRemove(p, task);
+        task->queue = PO_TASK_UNUSED;
+        DASSERT(tract->taskCount > 0);
+        --tract->taskCount;
+        tractQueuedRemove(tract, task);
+        task->next = cancelled;
+        cancelled = task;
+        ++n;
+    }
+    DASSERT(!tract->taskCount);
+
+    if(n)
+        drainedCallback = cancelTractDrained(p, tract, &drainedData);
+
+    mutexUnlock(&p->mutex);
+
+    if(n)
+    {
+        INFO("cancelled %"PRIu32" tasks in tract(%p)", n, tract);
+        cancelFinish(p, cancelled);
+    }
+
+    if(drainedCallback)
+        drainedCallback(drainedData);
+
+    return n;
+}
+
+
+void poThreadPool_futureInit(struct POThreadPool_future *future,
+        void (*continuation)(struct POThreadPool_future *future,
+            void *continuationData),
+        void *continuationData)
+{
+    DASSERT(future);
+
+    memset(future, 0, sizeof(*future));
+    future->state = PO_THREADPOOL_FUTURE_DONE;
+    future->continuation = continuation;
+    future->continuationData = continuationData;
+}
+
+
+// The task callback of tasks with a future.  It runs the user callback
+// and finishes the future.
+static
+void *futureCallback(struct POThreadPool_future *future)
+{
+    DASSERT(future);
+    DASSERT(future->state != PO_THREADPOOL_FUTURE_DONE);
+
+    future->result = future->userCallback(future->userData);
+
+    if(future->continuation)
+        future->continuation(future, future->continuationData);
+
+    // After we set the state the waiters may return and reuse or free
+    // the future, so we do not read it after this.  We learn if there
+    // are waiters from the state we replace.  The futex wake only uses
+    // the address, and it's harmless if the memory was freed or reused.
+    if(__atomic_exchange_n(&future->state, PO_THREADPOOL_FUTURE_DONE,
+            __ATOMIC_SEQ_CST) == PO_THREADPOOL_FUTURE_WAITED)
+        futexWakeAll(&future->state);
+
+    return NULL;
+}
+
+
+int poThreadPool_runTaskFuture(struct POThreadPool *p,
+        uint32_t timeOut /*milliseconds is units of seconds/1000*/,
+        struct POThreadPool_tract *tract,
+        struct POThreadPool_future *future,
+        void *(*callback)(void *), void *callbackData)
+{
+    DASSERT(p);
+    DASSERT(future);
+    DASSERT(callback);
+    DASSERT(future->state == PO_THREADPOOL_FUTURE_DONE);
+
+    future->result = NULL;
+    future->userCallback = callback;
+    future->userData = callbackData;
+    future->state = PO_THREADPOOL_FUTURE_PENDING;
+
+    int ret;
+    ret = poThreadPool_runTask(p, timeOut, tract,
+                (void *(*)(void *)) futureCallback, future);
+    if(ret)
+        future->state = PO_THREADPOOL_FUTURE_DONE;
+
+    return ret;
+}
+
+
+int poThreadPool_futureWait(struct POThreadPool_future *future,
+        uint32_t timeOut /*milliseconds is units of seconds/1000*/)
+{
+    DASSERT(future);
+
+    if(poThreadPool_futureIsDone(future))
+        return 0;
+
+    if(!timeOut)
+        return PO_ERROR_TIMEOUT;
+
+    double t = 0.0;
+    if(timeOut != PO_LONGTIME)
+        t = poTime_getDouble() + timeOut/1000.0;
+
+    // Tell the worker that there are waiters, unless it's done.
+    uint32_t state = PO_THREADPOOL_FUTURE_PENDING;
+    __atomic_compare_exchange_n(&future->state, &state,
+            PO_THREADPOOL_FUTURE_WAITED, false,
+            __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+
+    while(__atomic_load_n(&future->state, __ATOMIC_SEQ_CST) ==
+            PO_THREADPOOL_FUTURE_WAITED)
+    {
+        if(timeOut == PO_LONGTIME)
+        {
+            futexWait(&future->state, PO_THREADPOOL_FUTURE_WAITED);
+            continue;
+        }
+        // The futex can wake up without a change, so we keep track of
+        // the time left.
+        double left = t - poTime_getDouble();
+        if(left <= 0.0 ||
+                futexTimedWait(&future->state, PO_THREADPOOL_FUTURE_WAITED,
+                    (uint32_t) (left*1000.0) + 1) == ETIMEDOUT)
+            break;
+    }
+
+    // A waiter that timed out leaves the state as waited, which just
+    // costs the worker a futex wake.
+    if(!poThreadPool_futureIsDone(future))
+        return PO_ERROR_TIMEOUT;
+
+    return 0;
+}
+
+
+int poThreadPool_setWorkStealing(struct POThreadPool *p,
+        uint32_t dequeLength)
+{
+    DASSERT(p);
+    DASSERT(dequeLength);
+    DASSERT(dequeLength < 0xFFFFFFF0); // a stupid large amount
+
+    mutexLock(&p->mutex);
+
+    if(p->numThreads || p->dequeLength || !p->maxNumThreads ||
+            !dequeLength)
+    {
+        mutexUnlock(&p->mutex);
+        ERROR("work stealing must be set once before running tasks");
+        return 1; // fail
+    }
+
+    uint32_t i;
+    p->dequeEntry = alloc(sizeof(*p->dequeEntry)*
+            dequeLength*p->maxNumThreads);
+
+    for(i = 0; i < p->maxNumThreads; ++i)
+    {
+        mutexInit(&p->worker[i].deque.mutex);
+        p->worker[i].deque.entry = &p->dequeEntry[i*dequeLength];
+    }
+
+    p->dequeLength = dequeLength;
+
+    mutexUnlock(&p->mutex);
+
+    INFO("threadPool work stealing with %"PRIu32" task local deques",
+            dequeLength);
+
+    return 0; // success
+}
+
+
+// We must have the threadPool mutex lock to call this.
+//
+// Start threads, with no task, until there are numThreads threads or
+// there are no unused workers.  Returns the number of threads started.
+static inline
+uint32_t prespawn(struct POThreadPool *p, uint32_t numThreads)
+{
+    uint32_t n = 0;
+
+    if(numThreads > threadCap(p))
+        numThreads = threadCap(p);
+
+    while(p->numThreads < numThreads && p->workers.unused)
+    {
+        workerUnusedPop(p, NULL, NULL, NULL, 0, 0);
+        ++n;
+    }
+
+    return n;
+}
+
+
+uint32_t poThreadPool_prespawn(struct POThreadPool *p,
+        uint32_t numThreads)
+{
+    DASSERT(p);
+
+    mutexLock(&p->mutex);
+
+    uint32_t ret;
+    ret = prespawn(p, numThreads);
+
+    mutexUnlock(&p->mutex);
+
+    INFO("pre-spawning %"PRIu32" threads", ret);
+
+    return ret;
+}
+
+
+uint32_t poThreadPool_setMinIdleThreads(struct POThreadPool *p,
+        uint32_t minIdleThreads)
+{
+    DASSERT(p);
+
+    mutexLock(&p->mutex);
+
+    if(minIdleThreads > p->threadLimit)
+        minIdleThreads = p->threadLimit;
+
+    if(minIdleThreads < p->minIdleThreads)
+    {
+        // Idle workers that where kept for the old floor wait with no
+        // time-out, so we wake them to start timing out again.
+        struct POThreadPool_worker *w;
+        for(w = p->workers.idleBack; w; w = w->next)
+            futexWake(&w->handoff);
+    }
+
+    p->minIdleThreads = minIdleThreads;
+
+    // Start the idle threads now, so that the first tasks do not wait for
+    // threads to be created.
+    uint32_t ret;
+    ret = prespawn(p, p->numThreads - p->workers.idleLength +
+            minIdleThreads);
+
+    mutexUnlock(&p->mutex);
+
+    INFO("keeping at least %"PRIu32" idle threads, pre-spawning %"
+            PRIu32" threads", minIdleThreads, ret);
+
+    return ret;
+}
+
+
+// Make the number of threads fit threadCap() after it changed.  If it's
+// lower than the number of threads, the oldest idle threads exit now and
+// the working threads above it exit when they run out of work.  If it's
+// higher and there are queued tasks, we start threads for them.  We must
+// have the pool mutex lock to call this.
+static inline
+void fitThreads(struct POThreadPool *p)
+{
+    uint32_t cap = threadCap(p);
+
+    if(p->numThreads > cap)
+    {
+        uint32_t n = p->numThreads - cap;
+        double t = poTime_getDouble();
+        while(n-- && p->workers.idleFront)
+            workerOldIdlePopSignal(p, t);
+    }
+    else if(p->tasks.queueLength)
+        // There may be queued tasks that now can have threads.  The new
+        // threads will find them in the queue.
+        prespawn(p, p->numThreads + p->tasks.queueLength);
+}
+
+
+// Set the limit on the number of threads.  We must have the pool mutex
+// lock to call this.
+static inline
+void setThreadLimit(struct POThreadPool *p, uint32_t threadLimit)
+{
+    DASSERT(threadLimit <= p->maxNumThreads);
+
+    __atomic_store_n(&p->threadLimit, threadLimit, __ATOMIC_RELAXED);
+
+    fitThreads(p);
+}
+
+
+// The adaptive concurrency controller.  The spawner thread calls this
+// once every period with the pool mutex lock.
+//
+// This hill-climbs on throughput, the tasks finished per second, like
+// the .NET thread pool does.  Each period we compare the throughput with
+// that of the last period.  If it got better we move the thread limit
+// another step in the same direction, else we turn around.  So the limit
+// climbs while more threads finish more tasks, as with tasks that block,
+// and backs off when they do not, as with tasks that keep the CPUs busy,
+// and then it walks back and forth around the best limit.
+//
+// We only climb when tasks are waiting, in the General queue or to get
+// in it.  If tasks do not wait for threads the limit is not holding the
+// pool back, and idle threads retire with the idle time-out anyway.
+static
+void adaptThreadLimit(struct POThreadPool *p, double t)
+{
+    struct POThreadPool_adaptive *a = &p->adaptive;
+    uint64_t tasksRun = tasksRunTotal(p);
+    uint64_t numFullWaits = p->stats.numFullWaits;
+    double throughput = (tasksRun - a->lastTasksRun)/(t - a->lastTime);
+    uint32_t threadLimit = p->threadLimit;
+
+    if(!p->tasks.queueLength && !p->numTaskWaiters &&
+            numFullWaits == a->lastFullWaits)
+        // No tasks waited.  We start climbing again, from this limit,
+        // when they do.
+        throughput = -1.0;
+    else if(tasksRun == a->lastTasksRun)
+        // Tasks waited and no tasks finished.  The threads are stuck in
+        // their tasks, so we add a thread.
+        a->step = 1;
+    else
+    {
+        if(a->lastThroughput >= 0.0 && throughput <
+                a->lastThroughput*(1.0 + PO_THREADPOOL_ADAPTIVE_THRESHOLD))
+            // The last step did not make it better, so turn around.
+            a->step = -a->step;
+
+        // Turn around at the ends of the range.
+        if(a->step > 0 && threadLimit >= p->maxNumThreads)
+            a->step = -1;
+        else if(a->step < 0 && threadLimit <= a->floor)
+            a->step = 1;
+    }
+
+    if(throughput >= 0.0)
+    {
+        threadLimit += a->step;
+        if(threadLimit > p->maxNumThreads)
+            threadLimit = p->maxNumThreads;
+        else if(threadLimit < a->floor)
+            threadLimit = a->floor;
+
+        if(threadLimit != p->threadLimit)
+        {
+            DSPEW("throughput %g tasks/s, thread limit %"PRIu32
+                    " -> %"PRIu32, throughput, p->threadLimit,
+                    threadLimit);
+            setThreadLimit(p, threadLimit);
+        }
+    }
+
+    a->lastThroughput = throughput;
+    a->lastTime = t;
+    a->lastTasksRun = tasksRun;
+    a->lastFullWaits = numFullWaits;
+}
+
+
+int poThreadPool_resize(struct POThreadPool *p,
+        uint32_t maxNumThreads, uint32_t maxQueueLength)
+{
+    DASSERT(p);
+
+    if(maxNumThreads > p->maxNumThreads || (!maxNumThreads &&
+                p->maxNumThreads))
+    {
+        ERROR("the number of threads, %"PRIu32", is not from 1 to %"
+                PRIu32, maxNumThreads, p->maxNumThreads);
+        return 1; // fail
+    }
+
+    mutexLock(&p->mutex);
+
+    if(p->cleanup)
+    {
+        mutexUnlock(&p->mutex);
+        ERROR("the pool is being destroyed");
+        return 1; // fail
+    }
+
+    if(maxQueueLength > p->maxQueueLength)
+    {
+        // Grow the queue.  First we take back the tasks that we where
+        // going to retire, then the retired tasks, and then allocate
+        // more tasks.
+        uint32_t n = maxQueueLength - p->maxQueueLength;
+        uint32_t m = (n < p->tasks.numToRetire)?n:p->tasks.numToRetire;
+        p->tasks.numToRetire -= m;
+        n -= m;
+
+        while(n && p->tasks.retired)
+        {
+            struct POThreadPool_task *task = p->tasks.retired;
+            p->tasks.retired = task->next;
+            taskUnusedPush(p, task);
+            --n;
+        }
+
+        if(n)
+        {
+            struct POThreadPool_taskChunk *chunk;
+            struct POThreadPool_task **heap = NULL;
+            chunk = alloc(sizeof(*chunk) + n*sizeof(chunk->task[0]));
+            if(p->tasks.heap)
+                heap = realloc(p->tasks.heap, sizeof(*heap)*
+                        (p->tasks.numAllocated + n));
+            if(!chunk || (p->tasks.heap && ASSERT(heap)))
+            {
+                if(chunk)
+                    free(chunk);
+                mutexUnlock(&p->mutex);
+                return 1; // fail
             }
+            if(heap)
+                p->tasks.heap = heap;
+
+            chunk->length = n;
+            chunk->next = p->taskChunks;
+            p->taskChunks = chunk;
+            p->tasks.numAllocated += n;
+
+            uint32_t i;
+            for(i = 0; i < n; ++i)
+                taskUnusedPush(p, &chunk->task[i]);
         }
 
-        // Task is moved to the unused stack
-        task->next = p->tasks.unused;
-        p->tasks.unused = task;
+        if(p->numTaskWaiters)
+            // There is room for the waiting submitting threads now.
+            ASSERT((errno = pthread_cond_broadcast(&p->taskCond)) == 0);
+    }
+    else if(maxQueueLength < p->maxQueueLength)
+    {
+        // Shrink the queue.  We retire the unused tasks now and the rest
+        // of them as they are finished with.
+        uint32_t n = p->maxQueueLength - maxQueueLength;
+        while(n && p->tasks.unused)
+        {
+            struct POThreadPool_task *task = p->tasks.unused;
+            p->tasks.unused = task->next;
 #ifdef DEBUG
-        ++p->tasks.unusedLength;
+            --p->tasks.unusedLength;
 #endif
+            task->next = p->tasks.retired;
+            p->tasks.retired = task;
+            --n;
+        }
+        p->tasks.numToRetire += n;
+    }
+    p->maxQueueLength = maxQueueLength;
 
- 
-        *userData = task->userData;
-        return task->userCallback;
+    if(p->minIdleThreads > maxNumThreads)
+        p->minIdleThreads = maxNumThreads;
+
+    // The adaptive concurrency controller, if it's on, goes on from this
+    // limit.
+    if(p->adaptive.floor > maxNumThreads)
+        p->adaptive.floor = maxNumThreads;
+    p->adaptive.lastThroughput = -1.0;
+
+    setThreadLimit(p, maxNumThreads);
+
+    mutexUnlock(&p->mutex);
+
+    INFO("threadPool resized to %"PRIu32" threads and queue length %"
+            PRIu32, maxNumThreads, maxQueueLength);
+
+    return 0; // success
+}
+
+
+int poThreadPool_setAdaptiveConcurrency(struct POThreadPool *p,
+        uint32_t minNumThreads, uint32_t period)
+{
+    DASSERT(p);
+
+    if(period && (!minNumThreads || minNumThreads > p->maxNumThreads))
+    {
+        ERROR("the minimum number of threads, %"PRIu32", is not from 1 to %"
+                PRIu32, minNumThreads, p->maxNumThreads);
+        return 1; // fail
     }
 
+    mutexLock(&p->mutex);
 
-    // At this point there is no work, except work that is bound to
-    // another worker, but not this worker.
+    if(p->cleanup)
+    {
+        mutexUnlock(&p->mutex);
+        ERROR("the pool is being destroyed");
+        return 1; // fail
+    }
 
-    if(worker->tract)
+    p->adaptive.period = period;
+    p->adaptive.floor = minNumThreads;
+    p->adaptive.step = 1;
+    p->adaptive.lastThroughput = -1.0;
+    p->adaptive.lastTime = poTime_getDouble();
+    p->adaptive.lastTasksRun = tasksRunTotal(p);
+    p->adaptive.lastFullWaits = p->stats.numFullWaits;
+
+    if(period)
     {
-        DSPEW("no work for tract(%p)", worker->tract);
-        // This worker was working on a tract, but now there is no work
-        // available now.  The tract still exists for the user, but
-        // there is no need to bind this worker to this particular tract
-        // anymore.
+        if(p->threadLimit < minNumThreads)
+            setThreadLimit(p, minNumThreads);
+        // Wake the spawner thread so it starts timing the periods.
+        ASSERT((errno = pthread_cond_signal(&p->spawnCond)) == 0);
+    }
 
-        // An Idle worker should not be bound to a tract so that we can
-        // have other tracts use the idle worker.
-        DASSERT(worker->tract->worker == worker);
-        DASSERT(!worker->tract->firstTask);
-        DASSERT(!worker->tract->lastTask);
+    mutexUnlock(&p->mutex);
 
-        // Unbind this worker from the tract.
-        worker->tract->worker = NULL;
-        worker->tract = NULL;
+    if(period)
+    {
+        INFO("threadPool adaptive concurrency from %"PRIu32" to %"PRIu32
+                " threads every %"PRIu32" milliseconds", minNumThreads,
+                p->maxNumThreads, period);
+    }
+    else
+    {
+        INFO("threadPool adaptive concurrency is off");
     }
 
-    // Sorry worker, you are unemployed with no tract.
-    return NULL;
+    return 0; // success
 }
 
 
-static inline
-bool lastWorkerSignalCleanup(struct POThreadPool *p)
+// We must have the threadPool mutex lock to call this.
+//
+// Put the tasks that, at nanoTime() t, have run longer than threshold
+// nanoseconds in hungTask, up to max of them, and return how many there
+// are.  If newOnly is set we skip the tasks that we found before, and
+// mark the ones that we find.
+static
+uint32_t findHungTasks(struct POThreadPool *p, uint64_t t,
+        uint64_t threshold, struct POThreadPool_hungTask *hungTask,
+        uint32_t max, bool newOnly)
 {
-    if(p->cleanup)
+    struct POThreadPool_worker *worker;
+    uint64_t cutoff;
+    uint32_t n = 0;
+
+    if(t < threshold)
+        return 0;
+    cutoff = t - threshold;
+
+    // The working list is ordered by workingSince, and the worker starts
+    // its task after it's put in the list, so we stop at the first
+    // worker that was put in the list after the cutoff.  The workers
+    // that run tasks from their local deque are in the list since they
+    // got a task with the pool mutex, so they may be in front of workers
+    // with older tasks, but never behind the cutoff.
+    for(worker = p->workers.workingFront;
+            worker && n < max && worker->workingSince <= cutoff;
+            worker = worker->workingNext)
     {
-        // cleanup is set by the master when it is waiting.
-        if(p->numThreads == 1)
+        struct POThreadPool_hungTask *h;
+        uint64_t start;
+
+        start = __atomic_load_n(&worker->taskStart, __ATOMIC_ACQUIRE);
+        if(!start || start > cutoff ||
+                (newOnly && start == worker->hungStart))
+            continue;
+
+        h = &hungTask[n];
+        h->callback = __atomic_load_n(&worker->taskCallback,
+                __ATOMIC_RELAXED);
+        h->callbackData = __atomic_load_n(&worker->taskUserData,
+                __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if(__atomic_load_n(&worker->taskStart, __ATOMIC_RELAXED) != start)
+            // The task finished while we looked at it.
+            continue;
+
+        // worker->tract is only changed with the pool mutex lock.
+        h->tract = worker->tract;
+        h->worker = worker - p->worker;
+        h->runTime = (t - start)*1.0e-9;
+        if(newOnly)
+            worker->hungStart = start;
+        ++n;
+    }
+
+    return n;
+}
+
+
+// The spawner thread calls this with the pool mutex lock.  It calls the
+// watchdog hook for each task that has run longer than the watchdog
+// threshold since the last time, without the pool mutex lock so that the
+// hook may call into the pool.
+static
+void watchdog(struct POThreadPool *p, uint64_t t)
+{
+    uint32_t i, n;
+
+    n = findHungTasks(p, t, p->watchdogThreshold, p->hungTask,
+            p->maxNumThreads, true);
+    if(!n)
+        return;
+
+    mutexUnlock(&p->mutex);
+
+    for(i = 0; i < n; ++i)
+    {
+        WARN("task callback %p has run %.3lf seconds in worker %"PRIu32,
+                p->hungTask[i].callback, p->hungTask[i].runTime,
+                p->hungTask[i].worker);
+        p->watchdogHook(p, &p->hungTask[i], p->watchdogData);
+    }
+
+    mutexLock(&p->mutex);
+}
+
+
+int poThreadPool_setWatchdog(struct POThreadPool *p, uint32_t threshold,
+        void (*hook)(struct POThreadPool *p,
+            const struct POThreadPool_hungTask *hungTask, void *hookData),
+        void *hookData)
+{
+    DASSERT(p);
+
+    mutexLock(&p->mutex);
+
+    if(p->numThreads || p->watchdogThreshold || !p->maxNumThreads ||
+            !threshold)
+    {
+        mutexUnlock(&p->mutex);
+        ERROR("the watchdog must be set once, with a threshold, before "
+                "running tasks");
+        return 1; // fail
+    }
+
+    if(hook)
+    {
+        p->hungTask = calloc(p->maxNumThreads, sizeof(*p->hungTask));
+        if(VASSERT(p->hungTask, "calloc() failed"))
         {
-            // This is the last thread.  Signal the master
-            // on the way out.
-            ASSERT((errno = pthread_cond_signal(&p->cond)) == 0);
-#ifdef DEBUG
-            p->cleanup = false; // sanity check
-#endif
+            mutexUnlock(&p->mutex);
+            return 1; // fail
         }
-        return true;
     }
-    return false;
+
+    p->watchdogThreshold = threshold*((uint64_t) 1000000);
+    p->watchdogHook = hook;
+    p->watchdogData = hookData;
+    p->watchdogLastTime = nanoTime();
+
+    if(hook)
+        // Wake the spawner thread so it starts timing the watchdog.
+        ASSERT((errno = pthread_cond_signal(&p->spawnCond)) == 0);
+
+    mutexUnlock(&p->mutex);
+
+    INFO("threadPool watchdog for tasks that run more than %"PRIu32
+            " milliseconds %s a hook", threshold, hook?"with":"without");
+
+    return 0; // success
 }
 
 
-static void
-*workerPthreadCallback(struct POThreadPool_worker *worker)
+uint32_t poThreadPool_getHungTasks(struct POThreadPool *p,
+        uint32_t threshold, struct POThreadPool_hungTask *hungTasks,
+        uint32_t maxHungTasks)
 {
-    DASSERT(worker);
-    DASSERT(worker->pool);
-    struct POThreadPool *p;
-    pthread_mutex_t *pmutex /*pool mutex*/;
-    p = worker->pool;
-    pmutex = &p->mutex;
+    uint32_t n;
 
-    // This worker here now is not in any threadPool worker list.
+    DASSERT(p);
+    DASSERT(hungTasks || !maxHungTasks);
 
+    if(!p->watchdogThreshold)
+        // The working workers are not listed.
+        return 0;
 
-         /////////////////////////////////////////////////|
-        ////////////// ACCESSING POOL DATA ////////////////|
-       /////////////////////////////////////////////////////|
-      /////                                              \///|
-     /*-*/              mutexLock(pmutex);                ////|
-    /////                                                  \///|
+    mutexLock(&p->mutex);
 
+    n = findHungTasks(p, nanoTime(), threshold*((uint64_t) 1000000),
+            hungTasks, maxHungTasks, false);
 
-    void *(*userCallback)(void *);
-    void *userData;
+    mutexUnlock(&p->mutex);
 
-    // Copy data to the stack in case things change while we did not
-    // have the pmutex lock while we were calling the user callback.
+    return n;
+}
 
-    userCallback = worker->userCallback;
-    userData = worker->userData;
 
-    ++p->numThreads;
-    DASSERT(p->numThreads <= p->maxNumThreads);
+int poThreadPool_blockingBegin(struct POThreadPool *p)
+{
+    DASSERT(p);
 
-    // extra spaces to line up with other print below
-    INFO("adding thread, there are now %"PRIu32" idle or working threads",
-            p->numThreads);
+    struct POThreadPool_worker *worker = currentWorker;
+
+    if(!worker || worker->pool != p)
+    {
+        ERROR("poThreadPool_blockingBegin() must be called from a task"
+                " callback of pool(%p)", p);
+        return 1; // fail
+    }
 
-    // Now tell the manager thread to proceed:
-    //
-    // This is signaling the thread at function void launchWorkerThread()
-    // from a user call to poThreadPool_runTask().
-    ASSERT((errno = pthread_cond_signal(&p->cond)) == 0);
+    if(worker->blocking)
+    {
+        // Nested, so this worker is counted already.
+        ++worker->blocking;
+        return 0; // success
+    }
 
+    mutexLock(&p->mutex);
 
-    while(true)
+    if(p->threadLimit + p->numBlocking >= p->maxNumThreads)
     {
-        // This should not be in the idle or unused worker list; it's a
-        // working worker, which by definition has next == NULL.
-        DASSERT(!worker->next);
+        // The thread cap can't go up, so the caller would not get
+        // another thread while it blocks.
+        mutexUnlock(&p->mutex);
+        NOTICE("pool(%p) has no room for another thread above its"
+                " thread limit of %"PRIu32, p, p->threadLimit);
+        return 1; // fail
+    }
 
-        worker->userCallback = NULL;
+    worker->blocking = 1;
 
-        DASSERT(!worker->tract || (worker->tract->worker == worker));
-        DSPEW("tract(%p)", worker->tract);
-        worker->isWorking = true;
+    // The thread cap goes up by one, so if there are queued tasks an
+    // unused worker may get a thread to work on them while this thread
+    // blocks.
+    __atomic_store_n(&p->numBlocking, p->numBlocking + 1,
+            __ATOMIC_RELAXED);
+    fitThreads(p);
 
-        ////|                                                  /////
-         /*-*/             mutexUnlock(pmutex);               /////
-          /////                                              /////
-           //////////////////////////////////////////////////////
-            /////////// FINISHED ACCESSING POOL DATA ///////////
-             //////////////////////////////////////////////////
+    mutexUnlock(&p->mutex);
 
-        DSPEW("starting task");
+    return 0; // success
+}
 
-        //////////////// go to work on the task ///////////////////
-        userCallback(userData); // working callback
-        ////////////////// finished work on task //////////////////
 
-        DSPEW("finished task");
+int poThreadPool_blockingEnd(struct POThreadPool *p)
+{
+    DASSERT(p);
 
+    struct POThreadPool_worker *worker = currentWorker;
 
-             /////////////////////////////////////////////////|
-            ////////////// ACCESSING POOL DATA ////////////////|
-           /////////////////////////////////////////////////////|
-          /////                                              \///|
-         /*-*/              mutexLock(pmutex);                ////|
-        /////                                                  \///|
+    if(!worker || worker->pool != p || !worker->blocking)
+    {
+        ERROR("poThreadPool_blockingEnd() must be called from a task"
+                " callback of pool(%p) after poThreadPool_blockingBegin()",
+                p);
+        return 1; // fail
+    }
 
-        worker->userCallback = false;
-        DASSERT(!worker->tract ||
-            (worker->tract->worker == worker));
+    if(--worker->blocking)
+        return 0; // success, still in the outer blocking region
 
-        if(p->taskWaitingToBeRun)
-        {
-            p->taskWaitingToBeRun = false;
-            ASSERT((errno = pthread_cond_signal(&p->cond)) == 0);
-            // We'll get this waiting task after the managing
-            // thread starts running again, but not while
-            // we hold this mutex lock.
-        }
+    mutexLock(&p->mutex);
 
-        if((userCallback = lookForWork(p, worker, &userData)))
-            continue;
+    DASSERT(p->numBlocking);
+    // If the pool is over the thread cap now, an idle thread exits now,
+    // or a working thread exits when it runs out of work.
+    __atomic_store_n(&p->numBlocking, p->numBlocking - 1,
+            __ATOMIC_RELAXED);
+    fitThreads(p);
 
-        if(lastWorkerSignalCleanup(p))
-            break;
+    mutexUnlock(&p->mutex);
 
-        // This worker may not be assigned to a tract, otherwise
-        // lookForWork() would have found work.
-        DASSERT(!worker->tract);
+    return 0; // success
+}
 
 
-        // So we can tell if we get a new task after this.
-        worker->userCallback = NULL;
+int poThreadPool_setDeadlineMode(struct POThreadPool *p,
+        void *(*expiredCallback)(void *))
+{
+    DASSERT(p);
 
-        worker->lastWorkTime = poTime_getDouble();
+    mutexLock(&p->mutex);
 
-        // Put this worker in the idle worker list so that the managing
-        // thread can signal it to put it back to work or make it return.
-        DASSERT(!worker->prev);
-        DASSERT(!worker->next);
-        worker->next = p->workers.idleBack;
-        if(p->workers.idleBack)
+    if(p->numThreads || p->tasks.heap || !p->tasks.numAllocated)
+    {
+        mutexUnlock(&p->mutex);
+        ERROR("deadline mode must be set once before running tasks"
+                " in a pool with a queue");
+        return 1; // fail
+    }
+
+    p->tasks.heap = alloc(sizeof(*p->tasks.heap)*p->tasks.numAllocated);
+    p->expiredCallback = expiredCallback;
+
+    mutexUnlock(&p->mutex);
+
+    INFO("threadPool deadline mode %s expired callback",
+            expiredCallback?"with":"without");
+
+    return 0; // success
+}
+
+
+int poThreadPool_setAffinity(struct POThreadPool *p,
+        const uint32_t *cpus, uint32_t numCpus)
+{
+    DASSERT(p);
+    DASSERT(cpus);
+    DASSERT(numCpus);
+
+    cpu_set_t allowed;
+    uint32_t i;
+
+    // We can only use the CPUs that this process may run on.
+    ASSERT(sched_getaffinity(0, sizeof(allowed), &allowed) == 0);
+
+    for(i = 0; i < numCpus; ++i)
+        if(cpus[i] >= CPU_SETSIZE || !CPU_ISSET(cpus[i], &allowed))
         {
-            DASSERT(p->workers.idleFront);
-            p->workers.idleBack->prev = worker;
+            ERROR("CPU %"PRIu32" is not available", cpus[i]);
+            return 1; // fail
         }
-        else
+
+    mutexLock(&p->mutex);
+
+    if(p->numThreads || p->numCpus || !numCpus)
+    {
+        mutexUnlock(&p->mutex);
+        ERROR("affinity must be set once before running tasks");
+        return 1; // fail
+    }
+
+    p->cpu = alloc(sizeof(*p->cpu)*numCpus);
+    memcpy(p->cpu, cpus, sizeof(*p->cpu)*numCpus);
+    p->numCpus = numCpus;
+
+    mutexUnlock(&p->mutex);
+
+    INFO("threadPool workers pinned to %"PRIu32" CPUs", numCpus);
+
+    return 0; // success
+}
+
+
+uint32_t poThreadPool_getNodeCpus(uint32_t node,
+        uint32_t *cpus, uint32_t maxCpus)
+{
+    DASSERT(cpus || !maxCpus);
+
+    char path[128];
+    FILE *file;
+    uint32_t n = 0;
+
+    snprintf(path, sizeof(path),
+            "/sys/devices/system/node/node%"PRIu32"/cpulist", node);
+
+    if(!(file = fopen(path, "r")))
+    {
+        NOTICE("can't open \"%s\"", path);
+        return 0;
+    }
+
+    // The list looks like: "0-3,8-11\n"
+    unsigned int first, last;
+    int c;
+    while(fscanf(file, "%u", &first) == 1)
+    {
+        last = first;
+        if((c = fgetc(file)) == '-')
         {
-            DASSERT(!p->workers.idleFront);
-            p->workers.idleFront = worker;
+            if(fscanf(file, "%u", &last) != 1)
+                break;
+            c = fgetc(file);
         }
-        p->workers.idleBack = worker;
-#ifdef DEBUG
-        ++p->workers.idleLength;
-#endif
-
-        ///////////////////////////////////////////////////////////////
-        ////////////////////// IDLE WORKER SLEEP //////////////////////
-        ///////////////////////////////////////////////////////////////
-        // We wait until the manager pops this worker off for new task.
-        //
-        // pthread_cond_wait() does unlock pmutex, wait for signal,
-        // and then lock pmutex when signaled:
-        condWait(&worker->cond, pmutex);
-        // Note: a thread can sit here an arbitrary amount of time,
-        // even if it is signaled.
-        ///////////////////////////////////////////////////////////////
+        for(; first <= last; ++first)
+        {
+            if(n < maxCpus)
+                cpus[n] = first;
+            ++n;
+        }
+        if(c != ',')
+            break;
+    }
 
-        if((userCallback = lookForWork(p, worker, &userData)))
-            continue;
+    fclose(file);
 
-        lastWorkerSignalCleanup(p);
+    return n;
+}
 
-        break; // this thread will exit
 
-    } ///////////////////////////// while(true) loop
+void poThreadPool_getStats(struct POThreadPool *p,
+        struct POThreadPool_stats *stats)
+{
+    DASSERT(p);
+    DASSERT(stats);
+
+    uint32_t i;
+
+    // We do not get the pool mutex lock, so the values may be changing
+    // as we read them, and may not add up exactly.
+    stats->numThreads = __atomic_load_n(&p->numThreads, __ATOMIC_RELAXED);
+    stats->numIdleThreads = __atomic_load_n(&p->workers.idleLength,
+            __ATOMIC_RELAXED);
+    if(stats->numIdleThreads > stats->numThreads)
+        stats->numIdleThreads = stats->numThreads;
+    stats->numWorkingThreads = stats->numThreads - stats->numIdleThreads;
+    stats->queueLength = __atomic_load_n(&p->tasks.queueLength,
+            __ATOMIC_RELAXED);
+
+    stats->threadLimit = __atomic_load_n(&p->threadLimit,
+            __ATOMIC_RELAXED);
+    stats->numBlocking = __atomic_load_n(&p->numBlocking,
+            __ATOMIC_RELAXED);
+
+    stats->tasksRun = tasksRunTotal(p);
+    stats->tasksStolen = 0;
+    for(i = 0; i < p->maxNumThreads; ++i)
+        stats->tasksStolen += __atomic_load_n(
+                &p->workerStats[i].tasksStolen, __ATOMIC_RELAXED);
+
+    stats->numRejected = __atomic_load_n(&p->stats.numRejected,
+            __ATOMIC_RELAXED);
+    stats->numFullWaits = __atomic_load_n(&p->stats.numFullWaits,
+            __ATOMIC_RELAXED);
+    stats->fullWaitTime = __atomic_load_n(&p->stats.fullWaitNanoseconds,
+            __ATOMIC_RELAXED) * 1.0e-9;
+    stats->numExpired = __atomic_load_n(&p->stats.numExpired,
+            __ATOMIC_RELAXED);
+}
 
 
-    --p->numThreads;
+int poThreadPool_setHistograms(struct POThreadPool *p)
+{
+    DASSERT(p);
 
-    INFO("removing thread, there are now %"PRIu32" idle or working threads",
-                p->numThreads);
+    mutexLock(&p->mutex);
 
-    // put this worker in the unused worker stack
-    worker->next = p->workers.unused;
-    p->workers.unused = worker;
+    if(p->numThreads || p->histograms || !p->maxNumThreads)
+    {
+        mutexUnlock(&p->mutex);
+        ERROR("histograms must be set once before running tasks");
+        return 1; // fail
+    }
 
-#ifdef DEBUG
-    ++p->workers.unusedLength;
-    DASSERT(p->maxNumThreads > p->numThreads);
-#endif
+    // Each worker gets its own histograms, starting on their own cache
+    // line.
+    ASSERT(posix_memalign((void **) &p->histograms, 64,
+                sizeof(*p->histograms)*p->maxNumThreads) == 0);
+    memset(p->histograms, 0, sizeof(*p->histograms)*p->maxNumThreads);
 
-    ////|                                                  /////
-     /*-*/             mutexUnlock(pmutex);               /////
-      /////                                              /////
-       //////////////////////////////////////////////////////
-        /////////// FINISHED ACCESSING POOL DATA ///////////
-         //////////////////////////////////////////////////
+    mutexUnlock(&p->mutex);
 
-#ifdef PO_THREADPOOL_DETACH
-    ASSERT((errno = pthread_detach(pthread_self())) == 0);
-#endif
+    INFO("threadPool recording task latency histograms");
 
-    return NULL;
+    return 0; // success
 }
 
 
-// We must have the threadPool mutex lock to call this.
-static inline
-void launchWorkerThread(struct POThreadPool *p,
-        struct POThreadPool_worker *worker)
+void poThreadPool_getHistograms(struct POThreadPool *p,
+        struct POThreadPool_histograms *histograms)
 {
-    pthread_attr_t attr;
+    DASSERT(p);
+    DASSERT(histograms);
 
-    DASSERT(p->numThreads < p->maxNumThreads);
-    ASSERT((errno = pthread_attr_init(&attr)) == 0);
+    memset(histograms, 0, sizeof(*histograms));
 
-#if 0 // For Debugging stack size.
-    size_t stackSize;
-    ASSERT((errno = pthread_attr_getstacksize(&attr, &stackSize)) == 0);
-    ERROR("stacksize= %zu MBytes", stackSize/(1024*1024));
-#endif
+    if(!p->histograms) return;
 
-#ifdef PO_THREADPOOL_STACKSIZE
-    ASSERT((errno = pthread_attr_setstacksize(&attr,
-            PO_THREADPOOL_STACKSIZE)) == 0);
-#endif
+    uint32_t i, j;
 
-    // We will add one more thread now
-    DASSERT(p->numThreads < p->maxNumThreads);
+    for(i = 0; i < p->maxNumThreads; ++i)
+        for(j = 0; j < PO_THREADPOOL_HISTOGRAM_LENGTH; ++j)
+        {
+            histograms->queueWait.count[j] += __atomic_load_n(
+                    &p->histograms[i].queueWait.count[j],
+                    __ATOMIC_RELAXED);
+            histograms->run.count[j] += __atomic_load_n(
+                    &p->histograms[i].run.count[j], __ATOMIC_RELAXED);
+        }
+}
 
-    ASSERT((errno = pthread_create(&worker->pthread, &attr,
-            (void *(*)(void *)) workerPthreadCallback, worker)) == 0);
 
-    // Wait for the thread to get going so that the POThreadPool structure
-    // is consistent, and so on.  We assume that the user does not call
-    // poThreadPool_runTask() from more than one thread in the process, so
-    // this will only continue from here if the new worker is about to go
-    // to work calling worker->userCallback().
-    condWait(&p->cond, &p->mutex); // release mutex lock, wait
-    // got mutex lock now
+uint64_t poThreadPool_histogramValue(uint32_t index)
+{
+    const uint32_t subBits = PO_THREADPOOL_HISTOGRAM_SUB_BITS;
 
-    DASSERT(p->numThreads <= p->maxNumThreads);
+    DASSERT(index < PO_THREADPOOL_HISTOGRAM_LENGTH);
+
+    if(index < (1 << subBits))
+        return index;
+
+    uint32_t shift;
+    shift = (index >> subBits) - 1;
+
+    return ((uint64_t) ((1 << subBits) +
+                (index & ((1 << subBits) - 1)))) << shift;
 }
 
 
-// Launch a thread with an unused worker
-// We must have the threadPool mutex lock to call this.
-static inline
-int workerUnusedPop(struct POThreadPool *p,
-        struct POThreadPool_tract *tract,
-        void *(*callback)(void *), void *callbackData)
+double poThreadPool_histogramPercentile(
+        const struct POThreadPool_histogram *h, double percentile)
 {
-    struct POThreadPool_worker *worker;
-    DASSERT(p->workers.unused);
-    // Grab an unused worker by popping the unused worker stack
-    worker = p->workers.unused;
-    DASSERT(worker >= p->worker);
-    DASSERT(worker <= &p->worker[
-                p->maxNumThreads-1]);
-    DASSERT(!worker->prev);
-    p->workers.unused = worker->next;
-    worker->next = NULL;
+    DASSERT(h);
 
-#ifdef DEBUG
-    --p->workers.unusedLength;
-#endif
+    uint64_t total = 0, count = 0, n;
+    uint32_t i;
 
-    // There should be no General queued tasks
-    DASSERT(!p->tasks.back);
-    DASSERT(!p->tasks.front);
-    DVASSERT(!p->tasks.queueLength,
-            "p->tasks.queueLength=%d", p->tasks.queueLength);
+    for(i = 0; i < PO_THREADPOOL_HISTOGRAM_LENGTH; ++i)
+        total += __atomic_load_n(&h->count[i], __ATOMIC_RELAXED);
 
-    worker->userCallback = callback;
-    worker->userData = callbackData;
-    if(tract)
+    if(!total) return 0.0;
+
+    // The number of times at or below the percentile.
+    n = total * percentile / 100.0 + 0.5;
+    if(n < 1) n = 1;
+
+    for(i = 0; i < PO_THREADPOOL_HISTOGRAM_LENGTH - 1; ++i)
     {
-        DASSERT(!tract->worker);
-        DASSERT(!worker->tract);
-        // We are starting or restarting work on a tract and
-        // there is no current worker working on this tract.
-        tract->worker = worker;
-        worker->tract = tract;
+        count += __atomic_load_n(&h->count[i], __ATOMIC_RELAXED);
+        if(count >= n)
+            break;
     }
-    launchWorkerThread(p, worker);
-    return 0; // success
+
+    if(i == PO_THREADPOOL_HISTOGRAM_LENGTH - 1)
+        // The last bucket has no top.
+        return poThreadPool_histogramValue(i) * 1.0e-9;
+
+    // The top of the bucket, in seconds.
+    return (poThreadPool_histogramValue(i + 1) - 1) * 1.0e-9;
 }
 
 
-// We must have the threadPool mutex lock to call this.
-static
-int _poThreadPool_runTask(struct POThreadPool *p,
-        uint32_t timeOut/*milliseconds = (1/1000) sec*/,
-        struct POThreadPool_tract *tract,
-        void *(*callback)(void *), void *callbackData)
+int poThreadPool_setTractQuantum(struct POThreadPool *p,
+        uint32_t quantum)
 {
     DASSERT(p);
-    DASSERT(callback);
-    DASSERT(p->numThreads <= p->maxNumThreads);
-
-    bool hasTractWorker;
-    hasTractWorker = tractHasRunningWorker(p, tract);
-    // hasTractWorker is set if we have a tract with a worker that has a
-    // running thread, so it will block running a thread for this request.
-    // A tract is defined by having only one worker thread working on it
-    // at a time.  The tract is like a baton that is must be held by
-    // the worker that is currently working on the tract.
 
+    mutexLock(&p->mutex);
 
-    // Can we try to put a thread to work on this new task now.
-    
-    if(p->workers.idleFront && !hasTractWorker)
+    if(p->numThreads)
     {
-        //
-        // ### CASE 1:  we have idle worker threads ready to work
-        //
-        // There should be no tasks in the General Queue
-        DASSERT(!p->tasks.front);
-        DASSERT(!p->tasks.back);
-
-        // We use an idle worker thread in this case.
-        return workerIdleYoungPop(p, tract, callback, callbackData);
-        // returns 0 == success
+        mutexUnlock(&p->mutex);
+        ERROR("the tract quantum must be set before running tasks");
+        return 1; // fail
     }
 
-    if(p->workers.unused && !hasTractWorker)
-    {
-        //
-        // ### CASE 2:  we have unused workers that can be working threads
-        //
-        // Launch a new thread with an unused worker
-        return workerUnusedPop(p, tract, callback, callbackData);
-        // returns 0 == success
-    }
+    p->tractQuantum = quantum;
 
+    mutexUnlock(&p->mutex);
 
+    INFO("threadPool tract quantum %"PRIu32" tasks", quantum);
 
-    // The rest are queuing or blocking cases.
+    return 0; // success
+}
 
 
-    if(!p->tasks.unused)
-    {
-        //
-        // ### CASE 3:  we need to queue this, but the queues are full
-        //
-        // We have no tasks to queue with, i.e. the queues are full.
+int poThreadPool_setTractSlab(struct POThreadPool *p, uint32_t numTracts)
+{
+    DASSERT(p);
 
-        if(timeOut == 0)
-            // We are out of time.
-            return PO_ERROR_TIMEOUT; // fail
-    
-        DASSERT(!p->taskWaitingToBeRun);
+    mutexLock(&p->mutex);
 
-        p->taskWaitingToBeRun = true;
-        // Next try we should have a free task struct to queue with
-        // or a free worker thread to run with.
-        INFO(
-#ifdef DEBUG
-                "Using all %d tasks "
-                "and general queue with %d tasks, waiting now",
-                p->maxQueueLength,
-                p->tasks.queueLength
-#else
-                "We ran out of tasks using all %d queued tasks, "
-                "waiting now",
-                p->maxQueueLength
-#endif
-                );
+    if(p->numThreads || p->tractSlot || !numTracts)
+    {
+        mutexUnlock(&p->mutex);
+        ERROR("the tract slab must be set once before running tasks");
+        return 1; // fail
+    }
 
+    p->tractSlot = alloc(sizeof(*p->tractSlot)*numTracts);
+    if(!p->tractSlot)
+    {
+        mutexUnlock(&p->mutex);
+        return 1; // fail
+    }
+    p->numTractSlots = numTracts;
 
-        if(timeOut == PO_LONGTIME)
-        {
-            condWait(&p->cond, &p->mutex);
-            DASSERT(!p->taskWaitingToBeRun);
-            // Try again.  There should be no state change up to now!
-            return _poThreadPool_runTask(p, timeOut, tract, callback,
-                callbackData);
-        }
-        // else timeOut != PO_LONGTIME
-        condTimedWait(&p->cond, &p->mutex, timeOut);
-        if(p->taskWaitingToBeRun) p->taskWaitingToBeRun = false;
-        // Try again, with no timeOut.  It does not matter if
-        // we timed out or not, either way we just do this:
-        return _poThreadPool_runTask(p, 0, tract, callback, callbackData);
+    // Stack the unused slots so that the first slot is on top.
+    uint32_t i = numTracts;
+    while(i)
+    {
+        --i;
+        p->tractSlot[i].generation = 1;
+        p->tractSlot[i].nextUnused = p->unusedTractSlot;
+        p->unusedTractSlot = &p->tractSlot[i];
     }
 
-    if(tract)
-        // Add to the tract task Count because this will be queued
-        // somewhere.
-        ++tract->taskCount;
+    mutexUnlock(&p->mutex);
 
+    INFO("threadPool tract slab with %"PRIu32" tracts", numTracts);
 
-    if(p->tasks.front || !hasTractWorker)
-    {
-        //
-        // ### CASE 4:  we put this task in the General queue
-        //
-        // General Queue
-        // We can put this "task" in the regular General queue.
-        // The General queue should be used so tasks stay 
-        struct POThreadPool_task *task;
+    return 0; // success
+}
 
-        // pop a task off the unused task stack.
-        task = p->tasks.unused;
-        p->tasks.unused = task->next;
 
-        // Put this task in back of the General task queue.
-        if(p->tasks.back)
-        {
-            DASSERT(p->tasks.front);
-            p->tasks.back->next = task;
-        }
-        else
-        {
-            DASSERT(!p->tasks.front);
-            p->tasks.front = task;
-        }
-        p->tasks.back = task;
-        task->next = NULL;
+uint64_t poThreadPool_tractAlloc(struct POThreadPool *p,
+        void *(*drainedCallback)(void *), void *drainedData)
+{
+    struct POThreadPool_tractSlot *slot;
+    DASSERT(p);
 
-#ifdef DEBUG
-        ++p->tasks.queueLength;
-        --p->tasks.unusedLength;
-#endif
-        task->userCallback = callback;
-        task->userData = callbackData;
-        task->tract = tract;
+    mutexLock(&p->mutex);
 
-        return 0; // success, it's queued in the General queue.
+    slot = p->unusedTractSlot;
+    if(slot)
+    {
+        p->unusedTractSlot = slot->nextUnused;
+        slot->nextUnused = NULL;
+        slot->refCount = 1;
+        slot->drainedCallback = drainedCallback;
+        slot->drainedData = drainedData;
     }
 
+    mutexUnlock(&p->mutex);
 
-    // ### CASE 5:  we have a tract worker thread running and there
-    //              are no tasks in the General queue, so we may add
-    //              this task to tract task queue.
+    if(!slot)
+        return 0; // fail, all tracts are in use.
 
-    DASSERT(!p->tasks.front);
-    DASSERT(!p->tasks.back);
-    DASSERT(!p->tasks.queueLength);
-    DASSERT(hasTractWorker);
-    DASSERT(tract);
+    return (((uint64_t) slot->generation) << 32) |
+        (uint64_t) (slot - p->tractSlot);
+}
 
-    struct POThreadPool_task *task;
 
-    // pop the task from unused
-    task = p->tasks.unused;
-    p->tasks.unused = task->next;
+// Returns the slot for a handle, or NULL if the handle is stale.  This
+// does not use the pool mutex.
+static inline
+struct POThreadPool_tractSlot *handleTractSlot(struct POThreadPool *p,
+        uint64_t handle)
+{
+    uint32_t index = (uint32_t) handle;
+    struct POThreadPool_tractSlot *slot;
+
+    if(index >= p->numTractSlots)
+        return NULL;
+    slot = &p->tractSlot[index];
+    if(__atomic_load_n(&slot->generation, __ATOMIC_ACQUIRE) !=
+            (uint32_t) (handle >> 32))
+        return NULL;
+    return slot;
+}
 
-    task->userCallback = callback;
-    task->userData = callbackData;
-    task->tract = tract;
-#ifdef DEBUG
-    --p->tasks.unusedLength;
-#endif
 
-    tractQueueTask(p, task);
+struct POThreadPool_tract *poThreadPool_tractGet(struct POThreadPool *p,
+        uint64_t handle)
+{
+    struct POThreadPool_tractSlot *slot;
+    DASSERT(p);
 
-    // Now it should be run by the working thread after all
-    // the other tasks in the worker tract task list.  It's
-    // in a "Blocked" tract task queue which is kept in the
-    // particular worker/tract tract data structure.
-    return 0;
+    slot = handleTractSlot(p, handle);
+    if(!slot)
+        return NULL;
+    return &slot->tract;
 }
 
 
-/* Add a task to the thread pool.
- *
- * If tract is NULL no tract is used.
- *
- */
-int poThreadPool_runTask(struct POThreadPool *p,
-        uint32_t timeOut /*milliseconds is units of seconds/1000*/,
-        struct POThreadPool_tract *tract,
-        void *(*callback)(void *), void *callbackData)
+void poThreadPool_tractRetain(struct POThreadPool *p, uint64_t handle)
 {
+    struct POThreadPool_tractSlot *slot;
     DASSERT(p);
 
-    DASSERT(pthread_equal(pthread_self(), p->master));
+    slot = handleTractSlot(p, handle);
+    ASSERT(slot);
+    // The user has a reference, so the tract cannot be recycled now.
+    DASSERT(__atomic_load_n(&slot->refCount, __ATOMIC_RELAXED));
+    __atomic_add_fetch(&slot->refCount, 1, __ATOMIC_RELAXED);
+}
 
-    mutexLock(&p->mutex);
 
-    DSPEW();
+void poThreadPool_tractRelease(struct POThreadPool *p, uint64_t handle)
+{
+    struct POThreadPool_tractSlot *slot;
+    void *(*callback)(void *) = NULL;
+    void *data = NULL;
+    DASSERT(p);
 
-    int ret;
-    ret = _poThreadPool_runTask(p, timeOut, tract,
-            callback, callbackData);
+    slot = handleTractSlot(p, handle);
+    ASSERT(slot);
+    DASSERT(__atomic_load_n(&slot->refCount, __ATOMIC_RELAXED));
+
+    if(__atomic_sub_fetch(&slot->refCount, 1, __ATOMIC_ACQ_REL))
+        return; // There are more references.
+
+    mutexLock(&p->mutex);
+
+    // If a worker is on this tract, the worker recycles it when it runs
+    // out of tasks in the tract, and may have done so already.
+    if(slot->generation == (uint32_t) (handle >> 32) &&
+            !slot->refCount && tractIsDrained(&slot->tract))
+    {
+        callback = slot->drainedCallback;
+        data = slot->drainedData;
+        tractSlotRecycle(p, slot);
+    }
 
     mutexUnlock(&p->mutex);
 
-    return ret;
+    if(callback)
+        callback(data);
 }
 
 
-// this is also done in poThreadPool_runTask()
+// Idle worker threads also time out by themselves.
 bool poThreadPool_checkIdleThreadTimeout(struct POThreadPool *p)
 {
     DASSERT(p);
@@ -1168,8 +4135,11 @@ poThreadPool_checkTractFinish(struct POThreadPool *p,
 
     if(tract->taskCount == 0 && !tract->worker)
     {
-        // reset the tract.
+        // reset the tract, but keep the user's histograms.
+        struct POThreadPool_histograms *histograms;
+        histograms = tract->histograms;
         memset(tract, 0, sizeof(*tract));
+        tract->histograms = histograms;
         ret = true;
     }
 
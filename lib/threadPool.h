@@ -37,6 +37,10 @@
  * will either block until a thread finishes a task or return an error,
  * depending on user preferences.
  *
+ * New worker threads are created by a spawner thread that belongs to the
+ * pool, so poThreadPool_runTask() does not wait for pthread_create().
+ * The task is given to the new worker before its thread exists.
+ *
  * \section task_queue task queue
  *
  * The potato thread pool has a waiting queued with a user set maximum
@@ -60,10 +64,15 @@
  * the opaque struct POThreadPool_tract memory, but the memory cannot be
  * recycled until poThreadPool_checkTractFinish() true.
  *
+ * Or the pool can own the tracts.  See poThreadPool_setTractSlab().  The
+ * user then gets tracts by integer handles, with reference counts, and
+ * the pool recycles a tract, and calls back the user, when the last
+ * reference is released and the last task in the tract has run.
+ *
  * \section thread_wind_down thread wind down
  *
- * The user may set a maxIdleTime, in microseconds, in which idle workers
- * threads are stopped.
+ * The user may set a maxIdleTime, in milliseconds, in which idle workers
+ * threads stop by themselves.
  */
 
 
@@ -90,11 +99,108 @@ struct POThreadPool_tract
 
     // When taskCount goes to zero we can recycle this tract.
     uint32_t taskCount; // number of queued tasks that are associated.
+
+    // The General queue priority of the queued tasks in this tract.
+    // All the queued tasks in a tract have the same priority, so that
+    // they stay in order.
+    uint32_t priority;
+
+    // The deadline of the last queued task in this tract.  With deadline
+    // mode, queued tasks in a tract never have an earlier deadline than
+    // the tasks queued before them, so that they stay in order.
+    double deadline;
+
+    // The user may set this to record the latencies of the tasks in this
+    // tract.  See poThreadPool_setHistograms().
+    struct POThreadPool_histograms *histograms;
+
+    // For the list of tracts that have queued tasks and are waiting for
+    // a worker, after a worker yielded the tract.  See
+    // poThreadPool_setTractQuantum().
+    struct POThreadPool_tract *nextReady;
+
+    // The taskCount queued tasks in a list, newest first, so that they
+    // can be cancelled with poThreadPool_cancelTract().
+    struct POThreadPool_task *queued;
 };
 
+
+// The user's memory for the result of a task from
+// poThreadPool_runTaskFuture().
+struct POThreadPool_future
+{
+    // PO_THREADPOOL_FUTURE_PENDING, PO_THREADPOOL_FUTURE_WAITED or
+    // PO_THREADPOOL_FUTURE_DONE.  The waiting threads set it to
+    // PO_THREADPOOL_FUTURE_WAITED and wait on this futex word, so that
+    // the worker knows to wake them from the value it replaces.
+    uint32_t state;
+
+    // The value returned by the task callback.
+    void *result;
+
+    // The task callback and its data.
+    void *(*userCallback)(void *);
+    void *userData;
+
+    // Called in the worker thread after the task callback returns, and
+    // before the future is done.
+    void (*continuation)(struct POThreadPool_future *future,
+            void *continuationData);
+    void *continuationData;
+};
+
+#define PO_THREADPOOL_FUTURE_PENDING  (1)
+#define PO_THREADPOOL_FUTURE_DONE     (2)
+#define PO_THREADPOOL_FUTURE_WAITED   (3) // pending with waiters
+
 /// \endcond
 
 
+/** The number of sub-buckets in each power of 2 range of a histogram is
+ * 2 to this power.  */
+#define PO_THREADPOOL_HISTOGRAM_SUB_BITS  (3)
+
+/** The number of buckets in a struct POThreadPool_histogram */
+#define PO_THREADPOOL_HISTOGRAM_LENGTH \
+    ((65 - PO_THREADPOOL_HISTOGRAM_SUB_BITS) << \
+     PO_THREADPOOL_HISTOGRAM_SUB_BITS)
+
+/** A log bucketed histogram of times in nanoseconds
+ *
+ * Each power of 2 range of times is split into 2 to the
+ * PO_THREADPOOL_HISTOGRAM_SUB_BITS buckets, so the bucket widths are
+ * within 1/8 of the times in them.  Use poThreadPool_histogramValue()
+ * to get the times of a bucket.
+ */
+struct POThreadPool_histogram
+{
+    /** the number of times recorded in each bucket */
+    uint64_t count[PO_THREADPOOL_HISTOGRAM_LENGTH];
+};
+
+/** Task latency histograms
+ */
+struct POThreadPool_histograms
+{
+    /** the time from when a task was added to when it started running */
+    struct POThreadPool_histogram queueWait;
+    /** the time that a task callback ran */
+    struct POThreadPool_histogram run;
+};
+
+
+/** The number of task priority levels.
+ *
+ * Priority 0 is the highest priority.  See poThreadPool_runTaskPriority().
+ */
+#define PO_THREADPOOL_NUM_PRIORITIES    (4)
+
+/** The priority of tasks from poThreadPool_runTask() and
+ * poThreadPool_runTasks().
+ */
+#define PO_THREADPOOL_PRIORITY_DEFAULT  (1)
+
+
 /** create a potato thread pool
  *
  * Cutting down on thread contention by increasing design complexity in
@@ -106,9 +212,21 @@ struct POThreadPool_tract
  * threads, \p maxNumThreads, and a waiting task queue of length
  * \p maxQueueLength.
  *
- * This is the only function in the threadPool class that allocates memory
- * and the size depends on the parameters \p maxQueueLength and \p
- * maxNumThreads.
+ * This allocates the memory for the pool, and the size depends on the
+ * parameters \p maxQueueLength and \p maxNumThreads.  Running tasks does
+ * not allocate memory.  The only other functions in the threadPool class
+ * that allocate memory are the optional setters
+ * poThreadPool_setWorkStealing(), poThreadPool_setDeadlineMode(),
+ * poThreadPool_setAffinity(), poThreadPool_setHistograms(),
+ * poThreadPool_setTractSlab() and poThreadPool_setWatchdog(), which are
+ * called before the first task, and poThreadPool_resize() when it makes
+ * the queue longer than it has been.  The task graphs in
+ * threadPoolGraph.h and the coroutines in threadPoolCoroutine.h allocate
+ * their memory when they are made.
+ *
+ * If \p maxNumThreads is not zero this creates the pool spawner thread,
+ * which creates the worker threads.  It is joined in
+ * poThreadPool_tryDestroy().
  *
  * \param maxNumThreads  the maximum number of worker threads that can
  * exist.  This does not include the master thread that calls
@@ -121,19 +239,20 @@ struct POThreadPool_tract
  * enough to hold all the tasks that will be blocked by running tasks that
  * are in the same tract.
  *
- * \param maxIdleTime  is the time that an idle worker thread will wait
- * idly until it is destroyed in the next user invoked action, like
- * poThreadPool_checkIdleThreadTimeout().  The idle worker threads are
- * only destroyed when poThreadPool_runTask() or
- * poThreadPool_checkIdleThreadTimeout() are called.  if \p maxIdleTime is
- * zero than there will be no idle threads waiting for tasks.
+ * \param maxIdleTime  is the time, in milli-seconds, that an idle worker
+ * thread will wait idly until it exits.  The idle worker threads time
+ * out by themselves, so the user does not need to call into the pool to
+ * wind it down.  One thread, or the number set with
+ * poThreadPool_setMinIdleThreads(), is kept.  if \p maxIdleTime is zero
+ * than idle threads exit as soon as they are idle, except the ones that
+ * are kept, which wait for tasks without using the CPU.
  *
  *  \return a pointer to an opaque struct POThreadPool
  */
 extern
 struct POThreadPool *poThreadPool_create(
         uint32_t maxNumThreads, uint32_t maxQueueLength,
-        uint32_t maxIdleTime /*micro-seconds*/);
+        uint32_t maxIdleTime /*milli-seconds*/);
 
 
 /** Waits for all the current task requests to finish and then cleans up
@@ -163,6 +282,45 @@ uint32_t poThreadPool_tryDestroy(struct POThreadPool *p,
         uint32_t timeOut /*in milli-seconds. 1 milli-sec = 1/1000 of sec*/);
 
 
+#ifndef PO_THREADPOOL_DRAIN_STEP
+/** The time, in milliseconds, between the calls to the progress
+ * callback of poThreadPool_drain() */
+#  define PO_THREADPOOL_DRAIN_STEP  (100)
+#endif
+
+
+/** stop taking tasks, finish the work, and destroy the pool
+ *
+ * From the time this is called, poThreadPool_runTask() and the other
+ * functions that add tasks return PO_ERROR_DRAINING, without waiting,
+ * unless they are called from a worker thread of this pool.  Threads
+ * that are waiting for room in the queue are rejected too.  The queued
+ * tasks, the tract queues, and the tasks that the running tasks add,
+ * all run, and the worker threads exit as they run out of work.  When
+ * they are all gone the pool is destroyed, as with
+ * poThreadPool_tryDestroy().
+ *
+ * If it times out the pool keeps draining, and this, or
+ * poThreadPool_tryDestroy(), may be called again to finish.  Only the
+ * thread that created the pool may call this.
+ *
+ * \param p returned from a call to poThreadPool_create()
+ * \param timeOut the time to wait in milli-seconds for the tasks to
+ * finish, or PO_LONGTIME to wait until they do.
+ * \param progress if not NULL, this is called in this thread every
+ * PO_THREADPOOL_DRAIN_STEP milliseconds, while there are tasks left,
+ * with the number of tasks that are running or waiting to run.
+ * \param userData passed to \p progress.
+ *
+ * \return 0 if all the tasks finished and the pool was destroyed, or
+ * the number of tasks that did not finish if it timed out.
+ */
+extern
+uint32_t poThreadPool_drain(struct POThreadPool *p, uint32_t timeOut,
+        void (*progress)(uint32_t numRemaining, void *userData),
+        void *userData);
+
+
 /** add a task to the thread pool.
  *
  * Request to run a task with a thread in the pool of threads.  If the
@@ -201,8 +359,12 @@ uint32_t poThreadPool_tryDestroy(struct POThreadPool *p,
  *  tasks from the same tract are running; if the task can't run it will
  *  be put in the wait queue, if it can, and so on ...
  *
- * This call must be called by the same thread that called the
- * poThreadPool_create() which returned \p p.
+ * This may be called from any thread, including from a task callback
+ * that is running in a worker thread of the same pool.  A task callback
+ * that submits with \p timeOut PO_LONGTIME will block its worker while
+ * the queue is full, so if all the workers do that at once nothing will
+ * free room in the queue.  Task callbacks should use a finite \p timeOut
+ * or a queue large enough for the follow-up tasks.
  *
  * All a tract does is keep tasks that are in the same tract from running
  * concurrently, but otherwise it's first come first serve in a line to
@@ -246,7 +408,9 @@ uint32_t poThreadPool_tryDestroy(struct POThreadPool *p,
  * \param callbackData a pointer to pass to the \p callback function.
  *
  * \return 0 on success and the task will be running or queued to
- * run, or \p PO_ERROR_TIMEOUT in the case there the time out has expired.
+ * run, or \p PO_ERROR_TIMEOUT in the case there the time out has expired,
+ * or \p PO_ERROR_DRAINING if the pool is draining.  See
+ * poThreadPool_drain().
  */
 extern
 int poThreadPool_runTask(struct POThreadPool *p,
@@ -255,11 +419,324 @@ int poThreadPool_runTask(struct POThreadPool *p,
         void *(*callback)(void *), void *callbackData);
 
 
+/** add a task to the thread pool with a priority.
+ *
+ * This is the same as poThreadPool_runTask(), which uses priority
+ * PO_THREADPOOL_PRIORITY_DEFAULT, except that if the task has to wait in
+ * the General queue it waits in the queue for priority \p priority.
+ * Workers take the next task from the highest priority queue that has
+ * tasks, where 0 is the highest priority, but a lower priority task that
+ * has been passed over PO_THREADPOOL_STARVATION_LIMIT times is taken next
+ * so that it is not starved.
+ *
+ * Tasks in a tract always run in order, so a task in a tract that has
+ * queued tasks gets the priority of those tasks, and not \p priority.
+ *
+ * \param priority from 0, the highest priority, to
+ * PO_THREADPOOL_NUM_PRIORITIES - 1.  Larger values are treated as the
+ * lowest priority.
+ *
+ * See poThreadPool_runTask() for the other parameters and the return
+ * value.
+ */
+extern
+int poThreadPool_runTaskPriority(struct POThreadPool *p,
+        uint32_t timeOut, /*in milliseconds = 10^(-3) seconds*/
+        uint32_t priority,
+        struct POThreadPool_tract *tract,
+        void *(*callback)(void *), void *callbackData);
+
+
+/** add a task with a deadline to the thread pool.
+ *
+ * This is the same as poThreadPool_runTask() except that the task has a
+ * deadline, which is used with deadline mode.  See
+ * poThreadPool_setDeadlineMode().  Without deadline mode \p deadline is
+ * not used.
+ *
+ * A task in a tract gets the deadline of the last queued task in the
+ * tract if that is later than \p deadline, so that the tasks in a tract
+ * stay in order.
+ *
+ * \param deadline the time, in seconds, as returned by
+ * poTime_getDouble(), after which the task should not run.
+ *
+ * See poThreadPool_runTask() for the other parameters and the return
+ * value.
+ */
+extern
+int poThreadPool_runTaskDeadline(struct POThreadPool *p,
+        uint32_t timeOut, /*in milliseconds = 10^(-3) seconds*/
+        double deadline,
+        struct POThreadPool_tract *tract,
+        void *(*callback)(void *), void *callbackData);
+
+
+/** A task for poThreadPool_runTasks()
+ *
+ * The fields have the same meaning as the corresponding parameters of
+ * poThreadPool_runTask().
+ */
+struct POThreadPool_taskEntry
+{
+    struct POThreadPool_tract *tract; ///< may be NULL (0)
+    void *(*callback)(void *); ///< a function to call in the task thread
+    void *callbackData; ///< a pointer to pass to callback
+};
+
+
+/** add many tasks to the thread pool at once.
+ *
+ * This is like calling poThreadPool_runTask() for each of the tasks in
+ * \p entries, in order, but the pool mutex is locked just once for all
+ * of them, unless the queue is full and this has to wait.  Each task
+ * that can run now wakes, or starts, just one worker thread.
+ *
+ * This may be called from any thread, as with poThreadPool_runTask(),
+ * but it never uses the work stealing local deques.
+ *
+ * \param p returned from a call to poThreadPool_create()
+ * \param timeOut the time to wait, in milliseconds, for room for each
+ * task as in poThreadPool_runTask().  When a task can't be run or queued
+ * in this time this stops and returns without adding that task or the
+ * tasks after it.
+ * \param entries an array of \p numEntries tasks
+ * \param numEntries the number of tasks in \p entries
+ *
+ * \return the number of tasks, from the start of \p entries, that are
+ * running or queued to run.
+ */
+extern
+uint32_t poThreadPool_runTasks(struct POThreadPool *p,
+        uint32_t timeOut, /*in milliseconds = 10^(-3) seconds*/
+        const struct POThreadPool_taskEntry *entries, uint32_t numEntries);
+
+
+#ifndef PO_THREADPOOL_PAYLOAD_SIZE
+/** The largest payload, in bytes, of poThreadPool_runTaskCopy() */
+#  define PO_THREADPOOL_PAYLOAD_SIZE  (64)
+#endif
+
+
+/** add a task to the thread pool with a copy of its data
+ *
+ * This is like poThreadPool_runTask(), but the \p payloadSize bytes at
+ * \p payload are copied into the pool's preallocated memory for the
+ * task, so the caller does not need to allocate memory for the task data
+ * and may reuse \p payload as soon as this returns.  \p callback is
+ * called with a pointer to the copy, which is valid until \p callback
+ * returns, and is aligned to 16 bytes.
+ *
+ * The library and the user code must be compiled with the same
+ * PO_THREADPOOL_PAYLOAD_SIZE.
+ *
+ * \param p returned from a call to poThreadPool_create()
+ * \param timeOut as in poThreadPool_runTask().
+ * \param tract as in poThreadPool_runTask().
+ * \param callback the task callback.
+ * \param payload the data to copy.
+ * \param payloadSize the number of bytes to copy, from 1 to
+ * PO_THREADPOOL_PAYLOAD_SIZE.
+ *
+ * \return 0 on success, PO_ERROR_INVALID if \p payloadSize is not from 1
+ * to PO_THREADPOOL_PAYLOAD_SIZE, or else the error from
+ * poThreadPool_runTask() if the task was not queued.
+ */
+extern
+int poThreadPool_runTaskCopy(struct POThreadPool *p,
+        uint32_t timeOut, /*in milliseconds = 10^(-3) seconds*/
+        struct POThreadPool_tract *tract,
+        void *(*callback)(void *payload),
+        const void *payload, uint32_t payloadSize);
+
+
+/** A handle to a queued task, from poThreadPool_runTaskCancelable()
+ *
+ * The user keeps this memory.  It does not need to be freed.
+ */
+struct POThreadPool_taskHandle
+{
+    /** the queued task, or NULL if the task was not queued */
+    struct POThreadPool_task *task;
+    /** the use of the task struct that this handle is for */
+    uint32_t generation;
+};
+
+
+/** add a task to the thread pool that can be cancelled
+ *
+ * This is like poThreadPool_runTask(), but if the task is queued it can
+ * be cancelled, before it starts running, with poThreadPool_cancelTask()
+ * or poThreadPool_cancelTract().  A task that is handed to a worker
+ * thread at once, because there was a thread for it, is not queued and
+ * can't be cancelled.
+ *
+ * \param p returned from a call to poThreadPool_create()
+ * \param timeOut as in poThreadPool_runTask().
+ * \param tract as in poThreadPool_runTask().
+ * \param callback the task callback.
+ * \param callbackData passed to \p callback or \p cancelCallback.
+ * \param cancelCallback if not NULL, this is called with \p
+ * callbackData, in the thread that cancels the task, in place of \p
+ * callback, so that the user can free \p callbackData.
+ * \param handle if not NULL, this is set to a handle that
+ * poThreadPool_cancelTask() uses to cancel this task.
+ *
+ * \return 0 on success, or non-zero if the task was not queued.
+ */
+extern
+int poThreadPool_runTaskCancelable(struct POThreadPool *p,
+        uint32_t timeOut, /*in milliseconds = 10^(-3) seconds*/
+        struct POThreadPool_tract *tract,
+        void *(*callback)(void *), void *callbackData,
+        void (*cancelCallback)(void *callbackData),
+        struct POThreadPool_taskHandle *handle);
+
+
+/** cancel a queued task
+ *
+ * If the task is still queued it's taken out of the queue, its task
+ * memory is put back in the pool, and its cancel callback is called in
+ * this thread.  This is O(1) for a task in the General queue, or O(the
+ * length of the tract queue) for a task in a tract queue.
+ *
+ * This may be called from any thread.
+ *
+ * \param p returned from a call to poThreadPool_create()
+ * \param handle from poThreadPool_runTaskCancelable().
+ *
+ * \return 0 if the task was cancelled, or non-zero if it was not queued,
+ * has started running, or has finished.
+ */
+extern
+int poThreadPool_cancelTask(struct POThreadPool *p,
+        const struct POThreadPool_taskHandle *handle);
+
+
+/** cancel all the queued tasks in a tract
+ *
+ * All the tasks in the tract that are waiting to run, in the General
+ * queue and in the tract queue, are taken out of the queues and their
+ * task memory is put back in the pool.  The cancel callbacks, of the
+ * tasks from poThreadPool_runTaskCancelable() that have one, are called
+ * in this thread in the order that the tasks where queued.  A task in
+ * the tract that is running now is not stopped.  This is O(the number of
+ * queued tasks in the tract).
+ *
+ * If the tract is from poThreadPool_tractAlloc() and has no references
+ * and no running task after this, it's recycled and its drained callback
+ * is called in this thread.
+ *
+ * This may be called from any thread, including from a task in the
+ * tract.
+ *
+ * \param p returned from a call to poThreadPool_create()
+ * \param tract the tract.
+ *
+ * \return the number of tasks that where cancelled.
+ */
+extern
+uint32_t poThreadPool_cancelTract(struct POThreadPool *p,
+        struct POThreadPool_tract *tract);
+
+
+/** Initialize a future.
+ *
+ * A future is memory that the user keeps, like a tract, that gets the
+ * value returned by a task callback, and that threads can wait on.
+ *
+ * \param future the future to initialize.
+ * \param continuation if not NULL, this is called in the worker thread
+ * after the task callback returns, with the result set, and before
+ * the future is done, so that it may, for example, submit another task.
+ * \param continuationData passed to \p continuation.
+ */
+extern
+void poThreadPool_futureInit(struct POThreadPool_future *future,
+        void (*continuation)(struct POThreadPool_future *future,
+            void *continuationData),
+        void *continuationData);
+
+
+/** Run a task with a future.
+ *
+ * This is like poThreadPool_runTask(), but the value returned by \p
+ * callback is kept in \p future, and threads can wait for the task to
+ * finish with poThreadPool_futureWait().  The memory of \p future must
+ * stay valid until the future is done.  A future may be used again,
+ * after it is done, without calling poThreadPool_futureInit() again.
+ *
+ * \param p returned from a call to poThreadPool_create()
+ * \param timeOut as in poThreadPool_runTask().
+ * \param tract as in poThreadPool_runTask().
+ * \param future initialized with poThreadPool_futureInit().
+ * \param callback the task callback.
+ * \param callbackData passed to \p callback.
+ *
+ * \return 0 on success, or PO_ERROR_TIMEOUT if the time out expired, or
+ * PO_ERROR_DRAINING if the pool is draining, as in
+ * poThreadPool_runTask().  If the task was not queued \p future is not
+ * pending.
+ */
+extern
+int poThreadPool_runTaskFuture(struct POThreadPool *p,
+        uint32_t timeOut, /*in milliseconds = 10^(-3) seconds*/
+        struct POThreadPool_tract *tract,
+        struct POThreadPool_future *future,
+        void *(*callback)(void *), void *callbackData);
+
+
+/** Wait for a future to be done.
+ *
+ * This does not use the pool mutex lock.  Calling this from a task
+ * callback blocks a worker thread, so if all the workers wait on tasks
+ * that are queued nothing will run them.
+ *
+ * \param future from poThreadPool_runTaskFuture().
+ * \param timeOut the time to wait in milliseconds, or PO_LONGTIME to
+ * wait until it's done.
+ *
+ * \return 0 if the future is done, or PO_ERROR_TIMEOUT if it is not
+ * done after \p timeOut milliseconds.
+ */
+extern
+int poThreadPool_futureWait(struct POThreadPool_future *future,
+        uint32_t timeOut /*in milliseconds = 10^(-3) seconds*/);
+
+
+/** Get the value returned by the task callback of a done future.
+ *
+ * \param future from poThreadPool_runTaskFuture().
+ *
+ * \return the value returned by the task callback.
+ */
+static inline
+void *poThreadPool_futureResult(const struct POThreadPool_future *future)
+{
+    return future->result;
+}
+
+
+/** Check if a future is done, without waiting.
+ *
+ * \param future from poThreadPool_runTaskFuture().
+ *
+ * \return true if the task of \p future has finished.
+ */
+static inline
+bool poThreadPool_futureIsDone(const struct POThreadPool_future *future)
+{
+    return (__atomic_load_n(&future->state, __ATOMIC_ACQUIRE) ==
+            PO_THREADPOOL_FUTURE_DONE);
+}
+
+
 /** Check for and remove a timed out idle thread from the pool.
  *
- * Idle threads may be removed in a call to poThreadPool_runTask(),
- * but if you just need to wind down your worker threads and not
- * add tasks you call call this.
+ * Idle threads time out and exit by themselves after waiting the
+ * maxIdleTime that was passed to poThreadPool_create(), so there is
+ * no need to call this.  This removes the oldest idle thread if it has
+ * timed out and has not exited yet.
  *
  * Note the potato thread pool does not bother to count the number
  * of running threads, that would require more memory and computer
@@ -290,3 +767,577 @@ bool poThreadPool_checkIdleThreadTimeout(struct POThreadPool *p);
 extern bool
 poThreadPool_checkTractFinish(struct POThreadPool *p,
         struct POThreadPool_tract *tract);
+
+
+/** Turn on work stealing in the thread pool.
+ *
+ * With work stealing each worker thread gets a local deque that holds up
+ * to \p dequeLength tasks.  A task that is not in a tract, and is
+ * submitted with poThreadPool_runTask() from a task callback running in
+ * a worker thread of the same pool, is queued in that worker's local
+ * deque without getting the pool mutex lock, so long as there are no
+ * idle workers and the deque is not full.  The worker runs the tasks in
+ * its deque, last in first out, after its task callback returns, and
+ * other workers that run out of work steal them, first in first out.
+ *
+ * Tasks in a tract never go in a local deque, so no more than one worker
+ * works on a tract at a time, as always.  Tasks from threads that are not
+ * workers, and tasks that do not fit in the local deque, are queued as
+ * usual, and the local deque tasks are not ordered with them.
+ *
+ * This must be called before the first call to poThreadPool_runTask().
+ *
+ * \param p a struct POThreadPool pointer returned from
+ * poThreadPool_create().
+ * \param dequeLength the maximum number of tasks in each worker's local
+ * deque.
+ *
+ * \return 0 on success, or non-zero if the pool has already started
+ * threads or already has work stealing.
+ */
+extern
+int poThreadPool_setWorkStealing(struct POThreadPool *p,
+        uint32_t dequeLength);
+
+
+/** Start worker threads before there are tasks for them.
+ *
+ * Threads are started without tasks until there are \p numThreads
+ * threads in the pool, or until the maximum number of threads is
+ * reached.  The new threads become idle threads, so the next tasks
+ * do not have to wait for threads to be created.  Pre-spawned threads
+ * time out like any other idle threads, unless
+ * poThreadPool_setMinIdleThreads() keeps them.
+ *
+ * This may be called at any time, but it's usually called right after
+ * poThreadPool_create().
+ *
+ * \param p a struct POThreadPool pointer returned from
+ * poThreadPool_create().
+ * \param numThreads the number of threads that the pool should have.
+ *
+ * \return the number of threads started.
+ */
+extern
+uint32_t poThreadPool_prespawn(struct POThreadPool *p,
+        uint32_t numThreads);
+
+
+/** Set the minimum number of idle threads.
+ *
+ * The idle thread time-out will not stop an idle thread if that would
+ * leave fewer than \p minIdleThreads idle threads, so after a quiet
+ * period a burst of tasks does not have to wait for threads to be
+ * created.  This also starts threads, as in poThreadPool_prespawn(), so
+ * that there are \p minIdleThreads idle threads, or as many as the
+ * maximum number of threads allows.  Idle threads that are put to work
+ * are not replaced until they finish their tasks.
+ *
+ * poThreadPool_tryDestroy() stops all the threads regardless.
+ *
+ * \param p a struct POThreadPool pointer returned from
+ * poThreadPool_create().
+ * \param minIdleThreads the floor for the number of idle threads.
+ *
+ * \return the number of threads started.
+ */
+extern
+uint32_t poThreadPool_setMinIdleThreads(struct POThreadPool *p,
+        uint32_t minIdleThreads);
+
+
+/** Turn on deadline mode in the thread pool.
+ *
+ * In deadline mode queued tasks run earliest deadline first, and a task
+ * that is past its deadline when a worker gets it from the queue does
+ * not run.  If \p expiredCallback is set it is called in place of the
+ * task callback with the task's callback data, else the task is
+ * dropped.  Without an \p expiredCallback, when the queue is full,
+ * poThreadPool_runTask() drops the expired tasks in the queue to make
+ * room before it waits or fails.
+ *
+ * Tasks are given deadlines with poThreadPool_runTaskDeadline().  Tasks
+ * from poThreadPool_runTask() have no deadline and run after all queued
+ * tasks with deadlines, in the order they where queued.  Task priorities
+ * are not used in deadline mode.
+ *
+ * This must be called before the first call to poThreadPool_runTask().
+ *
+ * \param p a struct POThreadPool pointer returned from
+ * poThreadPool_create() with a \p maxQueueLength that is not zero.
+ * \param expiredCallback the function to call for expired tasks, or
+ * NULL to drop them.
+ *
+ * \return 0 on success, or non-zero if the pool has already started
+ * threads, already has deadline mode, or has no queue.
+ */
+extern
+int poThreadPool_setDeadlineMode(struct POThreadPool *p,
+        void *(*expiredCallback)(void *));
+
+
+/** Pin the worker threads to CPUs.
+ *
+ * The worker threads are pinned round-robin to the CPUs in \p cpus, one
+ * CPU per thread, so that a worker thread always runs on the same CPU.
+ *
+ * For a machine with more than one NUMA node, you may make a pool for
+ * each node, with the CPUs from poThreadPool_getNodeCpus(), and run the
+ * tasks for each node in its own pool.  The pool memory is allocated,
+ * and first touched, by the thread that calls poThreadPool_create(), so
+ * to have the pool memory local to the node call poThreadPool_create()
+ * from a thread that is running on that node.
+ *
+ * This must be called before the first call to poThreadPool_runTask().
+ *
+ * \param p a struct POThreadPool pointer returned from
+ * poThreadPool_create().
+ * \param cpus an array of CPU numbers.  It is copied.
+ * \param numCpus the number of CPUs in \p cpus.
+ *
+ * \return 0 on success, or non-zero if the pool has already started
+ * threads, already has an affinity, or a CPU is not available to this
+ * process.
+ */
+extern
+int poThreadPool_setAffinity(struct POThreadPool *p,
+        const uint32_t *cpus, uint32_t numCpus);
+
+
+/** Get the CPUs of a NUMA node.
+ *
+ * This reads the CPU list of the NUMA node from /sys/devices/system/node/
+ * for use with poThreadPool_setAffinity().
+ *
+ * \param node the NUMA node number.
+ * \param cpus an array that gets the CPU numbers.
+ * \param maxCpus the length of the \p cpus array.
+ *
+ * \return the number of CPUs in the node, which may be more than \p
+ * maxCpus, or 0 if the node was not found.
+ */
+extern
+uint32_t poThreadPool_getNodeCpus(uint32_t node,
+        uint32_t *cpus, uint32_t maxCpus);
+
+
+/** Thread pool statistics from poThreadPool_getStats()
+ */
+struct POThreadPool_stats
+{
+    /** the number of worker threads, idle and working */
+    uint32_t numThreads;
+    /** the number of idle worker threads */
+    uint32_t numIdleThreads;
+    /** the number of worker threads that are working on tasks */
+    uint32_t numWorkingThreads;
+    /** the number of tasks waiting in the General queue */
+    uint32_t queueLength;
+    /** the most worker threads the pool may have now.  See
+     * poThreadPool_resize() and poThreadPool_setAdaptiveConcurrency() */
+    uint32_t threadLimit;
+    /** the number of worker threads that are in a blocking region.  See
+     * poThreadPool_blockingBegin() */
+    uint32_t numBlocking;
+
+    /** the number of tasks that have finished running */
+    uint64_t tasksRun;
+    /** the number of tasks taken from another worker's local deque */
+    uint64_t tasksStolen;
+    /** the number of tasks that where not queued because the queue was
+     * full and the time out expired, returning PO_ERROR_TIMEOUT */
+    uint64_t numRejected;
+    /** the number of times that a thread adding a task waited because
+     * the queue was full */
+    uint64_t numFullWaits;
+    /** the total time, in seconds, that threads adding tasks waited
+     * because the queue was full */
+    double fullWaitTime;
+    /** the number of tasks that where past their deadline in deadline
+     * mode */
+    uint64_t numExpired;
+};
+
+
+/** Get thread pool statistics.
+ *
+ * This does not lock the pool, and the counters are kept without locks
+ * or atomic read-modify-write operations, so it's cheap enough to call
+ * often in production builds.  The values are read one at a time while
+ * the pool is running, so they may not add up exactly.  The counts are
+ * totals from the time the pool was created.
+ *
+ * \param p a struct POThreadPool pointer returned from
+ * poThreadPool_create().
+ * \param stats the struct that gets the statistics.
+ */
+extern
+void poThreadPool_getStats(struct POThreadPool *p,
+        struct POThreadPool_stats *stats);
+
+
+/** Turn on task latency histograms.
+ *
+ * With histograms, the pool records how long each task waited, from the
+ * poThreadPool_runTask() call to the start of the task callback, and how
+ * long the task callback ran.  The times are recorded for the pool, and
+ * for a tract if the user sets the \p histograms pointer in the struct
+ * POThreadPool_tract to zeroed memory that stays valid while the tract
+ * has tasks.  poThreadPool_checkTractFinish() keeps the \p histograms
+ * pointer.
+ *
+ * Each worker records in its own histograms without locks, so this
+ * costs two clock reads for each task.  Without this call there are no
+ * clock reads.
+ *
+ * This must be called before the first call to poThreadPool_runTask().
+ *
+ * \param p a struct POThreadPool pointer returned from
+ * poThreadPool_create().
+ *
+ * \return 0 on success, or non-zero if the pool has already started
+ * threads or already has histograms.
+ */
+extern
+int poThreadPool_setHistograms(struct POThreadPool *p);
+
+
+/** Get the pool task latency histograms.
+ *
+ * The histograms of all the workers are added together.  The pool is
+ * not locked, so tasks may be recorded while this reads the counts.
+ *
+ * \param p a struct POThreadPool pointer returned from
+ * poThreadPool_create().
+ * \param histograms the struct that gets the histograms.  It gets all
+ * zeros if the pool does not have histograms.
+ */
+extern
+void poThreadPool_getHistograms(struct POThreadPool *p,
+        struct POThreadPool_histograms *histograms);
+
+
+/** Get the lowest time in a histogram bucket.
+ *
+ * \param index the bucket index.
+ *
+ * \return the lowest time, in nanoseconds, that is counted in the
+ * bucket.  The highest time is one less than the lowest time of the
+ * next bucket.
+ */
+extern
+uint64_t poThreadPool_histogramValue(uint32_t index);
+
+
+/** Get a percentile time from a histogram.
+ *
+ * \param h the histogram.
+ * \param percentile from 0 to 100.
+ *
+ * \return the time, in seconds, that \p percentile percent of the
+ * recorded times are at or below, to within the bucket width, or 0 if
+ * the histogram is empty.
+ */
+extern
+double poThreadPool_histogramPercentile(
+        const struct POThreadPool_histogram *h, double percentile);
+
+
+/** Set the tract quantum.
+ *
+ * Without a tract quantum, a worker that is working on a tract runs all
+ * the queued tasks in that tract before it runs other tasks, so a tract
+ * that keeps getting tasks can keep a worker to itself while other tasks
+ * wait.  With a tract quantum, a worker that has run \p quantum tasks in
+ * a row from a tract gives up the tract if there are other tasks
+ * waiting.  The tract then waits, with its queued tasks, in a first in
+ * first out list of ready tracts, and workers take turns between the
+ * ready tracts and the General queue.  Tasks in a tract still run in
+ * order and one at a time.
+ *
+ * This must be called before the first call to poThreadPool_runTask().
+ *
+ * \param p a struct POThreadPool pointer returned from
+ * poThreadPool_create().
+ * \param quantum the number of tasks in a row, or 0 for no tract
+ * quantum, the default.
+ *
+ * \return 0 on success, or non-zero if the pool has already started
+ * threads.
+ */
+extern
+int poThreadPool_setTractQuantum(struct POThreadPool *p, uint32_t quantum);
+
+
+/** Make the pool own a slab of tracts.
+ *
+ * The tracts in the slab are referred to by integer handles from
+ * poThreadPool_tractAlloc().  A handle has the index of the tract in the
+ * slab and a generation number, so looking up a tract is O(1) without
+ * the pool mutex lock, and handles to recycled tracts go stale.
+ *
+ * This must be called once before the first call to
+ * poThreadPool_runTask().
+ *
+ * \param p a struct POThreadPool pointer returned from
+ * poThreadPool_create().
+ * \param numTracts the number of tracts in the slab.
+ *
+ * \return 0 on success, or non-zero on failure.
+ */
+extern
+int poThreadPool_setTractSlab(struct POThreadPool *p, uint32_t numTracts);
+
+
+/** Get a tract from the pool tract slab.
+ *
+ * The tract starts with one reference.  When all the references are
+ * released with poThreadPool_tractRelease() and there are no queued or
+ * running tasks in the tract, the tract is recycled and \p
+ * drainedCallback is called with \p drainedData.  It's called from the
+ * worker thread that ran the last task in the tract, or from
+ * poThreadPool_tractRelease() if the tract has no tasks then.  Do not
+ * use the handle after the last reference is released.
+ *
+ * \param p a struct POThreadPool pointer returned from
+ * poThreadPool_create().
+ * \param drainedCallback the callback, or NULL for none.
+ * \param drainedData passed to \p drainedCallback.
+ *
+ * \return a non-zero tract handle, or 0 if all the tracts in the slab
+ * are in use.
+ */
+extern
+uint64_t poThreadPool_tractAlloc(struct POThreadPool *p,
+        void *(*drainedCallback)(void *), void *drainedData);
+
+
+/** Get the tract from a tract handle.
+ *
+ * This does not use the pool mutex lock.
+ *
+ * \param p a struct POThreadPool pointer returned from
+ * poThreadPool_create().
+ * \param handle a tract handle from poThreadPool_tractAlloc().
+ *
+ * \return a pointer to the tract to use with poThreadPool_runTask(), or
+ * NULL if the tract was recycled.
+ */
+extern
+struct POThreadPool_tract *poThreadPool_tractGet(struct POThreadPool *p,
+        uint64_t handle);
+
+
+/** Add a reference to a tract from the pool tract slab.
+ *
+ * The caller must already have a reference to the tract.
+ *
+ * \param p a struct POThreadPool pointer returned from
+ * poThreadPool_create().
+ * \param handle a tract handle from poThreadPool_tractAlloc().
+ */
+extern
+void poThreadPool_tractRetain(struct POThreadPool *p, uint64_t handle);
+
+
+/** Release a reference to a tract from the pool tract slab.
+ *
+ * \param p a struct POThreadPool pointer returned from
+ * poThreadPool_create().
+ * \param handle a tract handle from poThreadPool_tractAlloc().
+ */
+extern
+void poThreadPool_tractRelease(struct POThreadPool *p, uint64_t handle);
+
+
+/** Change the thread and queue limits of a running pool.
+ *
+ * The queue can be made longer or shorter, and more task memory is
+ * allocated if it's longer than it has been.  If the queue is made
+ * shorter while it has more queued tasks than \p maxQueueLength, they
+ * still run, and no more tasks are queued until there is room.
+ *
+ * The number of threads can be changed up to the \p maxNumThreads that
+ * was passed to poThreadPool_create(), since the pool has that many
+ * worker structs.  If it's made smaller, idle threads above the limit
+ * exit now and working threads above the limit exit when they finish
+ * their work, in place of going idle.
+ *
+ * This may be called from any thread.
+ *
+ * \param p a struct POThreadPool pointer returned from
+ * poThreadPool_create().
+ * \param maxNumThreads the maximum number of worker threads, from 1 to
+ * the \p maxNumThreads passed to poThreadPool_create().
+ * \param maxQueueLength the maximum number of queued tasks.
+ *
+ * \return 0 on success, or non-zero on failure.
+ */
+extern
+int poThreadPool_resize(struct POThreadPool *p,
+        uint32_t maxNumThreads, uint32_t maxQueueLength);
+
+
+/** Let the pool choose how many worker threads it runs.
+ *
+ * With adaptive concurrency the pool changes its thread limit, between
+ * \p minNumThreads and the \p maxNumThreads passed to
+ * poThreadPool_create(), to get the most tasks finished per second.
+ * Once every \p period the spawner thread measures the throughput and,
+ * while tasks are waiting in the queue, moves the limit one thread up or
+ * down.  It keeps going the same way while the throughput gets better
+ * and turns around when it does not, so tasks that block get more
+ * threads and tasks that keep the CPUs busy get fewer.  The idle and
+ * unused workers are the reserve that it adds threads from, and threads
+ * above the limit exit as in poThreadPool_resize().
+ *
+ * The controller starts from the thread limit that the pool has, which
+ * is raised to \p minNumThreads if it's less.  poThreadPool_resize()
+ * sets the limit that the controller goes on from.  The limit is in
+ * poThreadPool_getStats().
+ *
+ * This may be called from any thread.
+ *
+ * \param p a struct POThreadPool pointer returned from
+ * poThreadPool_create().
+ * \param minNumThreads the lowest thread limit that the controller
+ * will set, from 1 to \p maxNumThreads.
+ * \param period the time between changes, in milliseconds.  It needs
+ * to be long enough for many tasks to finish.  If it's 0 the controller
+ * is turned off and the thread limit stays where it is.
+ *
+ * \return 0 on success, or non-zero on failure.
+ */
+extern
+int poThreadPool_setAdaptiveConcurrency(struct POThreadPool *p,
+        uint32_t minNumThreads, uint32_t period);
+
+
+/** A task that has been running a long time
+ *
+ * See poThreadPool_setWatchdog() and poThreadPool_getHungTasks().
+ */
+struct POThreadPool_hungTask
+{
+    /** the task callback */
+    void *(*callback)(void *);
+    /** the data passed to the task callback */
+    void *callbackData;
+    /** the tract that the worker running the task holds, or NULL.  This
+     * is the tract of the task if it has one.  The queued tasks in this
+     * tract can't run until the worker finishes. */
+    struct POThreadPool_tract *tract;
+    /** the index of the worker running the task, from 0 to \p
+     * maxNumThreads - 1 */
+    uint32_t worker;
+    /** the time, in seconds, that the task has been running */
+    double runTime;
+};
+
+
+/** Turn on the hung task watchdog.
+ *
+ * With the watchdog on, the pool keeps the working worker threads in a
+ * list ordered by the time they started their task, so that the tasks
+ * that have run a long time can be found without looking at all the
+ * workers, with poThreadPool_getHungTasks().  This costs two clock reads
+ * for each task.
+ *
+ * If \p hook is not NULL the pool's spawner thread looks for tasks that
+ * have run longer than \p threshold every half of \p threshold, and
+ * calls \p hook once for each of them, so that the user can shed load,
+ * with poThreadPool_cancelTract() or by rejecting work, before blocked
+ * tasks use up all the worker threads.  The hook is called without the
+ * pool mutex lock, so it may call the pool functions, but it should not
+ * block, since the spawner thread does not start threads while it runs.
+ *
+ * This must be called once before the first call to
+ * poThreadPool_runTask().
+ *
+ * \param p a struct POThreadPool pointer returned from
+ * poThreadPool_create().
+ * \param threshold the time, in milliseconds, that a task may run
+ * before \p hook is called for it.  It must not be 0.
+ * \param hook the function to call for each task that runs longer than
+ * \p threshold, or NULL.
+ * \param hookData passed to \p hook.
+ *
+ * \return 0 on success, or non-zero on failure.
+ */
+extern
+int poThreadPool_setWatchdog(struct POThreadPool *p, uint32_t threshold,
+        void (*hook)(struct POThreadPool *p,
+            const struct POThreadPool_hungTask *hungTask, void *hookData),
+        void *hookData);
+
+
+/** Get the tasks that have been running a long time.
+ *
+ * The watchdog must be on, see poThreadPool_setWatchdog().  The tasks
+ * are listed about in the order that they started.
+ *
+ * This may be called from any thread.
+ *
+ * \param p a struct POThreadPool pointer returned from
+ * poThreadPool_create().
+ * \param threshold the time, in milliseconds, that a task must have
+ * run to be listed.
+ * \param hungTasks an array that gets the tasks.
+ * \param maxHungTasks the length of \p hungTasks.
+ *
+ * \return the number of tasks put in \p hungTasks, which is 0 if the
+ * watchdog is not on.
+ */
+extern
+uint32_t poThreadPool_getHungTasks(struct POThreadPool *p,
+        uint32_t threshold, struct POThreadPool_hungTask *hungTasks,
+        uint32_t maxHungTasks);
+
+
+/** Mark the start of a blocking region in a task callback.
+ *
+ * Call this from a task callback before it blocks on disk or network
+ * I/O, or anything else that does not use the CPU, and call
+ * poThreadPool_blockingEnd() after.  While the callback is in the
+ * blocking region the pool may have one more worker thread than the
+ * thread limit, up to \p maxNumThreads from poThreadPool_create(), so
+ * the queued tasks can keep the CPUs busy.  If there are queued tasks,
+ * a thread is started for them now, from the unused workers.  After
+ * poThreadPool_blockingEnd() the extra thread exits when it runs out of
+ * work, or now if it's idle, so the pool does not stay oversized.
+ *
+ * The pool never has more than \p maxNumThreads threads, so there must
+ * be room between the thread limit and \p maxNumThreads for the threads
+ * of the blocking regions.  The thread limit starts at \p maxNumThreads,
+ * so lower it with poThreadPool_resize(), or let
+ * poThreadPool_setAdaptiveConcurrency() lower it.  If there is no room
+ * left this fails, and the task is not in a blocking region, so it must
+ * not call poThreadPool_blockingEnd().
+ *
+ * The calls may be nested, only the outermost pair counts.  If the
+ * callback returns without calling poThreadPool_blockingEnd() the pool
+ * ends the blocking region for it, with a warning.
+ *
+ * \param p the struct POThreadPool pointer of the pool that is running
+ * the calling task.
+ *
+ * \return 0 on success, or non-zero if this is not called from a task
+ * callback of the pool \p p, or if the pool has no room for another
+ * thread.
+ */
+extern
+int poThreadPool_blockingBegin(struct POThreadPool *p);
+
+
+/** Mark the end of a blocking region in a task callback.
+ *
+ * See poThreadPool_blockingBegin().
+ *
+ * \param p the struct POThreadPool pointer of the pool that is running
+ * the calling task.
+ *
+ * \return 0 on success, or non-zero if this is not called from a task
+ * callback of the pool \p p, in a blocking region.
+ */
+extern
+int poThreadPool_blockingEnd(struct POThreadPool *p);
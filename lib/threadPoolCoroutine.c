@@ -0,0 +1,827 @@
+#define _GNU_SOURCE
+#include <sys/time.h> // gettimeofday() in _pthreadWrap.h
+#include <stdbool.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdarg.h> // va_start() in debug.h
+#include <unistd.h>
+#include <ucontext.h>
+#include <sys/mman.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#include "debug.h"
+#include "tIme.h"
+#include "_pthreadWrap.h" // mutexInit() mutexLock() etc...
+#include "define.h"
+#include "threadPool.h"
+#include "threadPoolCoroutine.h"
+
+
+// The most epoll events that the poller thread gets in one call.
+#ifndef PO_THREADPOOLCOROUTINE_MAX_EVENTS
+#  define PO_THREADPOOLCOROUTINE_MAX_EVENTS  (64)
+#endif
+
+// The time, in milliseconds, that the poller thread waits before it tries
+// again to queue the coroutines that the pool had no room for.
+#ifndef PO_THREADPOOLCOROUTINE_RETRY_TIME
+#  define PO_THREADPOOLCOROUTINE_RETRY_TIME  (1)
+#endif
+
+
+// Values of POThreadPoolCoroutine_coro::state
+enum
+{
+    PO_CORO_UNUSED    = 0, // in the unused stack
+    PO_CORO_RUNNING   = 1, // queued in the pool or running
+    PO_CORO_SUSPENDED = 2  // waiting to be resumed, for a fd, or a timer
+};
+
+// Values of POThreadPoolCoroutine_coro::action, what the worker thread
+// does with the coroutine after it switches back from it.
+enum
+{
+    PO_CORO_SUSPEND = 1, // from poThreadPoolCoroutine_suspend()
+    PO_CORO_WAIT    = 2, // from poThreadPoolCoroutine_waitFd()
+    PO_CORO_FINISH  = 3  // the coroutine callback returned
+};
+
+// POThreadPoolCoroutine_coro::heapIndex when it's not in the timer heap.
+#define NOT_IN_HEAP  UINT32_MAX
+
+
+struct POThreadPoolCoroutine_coro
+{
+    struct POThreadPoolCoroutine *coroutines;
+
+    // The context of the coroutine while it's not running, and the
+    // context of the worker thread that is running it, which it switches
+    // back to when it suspends or finishes.
+    ucontext_t context;
+    ucontext_t *workerContext;
+
+    void (*callback)(void *userData);
+    void *userData;
+    struct POThreadPool_tract *tract;
+
+    // The lowest address of the stack, above the guard page.
+    uint8_t *stack;
+
+    // The rest is changed with the mutex lock in struct
+    // POThreadPoolCoroutine, except action and the wait parameters that
+    // the coroutine sets for the worker thread before it switches back.
+
+    uint32_t state, action;
+
+    // This is changed each time the coroutine finishes, so that handles
+    // to it go stale.
+    uint32_t generation;
+
+    // Set if poThreadPoolCoroutine_resume() was called while the
+    // coroutine was running, so the next suspend does not wait.
+    bool wakeup;
+
+    // The poThreadPoolCoroutine_waitFd() parameters, and the events that
+    // it returns.  inEpoll is set while fd is in the epoll set.
+    int fd;
+    uint32_t events, timeOut, result;
+    bool inEpoll;
+
+    // The time, from poTime_getDouble(), that the wait times out, and the
+    // index of this in the timer heap.
+    double deadline;
+    uint32_t heapIndex;
+
+    // In the unused stack, or the pending list.
+    struct POThreadPoolCoroutine_coro *next;
+} __attribute__((aligned(64)));
+// Each coroutine starts on its own cache line, since the worker threads
+// running them change them.
+
+
+struct POThreadPoolCoroutine
+{
+    struct POThreadPool *pool;
+
+    uint32_t maxCoroutines;
+    size_t stackSize, mapSize;
+
+    struct POThreadPoolCoroutine_coro *coro;
+    // All the stacks, each after a guard page.
+    uint8_t *stacks;
+
+    // The poller thread waits on epollFd for the file descriptors and
+    // eventFd, which is written to wake it when the first timer changes
+    // or it should exit.
+    int epollFd, eventFd;
+    pthread_t poller;
+
+    // protects the rest of this and the coroutine states
+    pthread_mutex_t mutex;
+
+    bool pollerExit;
+
+    // The unused coroutines.
+    struct POThreadPoolCoroutine_coro *unused;
+
+    // The coroutines to continue that the pool did not take yet, oldest
+    // first.  The poller thread tries to queue them again each time it
+    // wakes.
+    struct POThreadPoolCoroutine_coro *pending, *pendingLast;
+
+    // The coroutines waiting with a time out, in a binary heap with the
+    // earliest deadline in heap[0].
+    struct POThreadPoolCoroutine_coro **heap;
+    uint32_t heapLength;
+};
+
+
+// The coroutine that this thread is running, if any.  A coroutine can
+// continue on another thread after it suspends, so coroutine code must
+// read this before it switches back to the worker, and not after.
+static __thread struct POThreadPoolCoroutine_coro *currentCoro = NULL;
+
+
+// We must have the mutex lock to call this.
+//
+// Move the coroutine at index i in the heap up to where it belongs.
+static inline
+void heapUp(struct POThreadPoolCoroutine_coro **heap, uint32_t i)
+{
+    struct POThreadPoolCoroutine_coro *co;
+    co = heap[i];
+
+    while(i)
+    {
+        uint32_t parent;
+        parent = (i - 1)/2;
+        if(!(co->deadline < heap[parent]->deadline))
+            break;
+        heap[i] = heap[parent];
+        heap[i]->heapIndex = i;
+        i = parent;
+    }
+    heap[i] = co;
+    co->heapIndex = i;
+}
+
+
+// We must have the mutex lock to call this.
+//
+// Move the coroutine at index i in the heap of length n down to where it
+// belongs.
+static inline
+void heapDown(struct POThreadPoolCoroutine_coro **heap, uint32_t n,
+        uint32_t i)
+{
+    struct POThreadPoolCoroutine_coro *co;
+    co = heap[i];
+
+    while(true)
+    {
+        uint32_t child;
+        child = 2*i + 1;
+        if(child >= n)
+            break;
+        if(child + 1 < n && heap[child + 1]->deadline <
+                heap[child]->deadline)
+            ++child;
+        if(!(heap[child]->deadline < co->deadline))
+            break;
+        heap[i] = heap[child];
+        heap[i]->heapIndex = i;
+        i = child;
+    }
+    heap[i] = co;
+    co->heapIndex = i;
+}
+
+
+// We must have the mutex lock to call this.
+static inline
+void heapRemove(struct POThreadPoolCoroutine *c,
+        struct POThreadPoolCoroutine_coro *co)
+{
+    uint32_t i = co->heapIndex;
+
+    DASSERT(i < c->heapLength);
+    DASSERT(c->heap[i] == co);
+
+    co->heapIndex = NOT_IN_HEAP;
+
+    if(i == --c->heapLength)
+        return;
+
+    // Move the last one into the hole.
+    c->heap[i] = c->heap[c->heapLength];
+    c->heap[i]->heapIndex = i;
+    heapUp(c->heap, i);
+    heapDown(c->heap, c->heapLength, c->heap[i]->heapIndex);
+}
+
+
+static inline
+void wakePoller(struct POThreadPoolCoroutine *c)
+{
+    uint64_t one = 1;
+    ASSERT(write(c->eventFd, &one, sizeof(one)) == sizeof(one));
+}
+
+
+// We must have the mutex lock to call this.
+//
+// Stop a suspended coroutine from waiting, so it can be queued to
+// continue, and have its wait return events.
+static inline
+void wake(struct POThreadPoolCoroutine *c,
+        struct POThreadPoolCoroutine_coro *co, uint32_t events)
+{
+    DASSERT(co->state == PO_CORO_SUSPENDED);
+
+    if(co->inEpoll)
+    {
+        // This fails if the user closed the fd, which took it out of
+        // the epoll set already.
+        epoll_ctl(c->epollFd, EPOLL_CTL_DEL, co->fd, NULL);
+        co->inEpoll = false;
+    }
+
+    if(co->heapIndex != NOT_IN_HEAP)
+        heapRemove(c, co);
+
+    co->result = events;
+    co->state = PO_CORO_RUNNING;
+}
+
+
+// We must have the mutex lock to call this.
+static inline
+void pendingPush(struct POThreadPoolCoroutine *c,
+        struct POThreadPoolCoroutine_coro *co)
+{
+    DASSERT(co->state == PO_CORO_RUNNING);
+
+    co->next = NULL;
+    if(c->pendingLast)
+        c->pendingLast->next = co;
+    else
+        c->pending = co;
+    c->pendingLast = co;
+}
+
+
+static void *stepTask(struct POThreadPoolCoroutine_coro *co);
+
+
+// Queue a coroutine in the pool to continue.  We must not have the mutex
+// lock to call this.  This does not wait for room in the pool queue,
+// since the caller may be a worker thread of the pool, that could wait
+// for ever.  If the pool does not take it, it's left in the pending list
+// for the poller thread, so it never runs in this thread.
+static inline
+void queueCoro(struct POThreadPoolCoroutine_coro *co)
+{
+    struct POThreadPoolCoroutine *c = co->coroutines;
+    bool wasEmpty;
+
+    DASSERT(co->state == PO_CORO_RUNNING);
+
+    if(!poThreadPool_runTask(c->pool, 0, co->tract,
+                (void *(*)(void *)) stepTask, co))
+        return;
+
+    mutexLock(&c->mutex);
+    wasEmpty = !c->pending;
+    pendingPush(c, co);
+    mutexUnlock(&c->mutex);
+
+    if(wasEmpty)
+        // The poller thread must wait less.
+        wakePoller(c);
+}
+
+
+// We must have the mutex lock to call this.  It's unlocked while the
+// coroutines are queued.
+//
+// The poller thread queues the pending coroutines without waiting for
+// room in the pool queue, so that it keeps watching the file descriptors
+// and timers.  The coroutines that the pool does not take stay pending,
+// in order, for the next try.
+static inline
+void queuePending(struct POThreadPoolCoroutine *c)
+{
+    struct POThreadPoolCoroutine_coro *co, *last;
+
+    co = c->pending;
+    last = c->pendingLast;
+    c->pending = NULL;
+    c->pendingLast = NULL;
+
+    mutexUnlock(&c->mutex);
+
+    while(co)
+    {
+        // The coroutine may finish, and be in the unused stack, as soon
+        // as it's queued.
+        struct POThreadPoolCoroutine_coro *next = co->next;
+        if(poThreadPool_runTask(c->pool, 0, co->tract,
+                    (void *(*)(void *)) stepTask, co))
+            // The queue is full, so the rest will not fit either.
+            break;
+        co = next;
+    }
+
+    mutexLock(&c->mutex);
+
+    if(co)
+    {
+        // These are older than the ones that where added since.
+        last->next = c->pending;
+        if(!c->pending)
+            c->pendingLast = last;
+        c->pending = co;
+    }
+}
+
+
+// The start of all the coroutine contexts.
+static
+void coroMain(void)
+{
+    // We just switched here from stepTask() in this thread.
+    struct POThreadPoolCoroutine_coro *co = currentCoro;
+    DASSERT(co);
+
+    co->callback(co->userData);
+
+    co->action = PO_CORO_FINISH;
+    // This may be a different worker thread than the one that started
+    // the coroutine.
+    setcontext(co->workerContext);
+    VASSERT(0, "setcontext() failed");
+}
+
+
+// The pool task callback of a coroutine.  It switches to the coroutine
+// and runs it until it suspends or finishes, and then does what the
+// coroutine asked for, now that this thread is off of its stack.
+static
+void *stepTask(struct POThreadPoolCoroutine_coro *co)
+{
+    struct POThreadPoolCoroutine *c = co->coroutines;
+    ucontext_t workerContext;
+    bool requeue = false;
+
+    DASSERT(!currentCoro);
+
+    co->workerContext = &workerContext;
+    currentCoro = co;
+
+    ASSERT(swapcontext(&workerContext, &co->context) == 0);
+
+    currentCoro = NULL;
+
+    mutexLock(&c->mutex);
+
+    DASSERT(co->state == PO_CORO_RUNNING);
+
+    switch(co->action)
+    {
+        case PO_CORO_FINISH:
+            co->state = PO_CORO_UNUSED;
+            ++co->generation;
+            co->wakeup = false;
+            co->next = c->unused;
+            c->unused = co;
+            break;
+
+        case PO_CORO_SUSPEND:
+        case PO_CORO_WAIT:
+            co->result = 0;
+            if(co->wakeup)
+            {
+                // It was resumed before it suspended.
+                co->wakeup = false;
+                requeue = true;
+                break;
+            }
+            if(co->action == PO_CORO_WAIT && co->fd >= 0)
+            {
+                struct epoll_event ev;
+                memset(&ev, 0, sizeof(ev));
+                ev.events = co->events | EPOLLONESHOT;
+                ev.data.ptr = co;
+                if(epoll_ctl(c->epollFd, EPOLL_CTL_ADD, co->fd, &ev))
+                {
+                    // Regular files can't be in an epoll set, and they
+                    // are always ready.
+                    if(errno != EPERM)
+                        ERROR("epoll_ctl(,EPOLL_CTL_ADD, fd=%d,) failed",
+                                co->fd);
+                    requeue = true;
+                    break;
+                }
+                co->inEpoll = true;
+            }
+            if(co->action == PO_CORO_WAIT && co->timeOut != PO_LONGTIME)
+            {
+                co->deadline = poTime_getDouble() + co->timeOut*0.001;
+                c->heap[c->heapLength] = co;
+                heapUp(c->heap, c->heapLength++);
+                if(co->heapIndex == 0)
+                    // The poller thread must wait less.
+                    wakePoller(c);
+            }
+            co->state = PO_CORO_SUSPENDED;
+            break;
+
+        default:
+            VASSERT(0, "bad coroutine action %"PRIu32, co->action);
+    }
+
+    mutexUnlock(&c->mutex);
+
+    if(requeue)
+        queueCoro(co);
+
+    return NULL;
+}
+
+
+// Switch from the coroutine co back to the worker thread that is running
+// it.  When this returns the coroutine may be running in another thread.
+static inline
+void switchOut(struct POThreadPoolCoroutine_coro *co, uint32_t action)
+{
+    co->action = action;
+    ASSERT(swapcontext(&co->context, co->workerContext) == 0);
+}
+
+
+// The poller thread.  It queues the coroutines whose fds are ready and
+// whose time outs have run out, and the pending coroutines.
+static
+void *pollerCallback(struct POThreadPoolCoroutine *c)
+{
+    struct epoll_event events[PO_THREADPOOLCOROUTINE_MAX_EVENTS];
+
+    mutexLock(&c->mutex);
+
+    while(!c->pollerExit)
+    {
+        struct POThreadPoolCoroutine_coro *co;
+        int i, n, timeOut = -1;
+        double t;
+
+        if(c->heapLength)
+        {
+            t = c->heap[0]->deadline - poTime_getDouble();
+            if(t <= 0.0)
+                timeOut = 0;
+            else if(t < INT_MAX/1000)
+                // Round up, so we do not wake before the deadline.
+                timeOut = (int) (t*1000.0) + 1;
+        }
+
+        if(c->pending && (timeOut < 0 ||
+                    timeOut > PO_THREADPOOLCOROUTINE_RETRY_TIME))
+            timeOut = PO_THREADPOOLCOROUTINE_RETRY_TIME;
+
+        mutexUnlock(&c->mutex);
+
+        n = epoll_wait(c->epollFd, events, PO_THREADPOOLCOROUTINE_MAX_EVENTS,
+                timeOut);
+        if(n < 0)
+        {
+            VASSERT(errno == EINTR, "epoll_wait() failed");
+            n = 0;
+        }
+
+        mutexLock(&c->mutex);
+
+        for(i = 0; i < n; ++i)
+        {
+            co = events[i].data.ptr;
+            if(!co)
+            {
+                // eventFd
+                uint64_t count;
+                ASSERT(read(c->eventFd, &count, sizeof(count)) ==
+                        sizeof(count));
+                continue;
+            }
+            // A coroutine that was resumed, while we did not have the
+            // mutex lock, is not in the epoll set any more.
+            if(co->state != PO_CORO_SUSPENDED || !co->inEpoll)
+                continue;
+            wake(c, co, events[i].events);
+            pendingPush(c, co);
+        }
+
+        t = poTime_getDouble();
+        while(c->heapLength && c->heap[0]->deadline <= t)
+        {
+            co = c->heap[0];
+            wake(c, co, 0);
+            pendingPush(c, co);
+        }
+
+        if(c->pending)
+            queuePending(c);
+    }
+
+    mutexUnlock(&c->mutex);
+
+    return NULL;
+}
+
+
+struct POThreadPoolCoroutine *poThreadPoolCoroutine_create(
+        struct POThreadPool *p, uint32_t maxCoroutines, size_t stackSize)
+{
+    struct POThreadPoolCoroutine *c;
+    struct epoll_event ev;
+    size_t pageSize;
+    uint32_t i;
+
+    if(ASSERT(p && maxCoroutines))
+        return NULL;
+
+    pageSize = sysconf(_SC_PAGESIZE);
+    if(!stackSize)
+        stackSize = PO_THREADPOOLCOROUTINE_STACK_SIZE;
+    stackSize = (stackSize + pageSize - 1) & ~(pageSize - 1);
+
+    c = calloc(1, sizeof(*c));
+    if(VASSERT(c, "calloc() failed")) return NULL;
+
+    c->pool = p;
+    c->maxCoroutines = maxCoroutines;
+    c->stackSize = stackSize;
+    c->epollFd = -1;
+    c->eventFd = -1;
+
+    if(posix_memalign((void **) &c->coro, 64,
+                sizeof(*c->coro)*maxCoroutines))
+        c->coro = NULL;
+    c->heap = calloc(maxCoroutines, sizeof(*c->heap));
+    // The stack memory is not used until the coroutines run.
+    c->mapSize = (pageSize + stackSize)*maxCoroutines;
+    c->stacks = mmap(NULL, c->mapSize, PROT_READ|PROT_WRITE,
+            MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE|MAP_STACK, -1, 0);
+    if(c->stacks == MAP_FAILED)
+        c->stacks = NULL;
+
+    if(VASSERT(c->coro && c->heap && c->stacks,
+                "memory allocation failed"))
+        goto fail;
+
+    c->epollFd = epoll_create1(EPOLL_CLOEXEC);
+    c->eventFd = eventfd(0, EFD_CLOEXEC|EFD_NONBLOCK);
+    if(VASSERT(c->epollFd >= 0 && c->eventFd >= 0,
+                "epoll_create1() or eventfd() failed"))
+        goto fail;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL;
+    if(ASSERT(epoll_ctl(c->epollFd, EPOLL_CTL_ADD, c->eventFd, &ev) == 0))
+        goto fail;
+
+    memset(c->coro, 0, sizeof(*c->coro)*maxCoroutines);
+    for(i = maxCoroutines; i;)
+    {
+        struct POThreadPoolCoroutine_coro *co;
+        uint8_t *guard;
+        --i;
+        co = &c->coro[i];
+        // Stacks grow down, so the guard page is below the stack.
+        guard = c->stacks + i*(pageSize + stackSize);
+        if(ASSERT(mprotect(guard, pageSize, PROT_NONE) == 0))
+            goto fail;
+        co->coroutines = c;
+        co->stack = guard + pageSize;
+        co->generation = 1;
+        co->heapIndex = NOT_IN_HEAP;
+        co->next = c->unused;
+        c->unused = co;
+    }
+
+    if(mutexInit(&c->mutex))
+        goto fail;
+
+    if(ASSERT((errno = pthread_create(&c->poller, NULL,
+                (void *(*)(void *)) pollerCallback, c)) == 0))
+    {
+        mutexDestroy(&c->mutex);
+        goto fail;
+    }
+
+    INFO("Created %"PRIu32" coroutines with %zu byte stacks",
+            maxCoroutines, stackSize);
+
+    return c;
+
+fail:
+
+    if(c->eventFd >= 0)
+        close(c->eventFd);
+    if(c->epollFd >= 0)
+        close(c->epollFd);
+    if(c->stacks)
+        munmap(c->stacks, c->mapSize);
+    free(c->heap);
+    free(c->coro);
+    free(c);
+    return NULL;
+}
+
+
+void poThreadPoolCoroutine_destroy(struct POThreadPoolCoroutine *c)
+{
+    DASSERT(c);
+#ifdef DEBUG
+    {
+        // All the coroutines must be finished.
+        uint32_t n = 0;
+        struct POThreadPoolCoroutine_coro *co;
+        mutexLock(&c->mutex);
+        for(co = c->unused; co; co = co->next)
+            ++n;
+        mutexUnlock(&c->mutex);
+        DASSERT(n == c->maxCoroutines);
+        DASSERT(!c->pending);
+    }
+#endif
+
+    mutexLock(&c->mutex);
+    c->pollerExit = true;
+    wakePoller(c);
+    mutexUnlock(&c->mutex);
+
+    ASSERT((errno = pthread_join(c->poller, NULL)) == 0);
+
+    mutexDestroy(&c->mutex);
+    close(c->eventFd);
+    close(c->epollFd);
+    munmap(c->stacks, c->mapSize);
+    free(c->heap);
+    free(c->coro);
+#ifdef DEBUG
+    memset(c, 0, sizeof(*c));
+#endif
+    free(c);
+}
+
+
+int poThreadPoolCoroutine_run(struct POThreadPoolCoroutine *c,
+        uint32_t timeOut, struct POThreadPool_tract *tract,
+        void (*callback)(void *userData), void *userData,
+        struct POThreadPoolCoroutine_handle *handle)
+{
+    struct POThreadPoolCoroutine_coro *co;
+    int ret;
+
+    DASSERT(c);
+    DASSERT(callback);
+
+    mutexLock(&c->mutex);
+
+    co = c->unused;
+    if(co)
+    {
+        c->unused = co->next;
+        co->state = PO_CORO_RUNNING;
+    }
+
+    mutexUnlock(&c->mutex);
+
+    if(!co)
+    {
+        NOTICE("coroutines(%p) has %"PRIu32" coroutines running", c,
+                c->maxCoroutines);
+        return 1; // fail
+    }
+
+    co->callback = callback;
+    co->userData = userData;
+    co->tract = tract;
+    co->next = NULL;
+
+    ASSERT(getcontext(&co->context) == 0);
+    co->context.uc_stack.ss_sp = co->stack;
+    co->context.uc_stack.ss_size = c->stackSize;
+    co->context.uc_link = NULL;
+    makecontext(&co->context, coroMain, 0);
+
+    if(handle)
+    {
+        handle->coro = co;
+        handle->generation = co->generation;
+    }
+
+    // poThreadPool_runTask() gets the pool mutex lock, so the worker
+    // thread will see all these values.
+    ret = poThreadPool_runTask(c->pool, timeOut, tract,
+            (void *(*)(void *)) stepTask, co);
+    if(ret)
+    {
+        mutexLock(&c->mutex);
+        // The handle is stale now.
+        ++co->generation;
+        co->state = PO_CORO_UNUSED;
+        co->next = c->unused;
+        c->unused = co;
+        mutexUnlock(&c->mutex);
+    }
+
+    return ret;
+}
+
+
+void poThreadPoolCoroutine_self(struct POThreadPoolCoroutine_handle *handle)
+{
+    struct POThreadPoolCoroutine_coro *co = currentCoro;
+
+    DASSERT(handle);
+    VASSERT(co, "not called from a coroutine");
+
+    handle->coro = co;
+    handle->generation = co->generation;
+}
+
+
+void poThreadPoolCoroutine_suspend(void)
+{
+    struct POThreadPoolCoroutine_coro *co = currentCoro;
+
+    VASSERT(co, "not called from a coroutine");
+
+    switchOut(co, PO_CORO_SUSPEND);
+}
+
+
+int poThreadPoolCoroutine_resume(struct POThreadPoolCoroutine *c,
+        const struct POThreadPoolCoroutine_handle *handle)
+{
+    struct POThreadPoolCoroutine_coro *co;
+
+    DASSERT(c);
+    DASSERT(handle);
+    DASSERT(handle->coro);
+
+    co = handle->coro;
+
+    mutexLock(&c->mutex);
+
+    if(co->generation != handle->generation ||
+            co->state == PO_CORO_UNUSED)
+    {
+        mutexUnlock(&c->mutex);
+        return 1; // It finished.
+    }
+
+    if(co->state == PO_CORO_RUNNING)
+    {
+        co->wakeup = true;
+        mutexUnlock(&c->mutex);
+        return 0; // success
+    }
+
+    wake(c, co, 0);
+
+    mutexUnlock(&c->mutex);
+
+    queueCoro(co);
+
+    return 0; // success
+}
+
+
+uint32_t poThreadPoolCoroutine_waitFd(int fd, uint32_t events,
+        uint32_t timeOut)
+{
+    struct POThreadPoolCoroutine_coro *co = currentCoro;
+
+    VASSERT(co, "not called from a coroutine");
+
+    co->fd = fd;
+    co->events = events;
+    co->timeOut = timeOut;
+
+    switchOut(co, PO_CORO_WAIT);
+
+    return co->result;
+}
+
+
+void poThreadPoolCoroutine_sleep(uint32_t timeOut)
+{
+    poThreadPoolCoroutine_waitFd(-1, 0, timeOut);
+}
@@ -0,0 +1,207 @@
+/** \file threadPoolCoroutine.h
+ *
+ * Coroutines that run on the potato thread pool.
+ *
+ * A coroutine is a task with its own stack, so that it can suspend
+ * itself, in the middle of its callback, while it waits for a file
+ * descriptor or a timer, or for another thread to resume it.  While it
+ * is suspended it does not hold a worker thread.  When it is resumed it
+ * is queued in the pool again, with poThreadPool_runTask(), and it
+ * continues on whatever worker thread gets it, like:
+ *
+ *     worker 0:  [ read request .. ]              [ .. write reply ]
+ *     worker 1:                      (other tasks)
+ *     poller:                     waitFd()  --->  fd ready, resume
+ *
+ * So a few worker threads can serve many connections that are mostly
+ * waiting, without splitting the callback into many tasks by hand.
+ *
+ * The stacks are allocated when the coroutines are made, with a guard
+ * page below each stack, so running a coroutine does not allocate
+ * memory.  The file descriptors and timers are watched by one poller
+ * thread with epoll(7).  A coroutine that continues never waits for room
+ * in the pool queue; if it does not fit, the poller thread keeps it and
+ * tries again soon.  The context switches use swapcontext(3), which
+ * costs about the same as a system call.
+ *
+ * If a coroutine runs in a tract, each time it continues it's queued in
+ * the same tract, so it never runs at the same time as the other tasks
+ * in the tract, and the parts of it run in order.  Other tasks in the
+ * tract may run while it's suspended.
+ */
+
+
+/// \cond SKIP
+struct POThreadPool;
+struct POThreadPool_tract;
+struct POThreadPoolCoroutine;
+struct POThreadPoolCoroutine_coro;
+/// \endcond
+
+
+/** The default stack size, in bytes, of a coroutine.
+ *
+ * See poThreadPoolCoroutine_create().
+ */
+#ifndef PO_THREADPOOLCOROUTINE_STACK_SIZE
+#  define PO_THREADPOOLCOROUTINE_STACK_SIZE  (64*1024)
+#endif
+
+
+/** A handle to a coroutine.
+ *
+ * Set by poThreadPoolCoroutine_run() or poThreadPoolCoroutine_self() for
+ * poThreadPoolCoroutine_resume().  After the coroutine finishes the
+ * handle is stale, and resuming it does nothing, even if the coroutine
+ * memory is used again by another coroutine.
+ */
+struct POThreadPoolCoroutine_handle
+{
+    /// \cond SKIP
+    struct POThreadPoolCoroutine_coro *coro;
+    uint32_t generation;
+    /// \endcond
+};
+
+
+/** Make coroutines that run on a thread pool
+ *
+ * This starts the poller thread, that watches file descriptors and
+ * timers for poThreadPoolCoroutine_waitFd().
+ *
+ * \param p a pool from poThreadPool_create().  The coroutines are
+ * queued in it each time they start or continue, so it should have a
+ * queue.
+ * \param maxCoroutines the maximum number of coroutines that can be
+ * running or suspended at the same time.
+ * \param stackSize the size of the stack of each coroutine in bytes, or
+ * 0 for PO_THREADPOOLCOROUTINE_STACK_SIZE.  It's rounded up to a whole
+ * number of pages.  The memory is mapped when the coroutines are made,
+ * but the system only gives it pages as the stacks use them.
+ *
+ * \return a pointer to an opaque struct POThreadPoolCoroutine, or NULL
+ * on failure.
+ */
+extern
+struct POThreadPoolCoroutine *poThreadPoolCoroutine_create(
+        struct POThreadPool *p, uint32_t maxCoroutines, size_t stackSize);
+
+
+/** Free the coroutines
+ *
+ * All the coroutines must be finished.  The pool is not destroyed.
+ *
+ * \param c from poThreadPoolCoroutine_create().
+ */
+extern
+void poThreadPoolCoroutine_destroy(struct POThreadPoolCoroutine *c);
+
+
+/** Start a coroutine
+ *
+ * The coroutine is queued in the pool, with poThreadPool_runTask(), and
+ * \p callback is called on its own stack when a worker thread gets it.
+ * The coroutine finishes when \p callback returns.
+ *
+ * This may be called from any thread, including from coroutines.
+ *
+ * \param c from poThreadPoolCoroutine_create().
+ * \param timeOut the time to wait, in milliseconds, for room in the
+ * pool queue, as in poThreadPool_runTask().
+ * \param tract the tract that the coroutine runs in, or NULL.
+ * \param callback the coroutine function.
+ * \param userData passed to \p callback.
+ * \param handle if not NULL, this gets a handle to the coroutine.
+ *
+ * \return 0 on success, or non-zero if there are \p maxCoroutines
+ * coroutines already, or poThreadPool_runTask() failed.
+ */
+extern
+int poThreadPoolCoroutine_run(struct POThreadPoolCoroutine *c,
+        uint32_t timeOut, struct POThreadPool_tract *tract,
+        void (*callback)(void *userData), void *userData,
+        struct POThreadPoolCoroutine_handle *handle);
+
+
+/** Get a handle to the calling coroutine
+ *
+ * This may only be called from a coroutine.
+ *
+ * \param handle gets the handle of the calling coroutine, for
+ * poThreadPoolCoroutine_resume().
+ */
+extern
+void poThreadPoolCoroutine_self(struct POThreadPoolCoroutine_handle *handle);
+
+
+/** Suspend the calling coroutine until it's resumed
+ *
+ * This returns after another thread, or coroutine, calls
+ * poThreadPoolCoroutine_resume() with the handle of this coroutine.  If
+ * that happened since this coroutine last continued, this returns soon
+ * without waiting, so a resume is not lost if it comes before the
+ * suspend.  The worker thread runs other tasks while this waits.
+ *
+ * This may only be called from a coroutine.
+ */
+extern
+void poThreadPoolCoroutine_suspend(void);
+
+
+/** Resume a suspended coroutine
+ *
+ * If the coroutine is waiting in poThreadPoolCoroutine_suspend() or
+ * poThreadPoolCoroutine_waitFd() it's queued in the pool to continue.
+ * If it's running, its next suspend returns without waiting.  This does
+ * not wait for room in the pool queue.  If the pool does not take the
+ * coroutine, the poller thread keeps trying to queue it.
+ *
+ * This may be called from any thread.
+ *
+ * \param c from poThreadPoolCoroutine_create().
+ * \param handle from poThreadPoolCoroutine_run() or
+ * poThreadPoolCoroutine_self().
+ *
+ * \return 0 if the coroutine will be resumed, or non-zero if the handle
+ * is stale, because the coroutine finished.
+ */
+extern
+int poThreadPoolCoroutine_resume(struct POThreadPoolCoroutine *c,
+        const struct POThreadPoolCoroutine_handle *handle);
+
+
+/** Suspend the calling coroutine until a file descriptor is ready
+ *
+ * The coroutine continues, on a worker thread, when \p fd is ready for
+ * any of \p events, when \p timeOut runs out, or when it's resumed by
+ * poThreadPoolCoroutine_resume().  Like with epoll(7), the file
+ * descriptor should be non-blocking, since it may not be ready when
+ * this returns.
+ *
+ * This may only be called from a coroutine.
+ *
+ * \param fd the file descriptor to wait for, or -1 to only wait for the
+ * time out.
+ * \param events the epoll events to wait for, like EPOLLIN or EPOLLOUT.
+ * \param timeOut the time to wait in milliseconds, or PO_LONGTIME to
+ * wait with no time out.
+ *
+ * \return the epoll events that \p fd is ready for, or 0 if it timed
+ * out or was resumed, or if it can't be watched by epoll, like a
+ * regular file.
+ */
+extern
+uint32_t poThreadPoolCoroutine_waitFd(int fd, uint32_t events,
+        uint32_t timeOut);
+
+
+/** Suspend the calling coroutine for a time
+ *
+ * Like poThreadPoolCoroutine_waitFd() with no file descriptor.
+ *
+ * This may only be called from a coroutine.
+ *
+ * \param timeOut the time to sleep in milliseconds.
+ */
+extern
+void poThreadPoolCoroutine_sleep(uint32_t timeOut);
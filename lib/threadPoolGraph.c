@@ -0,0 +1,404 @@
+#define _GNU_SOURCE
+#include <sys/time.h> // gettimeofday() in _pthreadWrap.h
+#include <stdbool.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdarg.h> // va_start() in debug.h
+
+#include "debug.h"
+#include "_pthreadWrap.h" // mutexInit() mutexLock() etc...
+#include "define.h"
+#include "threadPool.h"
+#include "threadPoolGraph.h"
+
+
+// An edge from a node is in the singly linked list of edges out of the
+// node, by index into the graph edge array, with -1 at the end.
+struct POThreadPoolGraph_edge
+{
+    uint32_t to;
+    int32_t next;
+};
+
+
+struct POThreadPoolGraph_node
+{
+    void *(*callback)(void *userData);
+    // The number of edges into this node.
+    uint32_t numIn;
+    // The first edge out of this node, or -1 if there are none.
+    int32_t firstOut;
+};
+
+
+struct POThreadPoolGraph_run;
+
+// The state of a node in a run of the graph.  This is the callback data
+// of the pool task that runs the node.
+struct POThreadPoolGraph_nodeRun
+{
+    struct POThreadPoolGraph_run *run;
+    uint32_t node;
+    // The number of nodes that this node is waiting for, counted down
+    // with atomic operations by the worker threads.
+    uint32_t numWaiting;
+};
+
+
+// A run of the graph.  They are allocated in the graph, with nodeRun
+// arrays of maxNodes after them, and the unused ones are in a stack.
+struct POThreadPoolGraph_run
+{
+    struct POThreadPoolGraph *graph;
+    struct POThreadPool *pool;
+    void *userData;
+    void (*doneCallback)(void *userData);
+
+    // The number of nodes that have not finished.
+    uint32_t numLeft;
+
+    struct POThreadPoolGraph_run *next; // in the unused stack
+
+    struct POThreadPoolGraph_nodeRun nodeRun[];
+};
+
+
+struct POThreadPoolGraph
+{
+    uint32_t maxNodes, numNodes, maxEdges, numEdges, maxRuns;
+
+    // Set at the first run, after which nodes and edges can't be added.
+    bool running;
+
+    struct POThreadPoolGraph_node *node;
+    struct POThreadPoolGraph_edge *edge;
+
+    // Scratch memory of maxNodes for the cycle check in
+    // poThreadPoolGraph_addEdge(), a node stack and a visited bitmap.
+    uint32_t *stack;
+    uint64_t *visited;
+
+    // The runs, each runSize bytes, and the stack of the unused ones
+    // that mutex protects.
+    size_t runSize;
+    uint8_t *runs;
+    struct POThreadPoolGraph_run *unusedRun;
+    pthread_mutex_t mutex;
+};
+
+
+struct POThreadPoolGraph *poThreadPoolGraph_create(uint32_t maxNodes,
+        uint32_t maxEdges, uint32_t maxRuns)
+{
+    struct POThreadPoolGraph *g;
+    uint32_t i;
+
+    if(ASSERT(maxNodes && maxNodes < INT32_MAX &&
+                maxEdges < INT32_MAX && maxRuns))
+        return NULL;
+
+    g = calloc(1, sizeof(*g));
+    if(VASSERT(g, "calloc() failed")) return NULL;
+
+    g->maxNodes = maxNodes;
+    g->maxEdges = maxEdges;
+    g->maxRuns = maxRuns;
+
+    g->node = calloc(maxNodes, sizeof(*g->node));
+    g->edge = calloc(maxEdges?maxEdges:1, sizeof(*g->edge));
+    g->stack = calloc(maxNodes, sizeof(*g->stack));
+    g->visited = calloc((maxNodes + 63)/64, sizeof(*g->visited));
+    // Keep each run on its own cache lines.
+    g->runSize = (sizeof(struct POThreadPoolGraph_run) +
+            maxNodes*sizeof(struct POThreadPoolGraph_nodeRun) + 63) &
+            ~((size_t) 63);
+    if(posix_memalign((void **) &g->runs, 64, g->runSize*maxRuns))
+        g->runs = NULL;
+
+    if(VASSERT(g->node && g->edge && g->stack && g->visited && g->runs,
+                "memory allocation failed") ||
+            mutexInit(&g->mutex))
+    {
+        free(g->node);
+        free(g->edge);
+        free(g->stack);
+        free(g->visited);
+        free(g->runs);
+        free(g);
+        return NULL;
+    }
+
+    memset(g->runs, 0, g->runSize*maxRuns);
+    for(i = maxRuns; i;)
+    {
+        struct POThreadPoolGraph_run *run;
+        --i;
+        run = (struct POThreadPoolGraph_run *) (g->runs + i*g->runSize);
+        run->graph = g;
+        run->next = g->unusedRun;
+        g->unusedRun = run;
+    }
+
+    return g;
+}
+
+
+void poThreadPoolGraph_destroy(struct POThreadPoolGraph *g)
+{
+    DASSERT(g);
+#ifdef DEBUG
+    {
+        // All the runs must be finished.
+        uint32_t n = 0;
+        struct POThreadPoolGraph_run *run;
+        for(run = g->unusedRun; run; run = run->next)
+            ++n;
+        DASSERT(n == g->maxRuns);
+    }
+#endif
+
+    mutexDestroy(&g->mutex);
+    free(g->node);
+    free(g->edge);
+    free(g->stack);
+    free(g->visited);
+    free(g->runs);
+#ifdef DEBUG
+    memset(g, 0, sizeof(*g));
+#endif
+    free(g);
+}
+
+
+int32_t poThreadPoolGraph_addNode(struct POThreadPoolGraph *g,
+        void *(*callback)(void *userData))
+{
+    DASSERT(g);
+    DASSERT(callback);
+
+    if(g->running || g->numNodes == g->maxNodes)
+    {
+        ERROR("can't add a node to graph(%p) with %"PRIu32" nodes%s",
+                g, g->numNodes, g->running?" that has been run":"");
+        return -1;
+    }
+
+    g->node[g->numNodes].callback = callback;
+    g->node[g->numNodes].numIn = 0;
+    g->node[g->numNodes].firstOut = -1;
+
+    return (int32_t) g->numNodes++;
+}
+
+
+// Returns true if node to can be reached from node from.  This is a
+// depth first search that looks at each node once, so it's O(nodes +
+// edges) even with many paths between two nodes, as in stacked diamonds.
+static
+bool reaches(struct POThreadPoolGraph *g, uint32_t from, uint32_t to)
+{
+    uint32_t n = 0;
+
+    if(from == to) return true;
+
+    memset(g->visited, 0, ((g->numNodes + 63)/64)*sizeof(*g->visited));
+
+    // A node is marked when it's pushed, so it's pushed at most once and
+    // the stack can't have more than numNodes nodes.
+    g->visited[from/64] |= ((uint64_t) 1) << (from%64);
+    g->stack[n++] = from;
+
+    while(n)
+    {
+        uint32_t node = g->stack[--n];
+        int32_t e;
+
+        for(e = g->node[node].firstOut; e != -1; e = g->edge[e].next)
+        {
+            uint32_t next = g->edge[e].to;
+            if(next == to)
+                return true;
+            if(g->visited[next/64] & (((uint64_t) 1) << (next%64)))
+                continue;
+            g->visited[next/64] |= ((uint64_t) 1) << (next%64);
+            DASSERT(n < g->numNodes);
+            g->stack[n++] = next;
+        }
+    }
+
+    return false;
+}
+
+
+int poThreadPoolGraph_addEdge(struct POThreadPoolGraph *g,
+        uint32_t from, uint32_t to)
+{
+    DASSERT(g);
+
+    if(g->running || g->numEdges == g->maxEdges ||
+            from >= g->numNodes || to >= g->numNodes)
+    {
+        ERROR("can't add edge %"PRIu32"->%"PRIu32" to graph(%p)",
+                from, to, g);
+        return 1; // fail
+    }
+
+    if(reaches(g, to, from))
+    {
+        ERROR("edge %"PRIu32"->%"PRIu32" would make a cycle in graph(%p)",
+                from, to, g);
+        return 1; // fail
+    }
+
+    // Add to the front of the from node's edge list.
+    g->edge[g->numEdges].to = to;
+    g->edge[g->numEdges].next = g->node[from].firstOut;
+    g->node[from].firstOut = (int32_t) g->numEdges;
+    ++g->numEdges;
+    ++g->node[to].numIn;
+
+    return 0; // success
+}
+
+
+static void *nodeTask(struct POThreadPoolGraph_nodeRun *nodeRun);
+
+
+// Run nodes, starting with nodeRun, in this thread until there are no
+// ready nodes left that are not queued in the pool.
+static
+void runNodes(struct POThreadPoolGraph_nodeRun *nodeRun)
+{
+    struct POThreadPoolGraph_run *run = nodeRun->run;
+    struct POThreadPoolGraph *g = run->graph;
+
+    while(nodeRun)
+    {
+        struct POThreadPoolGraph_nodeRun *next = NULL;
+        int32_t e;
+
+        g->node[nodeRun->node].callback(run->userData);
+
+        // Release the nodes that come after this node.  We keep the
+        // first one that is ready to run next here, and queue the rest.
+        for(e = g->node[nodeRun->node].firstOut; e != -1;
+                e = g->edge[e].next)
+        {
+            struct POThreadPoolGraph_nodeRun *nr;
+            nr = &run->nodeRun[g->edge[e].to];
+
+            if(__atomic_sub_fetch(&nr->numWaiting, 1, __ATOMIC_ACQ_REL))
+                continue; // It's waiting for other nodes.
+
+            if(!next)
+                next = nr;
+            else if(poThreadPool_runTask(run->pool, 0, 0,
+                        (void *(*)(void *)) nodeTask, nr))
+                // The pool is full, so we run it here and now.
+                runNodes(nr);
+        }
+
+        if(__atomic_sub_fetch(&run->numLeft, 1, __ATOMIC_ACQ_REL) == 0)
+        {
+            // That was the last node.  We free the run before calling
+            // the done callback, so the user may run the graph again, or
+            // destroy it, from the done callback on.  We can't touch
+            // the graph after the callback.
+            void (*doneCallback)(void *) = run->doneCallback;
+            void *userData = run->userData;
+            DASSERT(!next);
+
+            mutexLock(&g->mutex);
+            run->next = g->unusedRun;
+            g->unusedRun = run;
+            mutexUnlock(&g->mutex);
+
+            if(doneCallback)
+                doneCallback(userData);
+            return;
+        }
+
+        nodeRun = next;
+    }
+}
+
+
+// The pool task callback of a node.
+static
+void *nodeTask(struct POThreadPoolGraph_nodeRun *nodeRun)
+{
+    runNodes(nodeRun);
+    return NULL;
+}
+
+
+int poThreadPoolGraph_run(struct POThreadPoolGraph *g,
+        struct POThreadPool *p, uint32_t timeOut,
+        void *userData, void (*doneCallback)(void *userData))
+{
+    struct POThreadPoolGraph_run *run;
+    uint32_t i, numRoots = 0;
+
+    DASSERT(g);
+    DASSERT(p);
+
+    if(!g->numNodes)
+    {
+        if(doneCallback)
+            doneCallback(userData);
+        return 0;
+    }
+
+    mutexLock(&g->mutex);
+
+    // The template can't change after this.
+    g->running = true;
+
+    run = g->unusedRun;
+    if(run)
+        g->unusedRun = run->next;
+
+    mutexUnlock(&g->mutex);
+
+    if(!run)
+    {
+        NOTICE("graph(%p) has %"PRIu32" runs running", g, g->maxRuns);
+        return 1; // fail
+    }
+
+    run->pool = p;
+    run->userData = userData;
+    run->doneCallback = doneCallback;
+    run->next = NULL;
+    run->numLeft = g->numNodes;
+
+    // poThreadPool_runTask() gets the pool mutex lock, so the worker
+    // threads will see all these values.
+    for(i = 0; i < g->numNodes; ++i)
+    {
+        run->nodeRun[i].run = run;
+        run->nodeRun[i].node = i;
+        run->nodeRun[i].numWaiting = g->node[i].numIn;
+        if(!g->node[i].numIn)
+            ++numRoots;
+    }
+
+    // Submit the nodes that wait for no other nodes.  We can't look at
+    // run, or g, after the last one is submitted, the run may be finished
+    // and doneCallback may have destroyed the graph.
+    for(i = 0; numRoots; ++i)
+        if(!g->node[i].numIn)
+        {
+            struct POThreadPoolGraph_nodeRun *nodeRun = &run->nodeRun[i];
+            --numRoots;
+            if(poThreadPool_runTask(p, timeOut, 0,
+                        (void *(*)(void *)) nodeTask, nodeRun))
+                // The pool is full, so we run it here and now.
+                runNodes(nodeRun);
+        }
+
+    return 0; // success
+}
@@ -0,0 +1,116 @@
+/** \file threadPoolGraph.h
+ *
+ * Task graphs that run on the potato thread pool.
+ *
+ * A task graph is a template of tasks, that we call nodes, and edges
+ * between them that say which nodes must finish before a node may run.
+ * The user makes the template once and then runs it, on a struct
+ * POThreadPool, as many times as they like with different user data,
+ * like:
+ *
+ *             +--> auth ---+
+ *    parse ---|            |---> render ---> write
+ *             +--> cache --+
+ *
+ * When a node finishes, the nodes that come after it, that have no other
+ * nodes left to wait for, are released to the pool.  The counting of the
+ * finished nodes is done with atomic counters in the worker threads, so
+ * there are no extra threads or locks for this.  The memory for the runs
+ * of a graph is allocated when the graph is made, so running a graph
+ * does not allocate memory.
+ */
+
+
+/// \cond SKIP
+struct POThreadPool;
+struct POThreadPoolGraph;
+/// \endcond
+
+
+/** Make a task graph template
+ *
+ * \param maxNodes the maximum number of nodes that can be added to the
+ * graph.
+ * \param maxEdges the maximum number of edges that can be added to the
+ * graph.
+ * \param maxRuns the maximum number of runs of the graph that can be
+ * running at the same time.
+ *
+ * \return a pointer to an opaque struct POThreadPoolGraph, or NULL on
+ * failure.
+ */
+extern
+struct POThreadPoolGraph *poThreadPoolGraph_create(uint32_t maxNodes,
+        uint32_t maxEdges, uint32_t maxRuns);
+
+
+/** Free a task graph template
+ *
+ * There must be no runs of the graph running.
+ *
+ * \param g a graph from poThreadPoolGraph_create().
+ */
+extern
+void poThreadPoolGraph_destroy(struct POThreadPoolGraph *g);
+
+
+/** Add a node to a task graph
+ *
+ * Nodes and edges must be added before the graph is first run.
+ *
+ * \param g a graph from poThreadPoolGraph_create().
+ * \param callback the task callback of the node.  It is called with
+ * the user data that was passed to poThreadPoolGraph_run().  Its return
+ * value is not used.
+ *
+ * \return the index of the node, or -1 if the graph has \p maxNodes
+ * nodes already or the graph has been run.
+ */
+extern
+int32_t poThreadPoolGraph_addNode(struct POThreadPoolGraph *g,
+        void *(*callback)(void *userData));
+
+
+/** Add an edge to a task graph
+ *
+ * The node \p to will not run until the node \p from finishes.
+ *
+ * \param g a graph from poThreadPoolGraph_create().
+ * \param from the index of a node from poThreadPoolGraph_addNode().
+ * \param to the index of a node from poThreadPoolGraph_addNode().
+ *
+ * \return 0 on success, or non-zero if the graph has \p maxEdges edges
+ * already, the graph has been run, or the edge would make a cycle.
+ */
+extern
+int poThreadPoolGraph_addEdge(struct POThreadPoolGraph *g,
+        uint32_t from, uint32_t to);
+
+
+/** Run a task graph on a thread pool
+ *
+ * The nodes with no edges into them are submitted to the pool with
+ * poThreadPool_runTask() and the other nodes are submitted by the worker
+ * threads as they become ready.  A worker that finishes a node runs one
+ * of the nodes that it makes ready itself, without queueing it.  If a
+ * ready node can not be queued, in \p timeOut milliseconds from this
+ * call or at once from a worker thread, it's run in the thread that
+ * found it ready, so a graph run always finishes.
+ *
+ * \param g a graph from poThreadPoolGraph_create().
+ * \param p a pool from poThreadPool_create().
+ * \param timeOut the time to wait, in milliseconds, to queue each of the
+ * first nodes, as in poThreadPool_runTask().
+ * \param userData passed to all the node callbacks and \p doneCallback.
+ * \param doneCallback if not NULL, this is called, in the thread that
+ * ran the last node, after all the nodes have finished.  The run is
+ * free when it's called, so the graph may be run again, or destroyed,
+ * from then on.
+ *
+ * \return 0 on success, or non-zero if there are \p maxRuns runs of this
+ * graph running already.
+ */
+extern
+int poThreadPoolGraph_run(struct POThreadPoolGraph *g,
+        struct POThreadPool *p, uint32_t timeOut,
+        void *userData, void (*doneCallback)(void *userData));
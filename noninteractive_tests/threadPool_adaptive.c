@@ -0,0 +1,86 @@
+#include <unistd.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <time.h>
+#include <stdarg.h>
+#include <inttypes.h>
+
+#include "debug.h"
+#include "tIme.h"
+#include "define.h"
+#include "threadPool.h"
+
+/* This tests the adaptive concurrency controller from
+ * poThreadPool_setAdaptiveConcurrency().  The tasks block, so more
+ * threads finish more tasks, and the controller should raise the thread
+ * limit from the floor. */
+
+
+#define MAX_WORKERS  8
+#define NUM_TASKS    400
+#define PERIOD       50 // milliseconds
+
+
+static void *task(void *ptr)
+{
+    usleep(5000); // microseconds sec/1,000,000
+    return NULL;
+}
+
+
+int main(int argc, char **argv)
+{
+    struct POThreadPool_stats stats;
+    struct POThreadPool *p;
+    uint32_t i, maxLimit = 0;
+
+    poDebugInit();
+
+    p = poThreadPool_create(MAX_WORKERS /*maxNumThreads*/,
+            NUM_TASKS /*maxQueueLength*/,
+            1000 /*maxIdleTime milli-seconds 1s/1000*/);
+
+    // The floor must be from 1 to MAX_WORKERS.
+    ASSERT(poThreadPool_setAdaptiveConcurrency(p, 0, PERIOD) != 0);
+    ASSERT(poThreadPool_setAdaptiveConcurrency(p, MAX_WORKERS + 1,
+                PERIOD) != 0);
+
+    // Start the controller from one thread.
+    ASSERT(poThreadPool_resize(p, 1, NUM_TASKS) == 0);
+    ASSERT(poThreadPool_setAdaptiveConcurrency(p, 1, PERIOD) == 0);
+    poThreadPool_getStats(p, &stats);
+    ASSERT(stats.threadLimit == 1);
+
+    for(i = 0; i < NUM_TASKS; ++i)
+        ASSERT(poThreadPool_runTask(p, 0, 0, task, 0) == 0);
+
+    while(poThreadPool_getStats(p, &stats), stats.tasksRun < NUM_TASKS)
+    {
+        if(stats.threadLimit > maxLimit)
+            maxLimit = stats.threadLimit;
+        usleep(10000); // microseconds sec/1,000,000
+    }
+
+    printf("the thread limit went up to %"PRIu32"\n", maxLimit);
+    VASSERT(maxLimit > 2, "the thread limit only went up to %"PRIu32,
+            maxLimit);
+
+    // Turning it off leaves the limit where it is.
+    poThreadPool_getStats(p, &stats);
+    i = stats.threadLimit;
+    ASSERT(poThreadPool_setAdaptiveConcurrency(p, 0, 0) == 0);
+    poThreadPool_getStats(p, &stats);
+    ASSERT(stats.threadLimit == i);
+
+    // This will block until all threads finish.
+    ASSERT(poThreadPool_tryDestroy(p, PO_LONGTIME) == 0);
+
+    printf("%s SUCCESS\n", argv[0]);
+
+    return 0;
+}
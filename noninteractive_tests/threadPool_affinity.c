@@ -0,0 +1,75 @@
+#define _GNU_SOURCE
+#include <unistd.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <sched.h>
+#include <time.h>
+#include <stdarg.h>
+#include <inttypes.h>
+
+#include "debug.h"
+#include "tIme.h"
+#include "define.h"
+#include "threadPool.h"
+
+/* This tests pinning the worker threads to CPUs.  We pin all the workers
+ * to the first CPU of NUMA node 0, or to the first CPU that we may run
+ * on if there is no NUMA node information. */
+
+
+#define N  20
+
+static uint32_t cpu;
+static uint32_t wrongCpuCount;
+
+
+static void *task(void *ptr)
+{
+    if(sched_getcpu() != cpu)
+        __sync_fetch_and_add(&wrongCpuCount, 1);
+    return NULL;
+}
+
+
+int main(int argc, char **argv)
+{
+    struct POThreadPool *p;
+    cpu_set_t allowed;
+    uint32_t i, cpus[64];
+
+    poDebugInit();
+
+    ASSERT(sched_getaffinity(0, sizeof(allowed), &allowed) == 0);
+
+    if(poThreadPool_getNodeCpus(0, cpus, 64) &&
+            CPU_ISSET(cpus[0], &allowed))
+        cpu = cpus[0];
+    else
+        for(cpu = 0; !CPU_ISSET(cpu, &allowed); ++cpu);
+
+    p = poThreadPool_create(4 /*maxNumThreads*/,
+            N /*maxQueueLength*/,
+            1000 /*maxIdleTime milli-seconds 1s/1000*/);
+
+    ASSERT(poThreadPool_setAffinity(p, &cpu, 1) == 0);
+    // Only once.
+    ASSERT(poThreadPool_setAffinity(p, &cpu, 1) != 0);
+
+    for(i=0; i<N; ++i)
+        ASSERT(poThreadPool_runTask(p, PO_LONGTIME, 0, task, 0) == 0);
+
+    // This will block until all threads finish.
+    ASSERT(poThreadPool_tryDestroy(p, PO_LONGTIME) == 0);
+
+    VASSERT(!wrongCpuCount, "%"PRIu32" tasks ran on the wrong CPU",
+            wrongCpuCount);
+
+    printf("%s SUCCESS\n", argv[0]);
+
+    return 0;
+}
@@ -0,0 +1,149 @@
+#include <unistd.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <time.h>
+#include <stdarg.h>
+#include <inttypes.h>
+
+#include "debug.h"
+#include "tIme.h"
+#include "define.h"
+#include "threadPool.h"
+
+/* This tests poThreadPool_blockingBegin() and poThreadPool_blockingEnd().
+ * While tasks are in a blocking region the pool runs more threads than
+ * its thread limit, so the CPU tasks queued behind the blocking tasks
+ * run, and the extra threads exit after the blocking regions end.  The
+ * thread limit is set below maxNumThreads, to leave room for the extra
+ * threads, and a blocking region fails if there is no room left. */
+
+
+#define MAX_WORKERS   4
+#define THREAD_LIMIT  2
+#define QUEUE_MAX     8
+
+
+static struct POThreadPool *pool;
+
+static uint32_t gate;
+
+static uint32_t numBlockingRun, numCpuRun, numNoRoomRun;
+
+
+static void *blockingTask(void *ptr)
+{
+    ASSERT(poThreadPool_blockingBegin(pool) == 0);
+    // Nested regions count once.
+    ASSERT(poThreadPool_blockingBegin(pool) == 0);
+    ASSERT(poThreadPool_blockingEnd(pool) == 0);
+
+    // Like waiting for disk or network I/O.
+    while(!__atomic_load_n(&gate, __ATOMIC_ACQUIRE))
+        usleep(1000); // microseconds sec/1,000,000
+
+    // The last one leaves it to the pool to end the region.
+    if(!ptr)
+        ASSERT(poThreadPool_blockingEnd(pool) == 0);
+
+    __sync_fetch_and_add(&numBlockingRun, 1);
+    return NULL;
+}
+
+
+static void *noRoomTask(void *p)
+{
+    // The pool can't have another thread, so it's not a blocking region.
+    ASSERT(poThreadPool_blockingBegin(p) != 0);
+    ASSERT(poThreadPool_blockingEnd(p) != 0);
+    __sync_fetch_and_add(&numNoRoomRun, 1);
+    return NULL;
+}
+
+
+static void *cpuTask(void *ptr)
+{
+    usleep(1000); // microseconds sec/1,000,000
+    __sync_fetch_and_add(&numCpuRun, 1);
+    return NULL;
+}
+
+
+int main(int argc, char **argv)
+{
+    struct POThreadPool_stats stats;
+    uintptr_t i;
+
+    poDebugInit();
+
+    pool = poThreadPool_create(MAX_WORKERS /*maxNumThreads*/,
+            QUEUE_MAX /*maxQueueLength*/,
+            10000 /*maxIdleTime milli-seconds 1s/1000*/);
+    ASSERT(pool);
+
+    ASSERT(poThreadPool_resize(pool, THREAD_LIMIT, QUEUE_MAX) == 0);
+
+    // Not from a task callback.
+    ASSERT(poThreadPool_blockingBegin(pool) != 0);
+    ASSERT(poThreadPool_blockingEnd(pool) != 0);
+
+    // The blocking tasks hold all THREAD_LIMIT threads.
+    for(i = 0; i < THREAD_LIMIT; ++i)
+        ASSERT(poThreadPool_runTask(pool, PO_LONGTIME, 0,
+                    blockingTask,
+                    (void *) (uintptr_t) (i == THREAD_LIMIT - 1)) == 0);
+
+    // Without the blocking regions these would wait for the gate.
+    for(i = 0; i < QUEUE_MAX; ++i)
+        ASSERT(poThreadPool_runTask(pool, PO_LONGTIME, 0,
+                    cpuTask, 0) == 0);
+
+    while(__atomic_load_n(&numCpuRun, __ATOMIC_ACQUIRE) < QUEUE_MAX)
+        usleep(1000); // microseconds sec/1,000,000
+
+    poThreadPool_getStats(pool, &stats);
+    VASSERT(stats.numBlocking == THREAD_LIMIT, "numBlocking=%"PRIu32,
+            stats.numBlocking);
+    ASSERT(stats.threadLimit == THREAD_LIMIT);
+    // Never more than maxNumThreads.
+    ASSERT(stats.numThreads > THREAD_LIMIT &&
+            stats.numThreads <= MAX_WORKERS);
+    ASSERT(numBlockingRun == 0);
+
+    // The blocking regions use all the room above the thread limit.
+    ASSERT(poThreadPool_runTask(pool, PO_LONGTIME, 0, noRoomTask,
+                pool) == 0);
+    while(__atomic_load_n(&numNoRoomRun, __ATOMIC_ACQUIRE) < 1)
+        usleep(1000); // microseconds sec/1,000,000
+
+    __atomic_store_n(&gate, 1, __ATOMIC_RELEASE);
+
+    // After the blocking regions end the extra threads exit, idle or
+    // not, well before the idle time-out.
+    while(poThreadPool_getStats(pool, &stats),
+            stats.numBlocking || stats.numThreads > THREAD_LIMIT)
+        usleep(1000); // microseconds sec/1,000,000
+
+    ASSERT(numBlockingRun == THREAD_LIMIT);
+
+    ASSERT(poThreadPool_tryDestroy(pool, PO_LONGTIME) == 0);
+
+    // A new pool has its thread limit at maxNumThreads, so there is no
+    // room for blocking regions.
+    pool = poThreadPool_create(MAX_WORKERS /*maxNumThreads*/,
+            QUEUE_MAX /*maxQueueLength*/,
+            10000 /*maxIdleTime milli-seconds 1s/1000*/);
+    ASSERT(pool);
+    ASSERT(poThreadPool_runTask(pool, PO_LONGTIME, 0, noRoomTask,
+                pool) == 0);
+    ASSERT(poThreadPool_tryDestroy(pool, PO_LONGTIME) == 0);
+    ASSERT(numNoRoomRun == 2);
+
+    printf("%s SUCCESS\n", argv[0]);
+
+    return 0;
+}
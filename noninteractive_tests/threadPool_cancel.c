@@ -0,0 +1,228 @@
+#include <unistd.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <time.h>
+#include <stdarg.h>
+#include <inttypes.h>
+
+#include "debug.h"
+#include "tIme.h"
+#include "define.h"
+#include "threadPool.h"
+
+/* This tests cancelling queued tasks with poThreadPool_cancelTask() and
+ * poThreadPool_cancelTract(), from the General queue, from a tract
+ * queue, and from the deadline mode heap.  The one worker thread is kept busy on a gate task so that the
+ * other tasks stay queued. */
+
+
+#define QUEUE_MAX  10
+
+
+static uint32_t gate;
+
+// Bits set by the tasks that ran and the tasks that where cancelled.
+static uint32_t ran, cancelled;
+
+// The order that the cancelled tasks where cancelled in.
+static char cancelOrder[QUEUE_MAX + 1];
+
+
+static void *gateTask(void *ptr)
+{
+    while(!__atomic_load_n(&gate, __ATOMIC_ACQUIRE))
+        usleep(1000); // microseconds sec/1,000,000
+    return NULL;
+}
+
+
+// The order that the tasks ran in.
+static char runOrder[64];
+
+
+static void *task(void *ptr)
+{
+    __sync_fetch_and_or(&ran, 1 << (uintptr_t) ptr);
+    runOrder[strlen(runOrder)] = 'a' + (uintptr_t) ptr;
+    return NULL;
+}
+
+
+static void cancelTask(void *ptr)
+{
+    ASSERT(!(cancelled & (1 << (uintptr_t) ptr)));
+    cancelled |= 1 << (uintptr_t) ptr;
+    cancelOrder[strlen(cancelOrder)] = 'a' + (uintptr_t) ptr;
+}
+
+
+static void run(struct POThreadPool *p, struct POThreadPool_tract *tract,
+        uintptr_t i, struct POThreadPool_taskHandle *handle)
+{
+    ASSERT(poThreadPool_runTaskCancelable(p, 0, tract, task, (void *) i,
+                cancelTask, handle) == 0);
+    // With the worker busy, all these tasks get queued.
+    ASSERT(handle->task);
+}
+
+
+static void wait(struct POThreadPool *p, uint32_t tasksRun)
+{
+    struct POThreadPool_stats stats;
+    while(poThreadPool_getStats(p, &stats), stats.tasksRun < tasksRun)
+        usleep(1000); // microseconds sec/1,000,000
+}
+
+
+int main(int argc, char **argv)
+{
+    struct POThreadPool_taskHandle handle[QUEUE_MAX], h;
+    struct POThreadPool_tract tractA, tractB;
+    struct POThreadPool_stats stats;
+    struct POThreadPool *p;
+    uint32_t i;
+
+    poDebugInit();
+
+    memset(&tractA, 0, sizeof(tractA));
+    memset(&tractB, 0, sizeof(tractB));
+
+    p = poThreadPool_create(1 /*maxNumThreads*/,
+            QUEUE_MAX /*maxQueueLength*/,
+            1000 /*maxIdleTime milli-seconds 1s/1000*/);
+
+    ////////////////////////////////////////////////////////////////
+    // The General queue.
+    ////////////////////////////////////////////////////////////////
+
+    // The gate task goes straight to a new worker, so it's not queued
+    // and can't be cancelled.
+    ASSERT(poThreadPool_runTaskCancelable(p, 0, 0, gateTask, 0,
+                cancelTask, &h) == 0);
+    ASSERT(!h.task);
+    ASSERT(poThreadPool_cancelTask(p, &h) != 0);
+
+    // Tasks 0, 1 and 2 with no tract, and 3, 4, 5, 6 in tract A, mixed.
+    run(p, 0, 0, &handle[0]);
+    run(p, &tractA, 3, &handle[3]);
+    run(p, 0, 1, &handle[1]);
+    run(p, &tractA, 4, &handle[4]);
+    run(p, &tractA, 5, &handle[5]);
+    run(p, 0, 2, &handle[2]);
+    run(p, &tractA, 6, &handle[6]);
+
+    poThreadPool_getStats(p, &stats);
+    ASSERT(stats.queueLength == 7);
+
+    // Cancel one from the middle of the queue.
+    ASSERT(poThreadPool_cancelTask(p, &handle[1]) == 0);
+    ASSERT(cancelled == 1 << 1);
+    // It can't be cancelled twice.
+    ASSERT(poThreadPool_cancelTask(p, &handle[1]) != 0);
+
+    // Cancel one in tract A, and then the rest of the tract.
+    ASSERT(poThreadPool_cancelTask(p, &handle[4]) == 0);
+    ASSERT(poThreadPool_cancelTract(p, &tractA) == 3);
+    ASSERT(poThreadPool_cancelTract(p, &tractA) == 0);
+    ASSERT(tractA.taskCount == 0 && !tractA.queued);
+    VASSERT(strcmp(cancelOrder, "bedfg") == 0, "cancelOrder=\"%s\"",
+            cancelOrder);
+
+    poThreadPool_getStats(p, &stats);
+    ASSERT(stats.queueLength == 2);
+
+    // The cancelled tasks are back in the pool, so the queue has room
+    // for 8 more.
+    for(i = 0; poThreadPool_runTask(p, 0, 0, task, (void *) 7) == 0; ++i);
+    ASSERT(i == QUEUE_MAX - 2);
+
+    __atomic_store_n(&gate, 1, __ATOMIC_RELEASE);
+    wait(p, 1 + 2 + QUEUE_MAX - 2);
+
+    VASSERT(ran == ((1 << 0) | (1 << 2) | (1 << 7)), "ran=0x%"PRIx32, ran);
+    ASSERT(cancelled == ((1 << 1) | (1 << 3) | (1 << 4) | (1 << 5) |
+                (1 << 6)));
+
+    // The handle of a task that ran is stale.
+    ASSERT(poThreadPool_cancelTask(p, &handle[0]) != 0);
+
+    ////////////////////////////////////////////////////////////////
+    // A tract queue.
+    ////////////////////////////////////////////////////////////////
+
+    ran = 0;
+    cancelled = 0;
+    memset(cancelOrder, 0, sizeof(cancelOrder));
+    gate = 0;
+
+    // The gate task works on tract B, and with nothing in the General
+    // queue the tasks in tract B are queued in the tract queue.
+    ASSERT(poThreadPool_runTask(p, 0, &tractB, gateTask, 0) == 0);
+    while(poThreadPool_getStats(p, &stats), stats.numWorkingThreads != 1)
+        usleep(1000); // microseconds sec/1,000,000
+    for(i = 0; i < 4; ++i)
+        run(p, &tractB, i, &handle[i]);
+    poThreadPool_getStats(p, &stats);
+    ASSERT(stats.queueLength == 0);
+    ASSERT(tractB.taskCount == 4);
+
+    // From the middle and the end of the tract queue.
+    ASSERT(poThreadPool_cancelTask(p, &handle[1]) == 0);
+    ASSERT(poThreadPool_cancelTask(p, &handle[3]) == 0);
+    ASSERT(tractB.taskCount == 2);
+    // Task 2 is at the end of the tract queue now.
+    run(p, &tractB, 4, &handle[4]);
+    ASSERT(poThreadPool_cancelTask(p, &handle[0]) == 0);
+
+    __atomic_store_n(&gate, 1, __ATOMIC_RELEASE);
+    wait(p, 1 + 2 + QUEUE_MAX - 2 + 1 + 2);
+
+    VASSERT(ran == ((1 << 2) | (1 << 4)), "ran=0x%"PRIx32, ran);
+    VASSERT(strcmp(cancelOrder, "bda") == 0, "cancelOrder=\"%s\"",
+            cancelOrder);
+
+    // This will block until all threads finish.
+    ASSERT(poThreadPool_tryDestroy(p, PO_LONGTIME) == 0);
+
+    ////////////////////////////////////////////////////////////////
+    // The deadline mode heap.
+    ////////////////////////////////////////////////////////////////
+
+    cancelled = 0;
+    memset(runOrder, 0, sizeof(runOrder));
+    memset(cancelOrder, 0, sizeof(cancelOrder));
+    gate = 0;
+
+    p = poThreadPool_create(1 /*maxNumThreads*/,
+            QUEUE_MAX /*maxQueueLength*/,
+            1000 /*maxIdleTime milli-seconds 1s/1000*/);
+    ASSERT(poThreadPool_setDeadlineMode(p, 0) == 0);
+
+    ASSERT(poThreadPool_runTask(p, 0, 0, gateTask, 0) == 0);
+    for(i = 0; i < 8; ++i)
+        run(p, 0, i, &handle[i]);
+
+    ASSERT(poThreadPool_cancelTask(p, &handle[0]) == 0);
+    ASSERT(poThreadPool_cancelTask(p, &handle[7]) == 0);
+    ASSERT(poThreadPool_cancelTask(p, &handle[3]) == 0);
+    ASSERT(poThreadPool_cancelTask(p, &handle[4]) == 0);
+
+    __atomic_store_n(&gate, 1, __ATOMIC_RELEASE);
+
+    // This will block until all threads finish.
+    ASSERT(poThreadPool_tryDestroy(p, PO_LONGTIME) == 0);
+
+    // The rest ran in order.
+    VASSERT(strcmp(runOrder, "bcfg") == 0, "runOrder=\"%s\"", runOrder);
+    VASSERT(strcmp(cancelOrder, "ahde") == 0, "cancelOrder=\"%s\"",
+            cancelOrder);
+
+    printf("%s SUCCESS\n", argv[0]);
+
+    return 0;
+}
@@ -0,0 +1,266 @@
+#include <unistd.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <fcntl.h>
+#include <time.h>
+#include <stdarg.h>
+#include <inttypes.h>
+#include <sys/epoll.h>
+
+#include "debug.h"
+#include "tIme.h"
+#include "define.h"
+#include "threadPool.h"
+#include "threadPoolCoroutine.h"
+
+/* This tests coroutines on a thread pool.  Many sleeping coroutines
+ * share a few worker threads, a coroutine waits for a pipe, and is
+ * suspended and resumed, the parts of coroutines in one tract do not
+ * run at the same time, and coroutines that wake, or are resumed, when
+ * the pool queue is full still continue. */
+
+
+#define MAX_WORKERS     2
+#define QUEUE_MAX       64
+#define NUM_SLEEPERS    50
+#define NUM_SLEEPS      3
+#define SLEEP_TIME      20 // milli-seconds
+#define NUM_TRACT       4
+#define SMALL_QUEUE     1
+
+
+static struct POThreadPoolCoroutine *coroutines;
+
+static uint32_t numFinished;
+
+static uint32_t numSleeps;
+
+static int pipeFd[2];
+
+static struct POThreadPoolCoroutine_handle handle;
+static uint32_t suspended;
+
+static struct POThreadPool_tract tract;
+// Accessed only by coroutines in tract.
+static uint32_t tractBusy, tractFailures;
+
+
+static void finish(void)
+{
+    __sync_fetch_and_add(&numFinished, 1);
+}
+
+
+static void waitFinished(uint32_t n)
+{
+    while(__atomic_load_n(&numFinished, __ATOMIC_ACQUIRE) < n)
+        usleep(1000); // microseconds sec/1,000,000
+}
+
+
+static void sleeper(void *ptr)
+{
+    uint32_t i;
+    for(i = 0; i < NUM_SLEEPS; ++i)
+    {
+        poThreadPoolCoroutine_sleep(SLEEP_TIME);
+        __sync_fetch_and_add(&numSleeps, 1);
+    }
+    finish();
+}
+
+
+static void reader(void *ptr)
+{
+    char c = 0;
+
+    // Nothing to read yet.
+    ASSERT(poThreadPoolCoroutine_waitFd(pipeFd[0], EPOLLIN, 10) == 0);
+    ASSERT(read(pipeFd[0], &c, 1) == -1 && errno == EAGAIN);
+
+    // main() writes after it sees this.
+    __atomic_store_n(&suspended, 1, __ATOMIC_RELEASE);
+
+    ASSERT(poThreadPoolCoroutine_waitFd(pipeFd[0], EPOLLIN, PO_LONGTIME) &
+            EPOLLIN);
+    ASSERT(read(pipeFd[0], &c, 1) == 1 && c == 'x');
+
+    finish();
+}
+
+
+static void resumed(void *ptr)
+{
+    // A resume before the suspend is not lost.
+    struct POThreadPoolCoroutine_handle self;
+    poThreadPoolCoroutine_self(&self);
+    ASSERT(poThreadPoolCoroutine_resume(coroutines, &self) == 0);
+    poThreadPoolCoroutine_suspend();
+
+    // This one is resumed by main().
+    poThreadPoolCoroutine_self(&handle);
+    __atomic_store_n(&suspended, 1, __ATOMIC_RELEASE);
+    poThreadPoolCoroutine_suspend();
+
+    finish();
+}
+
+
+static void waiter(void *ptr)
+{
+    poThreadPoolCoroutine_self(&handle);
+    __atomic_store_n(&suspended, 1, __ATOMIC_RELEASE);
+    poThreadPoolCoroutine_suspend();
+    finish();
+}
+
+
+static void *nop(void *ptr)
+{
+    return NULL;
+}
+
+
+static void resumer(void *p)
+{
+    // Fill the pool queue, so there is no room for the resumed coroutine.
+    ASSERT(poThreadPool_runTask(p, 0, 0, nop, 0) == 0);
+    // This must not wait for room in the queue, since this is the only
+    // worker thread.
+    ASSERT(poThreadPoolCoroutine_resume(coroutines, &handle) == 0);
+    finish();
+}
+
+
+static void tractCoroutine(void *ptr)
+{
+    uint32_t i;
+    for(i = 0; i < NUM_SLEEPS; ++i)
+    {
+        if(tractBusy) ++tractFailures;
+        tractBusy = 1;
+        usleep(1000); // microseconds sec/1,000,000
+        tractBusy = 0;
+        poThreadPoolCoroutine_sleep(1);
+    }
+    finish();
+}
+
+
+int main(int argc, char **argv)
+{
+    struct POThreadPoolCoroutine_handle h;
+    struct POThreadPool *p;
+    uint32_t i, n = 0;
+    double t;
+
+    poDebugInit();
+
+    p = poThreadPool_create(MAX_WORKERS /*maxNumThreads*/,
+            QUEUE_MAX /*maxQueueLength*/,
+            1000 /*maxIdleTime milli-seconds 1s/1000*/);
+    ASSERT(p);
+
+    coroutines = poThreadPoolCoroutine_create(p, NUM_SLEEPERS,
+            0 /*default stack size*/);
+    ASSERT(coroutines);
+
+    // Many more sleeping coroutines than worker threads all sleep at the
+    // same time.
+    t = poTime_getDouble();
+    for(i = 0; i < NUM_SLEEPERS; ++i)
+        ASSERT(poThreadPoolCoroutine_run(coroutines, PO_LONGTIME, 0,
+                    sleeper, 0, 0) == 0);
+    n += NUM_SLEEPERS;
+    // There are no more coroutines.
+    ASSERT(poThreadPoolCoroutine_run(coroutines, PO_LONGTIME, 0,
+                sleeper, 0, 0) != 0);
+    waitFinished(n);
+    t = poTime_getDouble() - t;
+    ASSERT(numSleeps == NUM_SLEEPERS*NUM_SLEEPS);
+    VASSERT(t < NUM_SLEEPERS*SLEEP_TIME*0.001,
+            "sleeping coroutines took %g seconds", t);
+
+    // Waiting for a file descriptor.
+    ASSERT(pipe(pipeFd) == 0);
+    ASSERT(fcntl(pipeFd[0], F_SETFL, O_NONBLOCK) == 0);
+    ASSERT(poThreadPoolCoroutine_run(coroutines, PO_LONGTIME, 0,
+                reader, 0, 0) == 0);
+    ++n;
+    while(!__atomic_load_n(&suspended, __ATOMIC_ACQUIRE))
+        usleep(1000); // microseconds sec/1,000,000
+    usleep(10000); // microseconds sec/1,000,000
+    ASSERT(write(pipeFd[1], "x", 1) == 1);
+    waitFinished(n);
+    close(pipeFd[0]);
+    close(pipeFd[1]);
+
+    // Suspend and resume.
+    suspended = 0;
+    ASSERT(poThreadPoolCoroutine_run(coroutines, PO_LONGTIME, 0,
+                resumed, 0, &h) == 0);
+    ++n;
+    while(!__atomic_load_n(&suspended, __ATOMIC_ACQUIRE))
+        usleep(1000); // microseconds sec/1,000,000
+    usleep(10000); // microseconds sec/1,000,000
+    ASSERT(numFinished == n - 1);
+    ASSERT(poThreadPoolCoroutine_resume(coroutines, &handle) == 0);
+    waitFinished(n);
+    // The handle is stale after the coroutine finishes.
+    ASSERT(poThreadPoolCoroutine_resume(coroutines, &h) != 0);
+
+    // Coroutines in a tract.
+    memset(&tract, 0, sizeof(tract));
+    for(i = 0; i < NUM_TRACT; ++i)
+        ASSERT(poThreadPoolCoroutine_run(coroutines, PO_LONGTIME, &tract,
+                    tractCoroutine, 0, 0) == 0);
+    n += NUM_TRACT;
+    waitFinished(n);
+    VASSERT(!tractFailures, "%"PRIu32" tract failures", tractFailures);
+
+    poThreadPoolCoroutine_destroy(coroutines);
+
+    // This will block until all threads finish.
+    ASSERT(poThreadPool_tryDestroy(p, PO_LONGTIME) == 0);
+
+    // Many more coroutines wake at the same time than fit in the pool
+    // queue.  The poller thread keeps the rest until there is room.
+    p = poThreadPool_create(1 /*maxNumThreads*/,
+            SMALL_QUEUE /*maxQueueLength*/,
+            1000 /*maxIdleTime milli-seconds 1s/1000*/);
+    ASSERT(p);
+    coroutines = poThreadPoolCoroutine_create(p, NUM_SLEEPERS,
+            0 /*default stack size*/);
+    ASSERT(coroutines);
+    numSleeps = 0;
+    for(i = 0; i < NUM_SLEEPERS; ++i)
+        ASSERT(poThreadPoolCoroutine_run(coroutines, PO_LONGTIME, 0,
+                    sleeper, 0, 0) == 0);
+    n += NUM_SLEEPERS;
+    waitFinished(n);
+    ASSERT(numSleeps == NUM_SLEEPERS*NUM_SLEEPS);
+
+    // A coroutine resumes another when the pool queue is full.
+    suspended = 0;
+    ASSERT(poThreadPoolCoroutine_run(coroutines, PO_LONGTIME, 0,
+                waiter, 0, 0) == 0);
+    while(!__atomic_load_n(&suspended, __ATOMIC_ACQUIRE))
+        usleep(1000); // microseconds sec/1,000,000
+    usleep(10000); // microseconds sec/1,000,000
+    ASSERT(poThreadPoolCoroutine_run(coroutines, PO_LONGTIME, 0,
+                resumer, p, 0) == 0);
+    n += 2;
+    waitFinished(n);
+
+    poThreadPoolCoroutine_destroy(coroutines);
+    ASSERT(poThreadPool_tryDestroy(p, PO_LONGTIME) == 0);
+
+    printf("%s SUCCESS\n", argv[0]);
+
+    return 0;
+}
@@ -0,0 +1,146 @@
+#include <unistd.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <time.h>
+#include <stdarg.h>
+#include <inttypes.h>
+
+#include "debug.h"
+#include "tIme.h"
+#include "define.h"
+#include "threadPool.h"
+
+/* This tests deadline mode, with one worker thread so the order that
+ * the queued tasks run in is known. */
+
+
+static uint32_t blocking;
+
+// Accessed only by the one worker thread.
+static uintptr_t order[20];
+static uint32_t count;
+
+static struct POThreadPool_tract tract;
+
+
+static void *block(void *ptr)
+{
+    while(__sync_fetch_and_add(&blocking, 0))
+        usleep(1000); // microseconds sec/1,000,000
+    return NULL;
+}
+
+
+static void *task(void *ptr)
+{
+    order[count++] = (uintptr_t) ptr;
+    return NULL;
+}
+
+
+static void *expired(void *ptr)
+{
+    order[count++] = 100 + (uintptr_t) ptr;
+    return NULL;
+}
+
+
+static struct POThreadPool *start(void *(*expiredCallback)(void *),
+        uint32_t maxQueueLength)
+{
+    struct POThreadPool *p;
+
+    count = 0;
+    blocking = 1;
+
+    p = poThreadPool_create(1 /*maxNumThreads*/,
+            maxQueueLength,
+            1000 /*maxIdleTime milli-seconds 1s/1000*/);
+
+    ASSERT(poThreadPool_setDeadlineMode(p, expiredCallback) == 0);
+
+    // Keep the one worker busy while we queue the tasks.
+    ASSERT(poThreadPool_runTask(p, 0, 0, block, 0) == 0);
+
+    return p;
+}
+
+
+static void finish(struct POThreadPool *p)
+{
+    __sync_fetch_and_sub(&blocking, 1);
+
+    // This will block until all threads finish.
+    ASSERT(poThreadPool_tryDestroy(p, PO_LONGTIME) == 0);
+}
+
+
+int main(int argc, char **argv)
+{
+    struct POThreadPool *p;
+    double t;
+
+    poDebugInit();
+
+    /////////// Earliest deadline first with an expired callback.
+
+    p = start(expired, 20);
+    t = poTime_getDouble();
+
+    ASSERT(poThreadPool_runTaskDeadline(p, 0, t + 10, 0, task,
+                (void *) 1) == 0);
+    ASSERT(poThreadPool_runTaskDeadline(p, 0, t + 5, 0, task,
+                (void *) 2) == 0);
+    ASSERT(poThreadPool_runTask(p, 0, 0, task, (void *) 3) == 0);
+    ASSERT(poThreadPool_runTaskDeadline(p, 0, t + 1, 0, task,
+                (void *) 4) == 0);
+    ASSERT(poThreadPool_runTaskDeadline(p, 0, t - 1, 0, task,
+                (void *) 5) == 0);
+    // The second task in the tract gets the deadline of the first, so
+    // it still runs after it.
+    ASSERT(poThreadPool_runTaskDeadline(p, 0, t + 8, &tract, task,
+                (void *) 6) == 0);
+    ASSERT(poThreadPool_runTaskDeadline(p, 0, t + 2, &tract, task,
+                (void *) 7) == 0);
+
+    finish(p);
+
+    VASSERT(count == 7, "ran %"PRIu32" tasks", count);
+    ASSERT(order[0] == 105); // expired
+    ASSERT(order[1] == 4);
+    ASSERT(order[2] == 2);
+    ASSERT(order[3] == 6);
+    ASSERT(order[4] == 7);
+    ASSERT(order[5] == 1);
+    ASSERT(order[6] == 3); // no deadline
+
+    /////////// Dropping expired tasks to make room in a full queue.
+
+    p = start(0, 3);
+    t = poTime_getDouble();
+
+    ASSERT(poThreadPool_runTaskDeadline(p, 0, t - 1, 0, task,
+                (void *) 1) == 0);
+    ASSERT(poThreadPool_runTaskDeadline(p, 0, t - 1, 0, task,
+                (void *) 2) == 0);
+    ASSERT(poThreadPool_runTaskDeadline(p, 0, t + 10, 0, task,
+                (void *) 3) == 0);
+    // The queue is full, but the expired tasks get dropped.
+    ASSERT(poThreadPool_runTaskDeadline(p, 0, t + 10, 0, task,
+                (void *) 4) == 0);
+
+    finish(p);
+
+    VASSERT(count == 2, "ran %"PRIu32" tasks", count);
+    ASSERT(order[0] == 3);
+    ASSERT(order[1] == 4);
+
+    printf("%s SUCCESS\n", argv[0]);
+
+    return 0;
+}
@@ -0,0 +1,136 @@
+#include <unistd.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <time.h>
+#include <stdarg.h>
+#include <inttypes.h>
+
+#include "debug.h"
+#include "tIme.h"
+#include "define.h"
+#include "threadPool.h"
+
+/* This tests deadline mode, without an expired callback, with tracts
+ * from the pool tract slab.  A released slab tract whose last task
+ * expires and is dropped, by a worker or to make room in a full queue,
+ * is recycled and its drained callback is called. */
+
+
+#define NUM_TRACTS  2
+#define QUEUE_MAX   NUM_TRACTS
+
+
+static uint32_t blocking;
+
+static uint32_t numRun, numDrained;
+
+
+static void *block(void *ptr)
+{
+    while(__sync_fetch_and_add(&blocking, 0))
+        usleep(1000); // microseconds sec/1,000,000
+    return NULL;
+}
+
+
+static void *task(void *ptr)
+{
+    __sync_fetch_and_add(&numRun, 1);
+    return NULL;
+}
+
+
+static void *drained(void *ptr)
+{
+    __sync_fetch_and_add(&numDrained, 1);
+    return NULL;
+}
+
+
+static struct POThreadPool *start(void)
+{
+    struct POThreadPool *p;
+
+    blocking = 1;
+    numRun = 0;
+    numDrained = 0;
+
+    p = poThreadPool_create(1 /*maxNumThreads*/,
+            QUEUE_MAX /*maxQueueLength*/,
+            1000 /*maxIdleTime milli-seconds 1s/1000*/);
+
+    ASSERT(poThreadPool_setDeadlineMode(p, 0) == 0);
+    ASSERT(poThreadPool_setTractSlab(p, NUM_TRACTS) == 0);
+
+    // Keep the one worker busy while we queue the tasks.
+    ASSERT(poThreadPool_runTask(p, 0, 0, block, 0) == 0);
+
+    return p;
+}
+
+
+// Queue a task that expires soon in each of the slab tracts, and release
+// the tracts.
+static void queueExpiring(struct POThreadPool *p)
+{
+    uint32_t i;
+
+    for(i = 0; i < NUM_TRACTS; ++i)
+    {
+        uint64_t h;
+        h = poThreadPool_tractAlloc(p, drained, 0);
+        ASSERT(h);
+        ASSERT(poThreadPool_runTaskDeadline(p, 0,
+                    poTime_getDouble() + 0.01,
+                    poThreadPool_tractGet(p, h), task, 0) == 0);
+        poThreadPool_tractRelease(p, h);
+    }
+
+    // They are queued, so the tracts are not drained yet.
+    ASSERT(poThreadPool_tractAlloc(p, drained, 0) == 0);
+    ASSERT(numDrained == 0);
+
+    usleep(30000); // microseconds sec/1,000,000
+}
+
+
+int main(int argc, char **argv)
+{
+    struct POThreadPool *p;
+    uint32_t i;
+
+    poDebugInit();
+
+    // The worker drops the expired tasks.
+    p = start();
+    queueExpiring(p);
+    __sync_fetch_and_sub(&blocking, 1);
+    while(__atomic_load_n(&numDrained, __ATOMIC_ACQUIRE) < NUM_TRACTS)
+        usleep(1000); // microseconds sec/1,000,000
+    ASSERT(numRun == 0);
+    // The tracts where recycled.
+    for(i = 0; i < NUM_TRACTS; ++i)
+        ASSERT(poThreadPool_tractAlloc(p, 0, 0));
+    ASSERT(poThreadPool_tryDestroy(p, PO_LONGTIME) == 0);
+
+    // Adding a task to the full queue drops the expired tasks, and calls
+    // the drained callbacks in this thread.
+    p = start();
+    queueExpiring(p);
+    ASSERT(poThreadPool_runTask(p, 0, 0, task, 0) == 0);
+    ASSERT(numDrained == NUM_TRACTS);
+    for(i = 0; i < NUM_TRACTS; ++i)
+        ASSERT(poThreadPool_tractAlloc(p, 0, 0));
+    __sync_fetch_and_sub(&blocking, 1);
+    ASSERT(poThreadPool_tryDestroy(p, PO_LONGTIME) == 0);
+    ASSERT(numRun == 1);
+
+    printf("%s SUCCESS\n", argv[0]);
+
+    return 0;
+}
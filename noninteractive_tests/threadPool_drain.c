@@ -0,0 +1,143 @@
+#include <unistd.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <time.h>
+#include <stdarg.h>
+#include <inttypes.h>
+
+#include "debug.h"
+#include "tIme.h"
+#include "define.h"
+#include "threadPool.h"
+
+/* This tests poThreadPool_drain().  New tasks are rejected with
+ * PO_ERROR_DRAINING, even from a thread that was waiting for room in
+ * the queue, but the queued tasks, the tract tasks, and the tasks that
+ * running tasks add all finish before the pool is destroyed. */
+
+
+#define MAX_WORKERS  2
+#define QUEUE_MAX    4
+
+
+static struct POThreadPool *pool;
+
+static uint32_t gate;
+
+static struct POThreadPool_tract tract;
+
+static uint32_t numRun, numFollowUps, numProgress;
+
+
+static void *followUp(void *ptr)
+{
+    __sync_fetch_and_add(&numFollowUps, 1);
+    return NULL;
+}
+
+
+static void *task(void *ptr)
+{
+    while(!__atomic_load_n(&gate, __ATOMIC_ACQUIRE))
+        usleep(1000); // microseconds sec/1,000,000
+
+    // Work that is running may add more work while the pool drains.
+    // The tasks that where queued do, since there is room in the queue
+    // after they are taken from it.
+    if(ptr)
+        ASSERT(poThreadPool_runTask(pool, PO_LONGTIME, 0, followUp, 0) ==
+                0);
+
+    usleep(20000); // microseconds sec/1,000,000
+    __sync_fetch_and_add(&numRun, 1);
+    return NULL;
+}
+
+
+static void *submitter(void *ptr)
+{
+    // The queue is full, so this waits until the drain rejects it.
+    ASSERT(poThreadPool_runTask(pool, PO_LONGTIME, 0, task, 0) ==
+            PO_ERROR_DRAINING);
+    return NULL;
+}
+
+
+static void progress(uint32_t numRemaining, void *userData)
+{
+    ASSERT(userData == &numProgress);
+    ASSERT(numRemaining);
+
+    // Rejected at once, even with a long time out.
+    ASSERT(poThreadPool_runTask(pool, PO_LONGTIME, 0, task, 0) ==
+            PO_ERROR_DRAINING);
+
+    // The tasks can finish now.
+    __atomic_store_n(&gate, 1, __ATOMIC_RELEASE);
+
+    ++numProgress;
+}
+
+
+int main(int argc, char **argv)
+{
+    struct POThreadPool_future future;
+    pthread_t thread;
+    uint32_t i;
+
+    poDebugInit();
+
+    memset(&tract, 0, sizeof(tract));
+
+    pool = poThreadPool_create(MAX_WORKERS /*maxNumThreads*/,
+            QUEUE_MAX /*maxQueueLength*/,
+            1000 /*maxIdleTime milli-seconds 1s/1000*/);
+
+    // Two running, and four queued, two of them in a tract.
+    for(i = 0; i < MAX_WORKERS + QUEUE_MAX; ++i)
+        ASSERT(poThreadPool_runTask(pool, 0, (i % 3)?0:&tract,
+                    task, (void *) (uintptr_t) (i >= MAX_WORKERS)) == 0);
+    ASSERT(poThreadPool_runTask(pool, 0, 0, task, 0) == PO_ERROR_TIMEOUT);
+
+    ASSERT((errno = pthread_create(&thread, 0, submitter, 0)) == 0);
+    usleep(50000); // microseconds sec/1,000,000
+
+    ASSERT(poThreadPool_drain(pool, PO_LONGTIME, progress,
+                &numProgress) == 0);
+    // The pool is gone now.
+
+    ASSERT((errno = pthread_join(thread, 0)) == 0);
+
+    VASSERT(numRun == MAX_WORKERS + QUEUE_MAX, "numRun=%"PRIu32, numRun);
+    ASSERT(numFollowUps == QUEUE_MAX);
+    ASSERT(numProgress > 0);
+
+    // A drain that times out leaves the pool draining.
+    gate = 0;
+    numRun = 0;
+    numFollowUps = 0;
+    pool = poThreadPool_create(MAX_WORKERS /*maxNumThreads*/,
+            QUEUE_MAX /*maxQueueLength*/,
+            1000 /*maxIdleTime milli-seconds 1s/1000*/);
+    ASSERT(poThreadPool_runTask(pool, 0, 0, task, (void *) 1) == 0);
+    ASSERT(poThreadPool_drain(pool, 10, 0, 0) == 1);
+    ASSERT(poThreadPool_runTask(pool, 0, 0, task, 0) == PO_ERROR_DRAINING);
+    poThreadPool_futureInit(&future, 0, 0);
+    ASSERT(poThreadPool_runTaskFuture(pool, 0, 0, &future, task, 0) ==
+            PO_ERROR_DRAINING);
+    // It was not queued, so it's not pending.
+    ASSERT(poThreadPool_futureWait(&future, 0) == 0);
+    __atomic_store_n(&gate, 1, __ATOMIC_RELEASE);
+    ASSERT(poThreadPool_drain(pool, PO_LONGTIME, 0, 0) == 0);
+    ASSERT(numRun == 1 && numFollowUps == 1);
+
+    printf("%s SUCCESS\n", argv[0]);
+
+    return 0;
+}
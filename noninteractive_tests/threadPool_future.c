@@ -0,0 +1,140 @@
+#include <unistd.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <time.h>
+#include <stdarg.h>
+#include <inttypes.h>
+
+#include "debug.h"
+#include "tIme.h"
+#include "define.h"
+#include "threadPool.h"
+
+/* This tests getting task results with futures, from
+ * poThreadPool_runTaskFuture() and poThreadPool_futureWait(), from the
+ * main thread and from a task that fans out sub-tasks and joins them. */
+
+
+#define N        100
+#define NSUB     4
+
+
+static struct POThreadPool *pool;
+
+static struct POThreadPool_future futures[N];
+
+static volatile bool go = false;
+
+static uint32_t numContinuations;
+
+
+static void *twice(void *ptr)
+{
+    return (void *) (2 * (uintptr_t) ptr);
+}
+
+
+static void *waitForGo(void *ptr)
+{
+    while(!go)
+        usleep(1000); // microseconds sec/1,000,000
+    return ptr;
+}
+
+
+static void continuation(struct POThreadPool_future *future, void *data)
+{
+    // The result is set before the continuation is called.
+    ASSERT(future == data);
+    ASSERT(poThreadPool_futureResult(future) ==
+            (void *) (2 * (uintptr_t) future->userData));
+    ASSERT(!poThreadPool_futureIsDone(future));
+    __sync_fetch_and_add(&numContinuations, 1);
+}
+
+
+// Fan out sub-tasks and join them, in a worker thread.
+static void *fanOut(void *ptr)
+{
+    struct POThreadPool_future sub[NSUB];
+    uintptr_t i, sum = 0;
+
+    for(i=0; i<NSUB; ++i)
+    {
+        poThreadPool_futureInit(&sub[i], 0, 0);
+        ASSERT(poThreadPool_runTaskFuture(pool, PO_LONGTIME, 0, &sub[i],
+                    twice, (void *) ((uintptr_t) ptr + i)) == 0);
+    }
+    for(i=0; i<NSUB; ++i)
+    {
+        ASSERT(poThreadPool_futureWait(&sub[i], PO_LONGTIME) == 0);
+        sum += (uintptr_t) poThreadPool_futureResult(&sub[i]);
+    }
+    return (void *) sum;
+}
+
+
+int main(int argc, char **argv)
+{
+    struct POThreadPool_future f;
+    uintptr_t i;
+
+    poDebugInit();
+
+    pool = poThreadPool_create(4*NSUB /*maxNumThreads*/,
+            2*N /*maxQueueLength*/,
+            1000 /*maxIdleTime milli-seconds 1s/1000*/);
+
+    // Results from the main thread.
+    for(i=0; i<N; ++i)
+    {
+        poThreadPool_futureInit(&futures[i], continuation, &futures[i]);
+        ASSERT(poThreadPool_runTaskFuture(pool, PO_LONGTIME, 0, &futures[i],
+                    twice, (void *) i) == 0);
+    }
+    for(i=0; i<N; ++i)
+    {
+        ASSERT(poThreadPool_futureWait(&futures[i], PO_LONGTIME) == 0);
+        ASSERT(poThreadPool_futureIsDone(&futures[i]));
+        ASSERT(poThreadPool_futureResult(&futures[i]) == (void *) (2*i));
+    }
+    ASSERT(numContinuations == N);
+
+    // Time out waiting.
+    poThreadPool_futureInit(&f, 0, 0);
+    ASSERT(poThreadPool_runTaskFuture(pool, PO_LONGTIME, 0, &f,
+                waitForGo, (void *) 7) == 0);
+    ASSERT(poThreadPool_futureWait(&f, 0) == PO_ERROR_TIMEOUT);
+    ASSERT(poThreadPool_futureWait(&f, 50) == PO_ERROR_TIMEOUT);
+    go = true;
+    ASSERT(poThreadPool_futureWait(&f, PO_LONGTIME) == 0);
+    ASSERT(poThreadPool_futureResult(&f) == (void *) 7);
+
+    // Tasks that fan out and join.
+    for(i=0; i<2; ++i)
+    {
+        poThreadPool_futureInit(&futures[i], 0, 0);
+        ASSERT(poThreadPool_runTaskFuture(pool, PO_LONGTIME, 0, &futures[i],
+                    fanOut, (void *) (10*i)) == 0);
+    }
+    for(i=0; i<2; ++i)
+    {
+        ASSERT(poThreadPool_futureWait(&futures[i], PO_LONGTIME) == 0);
+        // 2*(10*i + 0 + 10*i + 1 + 10*i + 2 + 10*i + 3)
+        VASSERT(poThreadPool_futureResult(&futures[i]) ==
+                (void *) (2*(NSUB*10*i + 6)), "got %zu",
+                (size_t) poThreadPool_futureResult(&futures[i]));
+    }
+
+    // This will block until all threads finish.
+    ASSERT(poThreadPool_tryDestroy(pool, PO_LONGTIME) == 0);
+
+    printf("%s SUCCESS\n", argv[0]);
+
+    return 0;
+}
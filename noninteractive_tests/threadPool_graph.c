@@ -0,0 +1,213 @@
+#include <unistd.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <time.h>
+#include <stdarg.h>
+#include <inttypes.h>
+
+#include "debug.h"
+#include "tIme.h"
+#include "define.h"
+#include "threadPool.h"
+#include "threadPoolGraph.h"
+
+/* This tests running task graphs with poThreadPoolGraph_run().  Each
+ * request runs the graph:
+ *
+ *             +--> auth ---+
+ *    parse ---|            |---> render ---> write
+ *             +--> cache --+
+ *
+ * and we check that each node ran once and after the nodes before it.
+ * The pool queue is small, so some nodes get run by the threads that
+ * find them ready.  A graph may also be destroyed by its done callback,
+ * even while poThreadPoolGraph_run() is still in the call that started
+ * it. */
+
+
+#define NUM_REQUESTS  500
+#define MAX_RUNS      16
+// The number of diamonds stacked in the cycle check test graph.
+#define NUM_DIAMONDS  30
+// The number of nodes in the graph that destroys itself.
+#define NUM_CHAIN     8
+
+enum { PARSE, AUTH, CACHE, RENDER, WRITE, NUM_NODES };
+
+
+struct Request
+{
+    // The order the nodes ran in, starting at 1, and 0 if not yet.
+    uint32_t order[NUM_NODES];
+    uint32_t count;
+    bool done;
+};
+
+static struct Request requests[NUM_REQUESTS];
+
+static uint32_t numDone;
+
+static uint32_t gate, blocked, numChainRun;
+
+
+static inline void stamp(struct Request *r, uint32_t node)
+{
+    ASSERT(r->order[node] == 0);
+    r->order[node] = __sync_add_and_fetch(&r->count, 1);
+}
+
+static void *parse(void *r)  { stamp(r, PARSE); return NULL; }
+static void *auth(void *r)   { usleep(100); stamp(r, AUTH); return NULL; }
+static void *cache(void *r)  { stamp(r, CACHE); return NULL; }
+static void *render(void *r) { stamp(r, RENDER); return NULL; }
+static void *write_(void *r) { stamp(r, WRITE); return NULL; }
+
+
+static void done(void *ptr)
+{
+    struct Request *r = ptr;
+    ASSERT(r->count == NUM_NODES);
+    r->done = true;
+    __sync_fetch_and_add(&numDone, 1);
+}
+
+
+static void *block(void *ptr)
+{
+    __atomic_store_n(&blocked, 1, __ATOMIC_RELEASE);
+    while(!__atomic_load_n(&gate, __ATOMIC_ACQUIRE))
+        usleep(1000); // microseconds sec/1,000,000
+    return NULL;
+}
+
+
+static void *nop(void *ptr) { return NULL; }
+
+
+static void *chain(void *g)
+{
+    __sync_fetch_and_add(&numChainRun, 1);
+    return NULL;
+}
+
+
+static void destroyGraph(void *g)
+{
+    ASSERT(numChainRun == NUM_CHAIN);
+    poThreadPoolGraph_destroy(g);
+}
+
+
+int main(int argc, char **argv)
+{
+    struct POThreadPoolGraph *g;
+    struct POThreadPool *p;
+    uint32_t i;
+
+    poDebugInit();
+
+    g = poThreadPoolGraph_create(NUM_NODES, 5, MAX_RUNS);
+    ASSERT(g);
+
+    ASSERT(poThreadPoolGraph_addNode(g, parse) == PARSE);
+    ASSERT(poThreadPoolGraph_addNode(g, auth) == AUTH);
+    ASSERT(poThreadPoolGraph_addNode(g, cache) == CACHE);
+    ASSERT(poThreadPoolGraph_addNode(g, render) == RENDER);
+    ASSERT(poThreadPoolGraph_addNode(g, write_) == WRITE);
+    ASSERT(poThreadPoolGraph_addNode(g, write_) == -1);
+
+    ASSERT(poThreadPoolGraph_addEdge(g, PARSE, AUTH) == 0);
+    ASSERT(poThreadPoolGraph_addEdge(g, PARSE, CACHE) == 0);
+    ASSERT(poThreadPoolGraph_addEdge(g, AUTH, RENDER) == 0);
+    ASSERT(poThreadPoolGraph_addEdge(g, CACHE, RENDER) == 0);
+    // A cycle.
+    ASSERT(poThreadPoolGraph_addEdge(g, RENDER, PARSE) != 0);
+    ASSERT(poThreadPoolGraph_addEdge(g, RENDER, WRITE) == 0);
+
+    p = poThreadPool_create(4 /*maxNumThreads*/,
+            2 /*maxQueueLength*/,
+            1000 /*maxIdleTime milli-seconds 1s/1000*/);
+
+    for(i=0; i<NUM_REQUESTS; ++i)
+        while(poThreadPoolGraph_run(g, p, PO_LONGTIME, &requests[i], done))
+            // All the runs are running.
+            usleep(100); // microseconds sec/1,000,000
+
+    // The template can't change after it's run.
+    ASSERT(poThreadPoolGraph_addEdge(g, AUTH, CACHE) != 0);
+
+    while(__sync_fetch_and_add(&numDone, 0) != NUM_REQUESTS)
+        usleep(1000); // microseconds sec/1,000,000
+
+    // The runs are free when the done callbacks are called, so we can
+    // destroy the graph before the worker threads finish.
+    poThreadPoolGraph_destroy(g);
+
+    // This will block until all threads finish.
+    ASSERT(poThreadPool_tryDestroy(p, PO_LONGTIME) == 0);
+
+    for(i=0; i<NUM_REQUESTS; ++i)
+    {
+        uint32_t *o = requests[i].order;
+        VASSERT(requests[i].done && o[PARSE] == 1 &&
+                o[AUTH] > o[PARSE] && o[CACHE] > o[PARSE] &&
+                o[RENDER] > o[AUTH] && o[RENDER] > o[CACHE] &&
+                o[WRITE] == NUM_NODES,
+                "request %"PRIu32" ran nodes out of order", i);
+    }
+
+    // Stacked diamonds have 2^NUM_DIAMONDS paths from top to bottom,
+    // but the cycle check looks at each node once.  We add the edges
+    // from the bottom up, so each check looks at all the diamonds below.
+    double t = poTime_getDouble();
+    g = poThreadPoolGraph_create(3*NUM_DIAMONDS + 1, 4*NUM_DIAMONDS, 1);
+    ASSERT(g);
+    for(i=0; i<3*NUM_DIAMONDS + 1; ++i)
+        ASSERT(poThreadPoolGraph_addNode(g, parse) == (int32_t) i);
+    for(i=NUM_DIAMONDS; i;)
+    {
+        uint32_t top;
+        top = 3*(--i);
+        ASSERT(poThreadPoolGraph_addEdge(g, top + 1, top + 3) == 0);
+        ASSERT(poThreadPoolGraph_addEdge(g, top + 2, top + 3) == 0);
+        ASSERT(poThreadPoolGraph_addEdge(g, top, top + 1) == 0);
+        ASSERT(poThreadPoolGraph_addEdge(g, top, top + 2) == 0);
+    }
+    // A cycle, from the bottom to the top.
+    ASSERT(poThreadPoolGraph_addEdge(g, 3*NUM_DIAMONDS, 0) != 0);
+    poThreadPoolGraph_destroy(g);
+    t = poTime_getDouble() - t;
+    VASSERT(t < 1.0, "adding edges took %g seconds", t);
+
+    // Two roots that both go to a chain of nodes.  The pool is full, so
+    // the nodes all run in this thread, in poThreadPoolGraph_run(), and
+    // the last root finishes the run and destroys the graph before that
+    // call returns.
+    g = poThreadPoolGraph_create(NUM_CHAIN, NUM_CHAIN, 1);
+    ASSERT(g);
+    for(i=0; i<NUM_CHAIN; ++i)
+        ASSERT(poThreadPoolGraph_addNode(g, chain) == (int32_t) i);
+    ASSERT(poThreadPoolGraph_addEdge(g, 0, 2) == 0);
+    for(i=1; i<NUM_CHAIN - 1; ++i)
+        ASSERT(poThreadPoolGraph_addEdge(g, i, i + 1) == 0);
+    p = poThreadPool_create(1 /*maxNumThreads*/,
+            1 /*maxQueueLength*/,
+            1000 /*maxIdleTime milli-seconds 1s/1000*/);
+    ASSERT(poThreadPool_runTask(p, 0, 0, block, 0) == 0);
+    while(!__atomic_load_n(&blocked, __ATOMIC_ACQUIRE))
+        usleep(1000); // microseconds sec/1,000,000
+    ASSERT(poThreadPool_runTask(p, 0, 0, nop, 0) == 0);
+    ASSERT(poThreadPoolGraph_run(g, p, 0, g, destroyGraph) == 0);
+    ASSERT(numChainRun == NUM_CHAIN);
+    __atomic_store_n(&gate, 1, __ATOMIC_RELEASE);
+    ASSERT(poThreadPool_tryDestroy(p, PO_LONGTIME) == 0);
+
+    printf("%s SUCCESS\n", argv[0]);
+
+    return 0;
+}
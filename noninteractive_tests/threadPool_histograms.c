@@ -0,0 +1,98 @@
+#include <unistd.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <time.h>
+#include <stdarg.h>
+#include <inttypes.h>
+
+#include "debug.h"
+#include "tIme.h"
+#include "define.h"
+#include "threadPool.h"
+
+/* This tests the task latency histograms for the pool and for a tract. */
+
+
+#define N  20
+
+
+static struct POThreadPool_tract tract;
+static struct POThreadPool_histograms tractHistograms;
+
+
+static void *task(void *ptr)
+{
+    usleep(10000); // microseconds sec/1,000,000
+    return NULL;
+}
+
+
+static uint64_t total(const struct POThreadPool_histogram *h)
+{
+    uint64_t n = 0;
+    uint32_t i;
+    for(i=0; i<PO_THREADPOOL_HISTOGRAM_LENGTH; ++i)
+        n += h->count[i];
+    return n;
+}
+
+
+int main(int argc, char **argv)
+{
+    struct POThreadPool *p;
+    struct POThreadPool_histograms h;
+    uint32_t i;
+
+    poDebugInit();
+
+    // The buckets start at increasing times.
+    for(i=1; i<PO_THREADPOOL_HISTOGRAM_LENGTH; ++i)
+        ASSERT(poThreadPool_histogramValue(i) >
+                poThreadPool_histogramValue(i-1));
+
+    p = poThreadPool_create(2 /*maxNumThreads*/,
+            2*N /*maxQueueLength*/,
+            1000 /*maxIdleTime milli-seconds 1s/1000*/);
+
+    ASSERT(poThreadPool_setHistograms(p) == 0);
+
+    tract.histograms = &tractHistograms;
+
+    for(i=0; i<N; ++i)
+    {
+        ASSERT(poThreadPool_runTask(p, PO_LONGTIME, 0, task, 0) == 0);
+        ASSERT(poThreadPool_runTask(p, PO_LONGTIME, &tract, task, 0) == 0);
+    }
+
+    struct POThreadPool_stats stats;
+    while(poThreadPool_getStats(p, &stats), stats.tasksRun < 2*N)
+        usleep(10000); // microseconds sec/1,000,000
+
+    poThreadPool_getHistograms(p, &h);
+
+    VASSERT(total(&h.run) == 2*N, "recorded %"PRIu64" run times",
+            total(&h.run));
+    ASSERT(total(&h.queueWait) == 2*N);
+    ASSERT(total(&tractHistograms.run) == N);
+    ASSERT(total(&tractHistograms.queueWait) == N);
+
+    // The tasks sleep for 10 milliseconds.
+    double t;
+    t = poThreadPool_histogramPercentile(&h.run, 50);
+    VASSERT(t > 0.009 && t < 0.5, "median run time %g seconds", t);
+    // With 2 workers, the tasks had to wait in the queue.
+    t = poThreadPool_histogramPercentile(&h.queueWait, 100);
+    VASSERT(t > 0.05, "longest queue wait %g seconds", t);
+
+    // This will block until all threads finish.
+    ASSERT(poThreadPool_tryDestroy(p, PO_LONGTIME) == 0);
+
+    printf("%s SUCCESS\n", argv[0]);
+
+    return 0;
+}
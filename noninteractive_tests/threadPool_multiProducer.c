@@ -0,0 +1,160 @@
+#include <unistd.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <time.h>
+#include <stdarg.h>
+#include <inttypes.h>
+
+#include "debug.h"
+#include "tIme.h"
+#include "define.h"
+#include "threadPool.h"
+
+/* This test has many threads calling poThreadPool_runTask() at the same
+ * time, and the tasks that they run submit follow-up tasks from the
+ * worker threads.  Each producer thread has its own tract, so we also
+ * check that the tasks in a tract run in the order they where
+ * submitted.  We run it with and without work stealing. */
+
+
+#define NPRODUCERS  6
+const uint32_t N = 2000;
+
+
+static struct POThreadPool *pool;
+
+static struct POThreadPool_tract tract[NPRODUCERS];
+
+// Accessed only by the tasks in the tract with the same index, so the
+// tract keeps these from being accessed at the same time.
+static uint32_t tractCounter[NPRODUCERS];
+static uint32_t tractFailures[NPRODUCERS];
+
+static uint32_t followUpCount;
+
+
+static void *followUp(void *ptr)
+{
+    __sync_fetch_and_add(&followUpCount, 1);
+    return NULL;
+}
+
+
+struct Task
+{
+    uint32_t index, count;
+};
+
+static struct Task tasks[NPRODUCERS][2000];
+
+
+static void *task(struct Task *t)
+{
+    if(tractCounter[t->index] != t->count)
+        ++tractFailures[t->index];
+    ++tractCounter[t->index];
+
+    // Submit a follow-up task from this worker thread.
+    ASSERT(poThreadPool_runTask(pool, PO_LONGTIME, 0/*tract*/,
+                followUp, 0) == 0);
+    return NULL;
+}
+
+
+static void *producer(void *ptr)
+{
+    uint32_t index, i;
+    index = (uintptr_t) ptr;
+
+    for(i=0; i<N; ++i)
+    {
+        tasks[index][i].index = index;
+        tasks[index][i].count = i;
+        ASSERT(poThreadPool_runTask(pool, PO_LONGTIME, &tract[index],
+                (void *(*)(void *)) task, &tasks[index][i]) == 0);
+    }
+    return NULL;
+}
+
+
+static void run(uint32_t dequeLength)
+{
+    pthread_t pthread[NPRODUCERS];
+    uintptr_t i;
+
+    memset(tractCounter, 0, sizeof(tractCounter));
+    memset(tractFailures, 0, sizeof(tractFailures));
+    followUpCount = 0;
+
+    double t;
+    t = poTime_getDouble();
+
+    pool = poThreadPool_create(20 /*maxNumThreads*/,
+            // Room for all the tract tasks and all the follow-up tasks,
+            // so that no worker blocks submitting a follow-up task.
+            2*NPRODUCERS*N/*maxQueueLength*/,
+            10000 /*maxIdleTime milli-seconds 1s/1000*/);
+
+    if(dequeLength)
+        ASSERT(poThreadPool_setWorkStealing(pool, dequeLength) == 0);
+
+    memset(tract, 0, sizeof(tract));
+
+    for(i=0; i<NPRODUCERS; ++i)
+        ASSERT((errno = pthread_create(&pthread[i], 0,
+                producer, (void *) i)) == 0);
+
+    for(i=0; i<NPRODUCERS; ++i)
+        ASSERT((errno = pthread_join(pthread[i], 0)) == 0);
+
+    // This will block until all threads finish.
+    ASSERT(poThreadPool_tryDestroy(pool, PO_LONGTIME) == 0);
+
+    t = poTime_getDouble() - t;
+
+    uint32_t num_failures = 0;
+
+    for(i=0; i<NPRODUCERS; ++i)
+        if(tractCounter[i] != N || tractFailures[i])
+        {
+            ++num_failures;
+            printf("Tract %"PRIu32" ran %"PRIu32" tasks with %"PRIu32
+                    " out of order\n",
+                    (uint32_t) i, tractCounter[i], tractFailures[i]);
+        }
+
+    if(followUpCount != NPRODUCERS*N)
+    {
+        ++num_failures;
+        printf("ran %"PRIu32" follow-up tasks instead of %"PRIu32"\n",
+                followUpCount, NPRODUCERS*N);
+    }
+
+    VASSERT(!num_failures, "This test FAILED!");
+
+    printf("\nfinished %"PRIu32" producers %s with %"PRIu32" failures"
+            " in %g seconds\n\n", NPRODUCERS,
+            (dequeLength?"with work stealing":"WITHOUT work stealing"),
+            num_failures, t);
+}
+
+
+int main(int argc, char **argv)
+{
+    poDebugInit();
+
+    run(0); // run without work stealing
+    run(64); // run with work stealing
+    run(0); // run without work stealing
+    run(64); // run with work stealing
+
+    printf("%s SUCCESS\n", argv[0]);
+
+    return 0;
+}
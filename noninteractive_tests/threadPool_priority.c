@@ -0,0 +1,109 @@
+#include <unistd.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <time.h>
+#include <stdarg.h>
+#include <inttypes.h>
+
+#include "debug.h"
+#include "tIme.h"
+#include "define.h"
+#include "threadPool.h"
+
+/* This tests the order that queued tasks with different priorities run
+ * in, with one worker thread so the order is known. */
+
+
+#define N  40
+
+#define HIGH  0
+#define LOW   (PO_THREADPOOL_NUM_PRIORITIES - 1)
+
+
+static uint32_t blocking = 1;
+
+// Accessed only by the one worker thread.
+static uintptr_t order[2*N + 2];
+static uint32_t count;
+
+static struct POThreadPool_tract tract;
+
+
+static void *block(void *ptr)
+{
+    while(__sync_fetch_and_add(&blocking, 0))
+        usleep(1000); // microseconds sec/1,000,000
+    return NULL;
+}
+
+
+static void *task(void *ptr)
+{
+    order[count++] = (uintptr_t) ptr;
+    return NULL;
+}
+
+
+int main(int argc, char **argv)
+{
+    struct POThreadPool *p;
+    uintptr_t i;
+
+    poDebugInit();
+
+    p = poThreadPool_create(1 /*maxNumThreads*/,
+            2*N + 2 /*maxQueueLength*/,
+            1000 /*maxIdleTime milli-seconds 1s/1000*/);
+
+    // Keep the one worker busy while we queue the tasks.
+    ASSERT(poThreadPool_runTask(p, 0, 0, block, 0) == 0);
+
+    // Low priority tasks are 1000 + i and high priority tasks are i.
+    for(i=0; i<N; ++i)
+        ASSERT(poThreadPool_runTaskPriority(p, 0, LOW, 0,
+                    task, (void *) (1000 + i)) == 0);
+    for(i=0; i<N; ++i)
+        ASSERT(poThreadPool_runTaskPriority(p, 0, HIGH, 0,
+                    task, (void *) i) == 0);
+
+    // The second task in this tract gets the priority of the first, so
+    // it still runs after the first.
+    ASSERT(poThreadPool_runTaskPriority(p, 0, LOW, &tract,
+                task, (void *) 2000) == 0);
+    ASSERT(poThreadPool_runTaskPriority(p, 0, HIGH, &tract,
+                task, (void *) 2001) == 0);
+
+    __sync_fetch_and_sub(&blocking, 1);
+
+    // This will block until all threads finish.
+    ASSERT(poThreadPool_tryDestroy(p, PO_LONGTIME) == 0);
+
+    VASSERT(count == 2*N + 2, "ran %"PRIu32" tasks", count);
+
+    // The high priority tasks run first, but a low priority task runs
+    // after every PO_THREADPOOL_STARVATION_LIMIT (16) high priority
+    // tasks.
+    uint32_t j = 0, high = 0, low = 0;
+
+    for(i=0; i<16; ++i)
+        ASSERT(order[j++] == high++);
+    ASSERT(order[j++] == 1000 + low++);
+    for(i=0; i<16; ++i)
+        ASSERT(order[j++] == high++);
+    ASSERT(order[j++] == 1000 + low++);
+    while(high < N)
+        ASSERT(order[j++] == high++);
+    while(low < N)
+        ASSERT(order[j++] == 1000 + low++);
+    ASSERT(order[j++] == 2000);
+    ASSERT(order[j++] == 2001);
+
+    printf("%s SUCCESS\n", argv[0]);
+
+    return 0;
+}
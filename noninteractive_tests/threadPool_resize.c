@@ -0,0 +1,123 @@
+#include <unistd.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <time.h>
+#include <stdarg.h>
+#include <inttypes.h>
+
+#include "debug.h"
+#include "tIme.h"
+#include "define.h"
+#include "threadPool.h"
+
+/* This tests changing the thread and queue limits of a running pool with
+ * poThreadPool_resize().  The tasks wait for us to open a gate so that
+ * we can fill the pool and count how many tasks fit. */
+
+
+static volatile bool gate = false;
+
+static uint32_t count;
+
+
+static void *task(void *ptr)
+{
+    while(!gate)
+        usleep(1000); // microseconds sec/1,000,000
+    __sync_fetch_and_add(&count, 1);
+    return NULL;
+}
+
+
+// Submit tasks without waiting until one does not fit, and return the
+// number that fit.
+static uint32_t fill(struct POThreadPool *p)
+{
+    uint32_t n = 0;
+    while(poThreadPool_runTask(p, 0, 0, task, 0) == 0)
+        ++n;
+    return n;
+}
+
+
+static void waitFor(struct POThreadPool *p, uint64_t tasksRun,
+        uint32_t numThreads)
+{
+    struct POThreadPool_stats stats;
+    while(poThreadPool_getStats(p, &stats),
+            stats.tasksRun < tasksRun || stats.numThreads != numThreads)
+        usleep(1000); // microseconds sec/1,000,000
+}
+
+
+int main(int argc, char **argv)
+{
+    struct POThreadPool_stats stats;
+    struct POThreadPool *p;
+    uint32_t n, total = 0;
+
+    poDebugInit();
+
+    p = poThreadPool_create(8 /*maxNumThreads*/,
+            4 /*maxQueueLength*/,
+            10000 /*maxIdleTime milli-seconds 1s/1000*/);
+
+    // More threads than the pool has workers.
+    ASSERT(poThreadPool_resize(p, 9, 4) != 0);
+
+    ASSERT(poThreadPool_resize(p, 2, 4) == 0);
+    n = fill(p);
+    VASSERT(n == 2 + 4, "%"PRIu32" tasks fit", n);
+    total += n;
+    poThreadPool_getStats(p, &stats);
+    ASSERT(stats.numThreads == 2);
+
+    // Grow with tasks in the queue.  2 new threads get 2 of the 4 queued
+    // tasks, so there is room for 18 more queued.
+    ASSERT(poThreadPool_resize(p, 4, 20) == 0);
+    while(poThreadPool_getStats(p, &stats), stats.queueLength != 2)
+        usleep(1000); // microseconds sec/1,000,000
+    n = fill(p);
+    VASSERT(n == 18, "%"PRIu32" tasks fit", n);
+    total += n;
+    poThreadPool_getStats(p, &stats);
+    ASSERT(stats.numThreads == 4);
+
+    gate = true;
+    waitFor(p, total, 4);
+
+    // Shrink.  The idle threads above the limit exit.
+    gate = false;
+    ASSERT(poThreadPool_resize(p, 1, 2) == 0);
+    waitFor(p, total, 1);
+    n = fill(p);
+    VASSERT(n == 1 + 2, "%"PRIu32" tasks fit", n);
+    total += n;
+
+    // Shrink while the queue is full.  The queued tasks still run, and
+    // then there is room for just one.
+    ASSERT(poThreadPool_resize(p, 1, 1) == 0);
+    ASSERT(fill(p) == 0);
+    gate = true;
+    waitFor(p, total, 1);
+    gate = false;
+    n = fill(p);
+    VASSERT(n == 1 + 1, "%"PRIu32" tasks fit", n);
+    total += n;
+    gate = true;
+
+    // This will block until all threads finish.
+    ASSERT(poThreadPool_tryDestroy(p, PO_LONGTIME) == 0);
+
+    VASSERT(count == total, "ran %"PRIu32" of %"PRIu32" tasks",
+            count, total);
+
+    printf("%s SUCCESS\n", argv[0]);
+
+    return 0;
+}
@@ -0,0 +1,130 @@
+#include <unistd.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <time.h>
+#include <stdarg.h>
+#include <inttypes.h>
+
+#include "debug.h"
+#include "tIme.h"
+#include "define.h"
+#include "threadPool.h"
+
+/* This tests poThreadPool_runTaskCopy(), which copies the task data
+ * into the pool.  We reuse the same memory for the data of all the
+ * tasks, so the tasks only see their own data if it was copied. */
+
+
+#define N  4000
+
+
+struct Payload
+{
+    uint64_t index;
+    uint64_t value[(PO_THREADPOOL_PAYLOAD_SIZE - 8)/8];
+};
+
+
+static struct POThreadPool_tract tract;
+
+static uint64_t sum;
+static uint32_t failures;
+
+// Accessed only by tasks in tract.
+static uint64_t tractCount;
+static uint32_t tractFailures;
+
+
+static bool check(const struct Payload *pl)
+{
+    uint32_t i;
+    if(((uintptr_t) pl) % 16)
+        return false;
+    for(i=0; i<sizeof(pl->value)/sizeof(pl->value[0]); ++i)
+        if(pl->value[i] != pl->index + i)
+            return false;
+    return true;
+}
+
+
+static void *task(void *ptr)
+{
+    struct Payload *pl = ptr;
+    if(!check(pl))
+        __sync_fetch_and_add(&failures, 1);
+    __sync_fetch_and_add(&sum, pl->index);
+    return NULL;
+}
+
+
+static void *tractTask(void *ptr)
+{
+    struct Payload *pl = ptr;
+    if(!check(pl) || pl->index != tractCount)
+        ++tractFailures;
+    ++tractCount;
+    return NULL;
+}
+
+
+static void set(struct Payload *pl, uint64_t index)
+{
+    uint32_t i;
+    pl->index = index;
+    for(i=0; i<sizeof(pl->value)/sizeof(pl->value[0]); ++i)
+        pl->value[i] = index + i;
+}
+
+
+int main(int argc, char **argv)
+{
+    struct POThreadPool *p;
+    struct Payload pl;
+    uint64_t i;
+
+    poDebugInit();
+
+    ASSERT(sizeof(pl) == PO_THREADPOOL_PAYLOAD_SIZE);
+
+    p = poThreadPool_create(4 /*maxNumThreads*/,
+            100 /*maxQueueLength*/,
+            1000 /*maxIdleTime milli-seconds 1s/1000*/);
+
+    // Too big, or too small.
+    ASSERT(poThreadPool_runTaskCopy(p, 0, 0, task, &pl,
+                sizeof(pl) + 1) == PO_ERROR_INVALID);
+    ASSERT(poThreadPool_runTaskCopy(p, 0, 0, task, &pl, 0) ==
+            PO_ERROR_INVALID);
+
+    memset(&tract, 0, sizeof(tract));
+
+    for(i=0; i<N; ++i)
+    {
+        set(&pl, i);
+        ASSERT(poThreadPool_runTaskCopy(p, PO_LONGTIME, 0, task,
+                    &pl, sizeof(pl)) == 0);
+        set(&pl, i);
+        ASSERT(poThreadPool_runTaskCopy(p, PO_LONGTIME, &tract, tractTask,
+                    &pl, sizeof(pl)) == 0);
+        // Clobber it.
+        set(&pl, 0xFFFFFFFF);
+    }
+
+    // This will block until all threads finish.
+    ASSERT(poThreadPool_tryDestroy(p, PO_LONGTIME) == 0);
+
+    VASSERT(!failures && sum == ((uint64_t) N)*(N-1)/2,
+            "%"PRIu32" bad payloads, sum=%"PRIu64, failures, sum);
+    VASSERT(tractCount == N && !tractFailures,
+            "ran %"PRIu64" tract tasks with %"PRIu32" failures",
+            tractCount, tractFailures);
+
+    printf("%s SUCCESS\n", argv[0]);
+
+    return 0;
+}
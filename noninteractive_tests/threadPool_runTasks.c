@@ -0,0 +1,120 @@
+#include <unistd.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <time.h>
+#include <stdarg.h>
+#include <inttypes.h>
+
+#include "debug.h"
+#include "tIme.h"
+#include "define.h"
+#include "threadPool.h"
+
+/* This tests submitting batches of tasks with poThreadPool_runTasks(),
+ * and the counters from poThreadPool_getStats(). */
+
+
+#define MAX_WORKERS  2
+#define QUEUE_MAX    4
+#define BATCH        10
+
+
+static uint32_t count;
+
+static struct POThreadPool_tract tract;
+// Accessed only by tasks in tract.
+static uint32_t tractCount, tractFailures;
+
+
+static void *task(void *ptr)
+{
+    usleep(10000); // microseconds sec/1,000,000
+    __sync_fetch_and_add(&count, 1);
+    return NULL;
+}
+
+
+static void *tractTask(void *ptr)
+{
+    if(tractCount != (uintptr_t) ptr)
+        ++tractFailures;
+    ++tractCount;
+    __sync_fetch_and_add(&count, 1);
+    return NULL;
+}
+
+
+int main(int argc, char **argv)
+{
+    struct POThreadPool_taskEntry entries[BATCH];
+    struct POThreadPool_stats stats;
+    struct POThreadPool *p;
+    uintptr_t i;
+
+    poDebugInit();
+
+    p = poThreadPool_create(MAX_WORKERS /*maxNumThreads*/,
+            QUEUE_MAX /*maxQueueLength*/,
+            1000 /*maxIdleTime milli-seconds 1s/1000*/);
+
+    for(i=0; i<BATCH; ++i)
+    {
+        entries[i].tract = 0;
+        entries[i].callback = task;
+        entries[i].callbackData = 0;
+    }
+
+    // Without waiting there is only room for the workers and the queue.
+    ASSERT(poThreadPool_runTasks(p, 0, entries, BATCH) ==
+            MAX_WORKERS + QUEUE_MAX);
+
+    // The batch stopped at the first task that did not fit.
+    poThreadPool_getStats(p, &stats);
+    VASSERT(stats.numRejected == 1, "numRejected=%"PRIu64,
+            stats.numRejected);
+    ASSERT(stats.numThreads == MAX_WORKERS);
+
+    // Waiting, they all get in.
+    ASSERT(poThreadPool_runTasks(p, PO_LONGTIME, entries, BATCH) == BATCH);
+
+    // And some had to wait.
+    poThreadPool_getStats(p, &stats);
+    ASSERT(stats.numFullWaits > 0);
+    ASSERT(stats.numRejected == 1);
+
+    // A batch in one tract runs in order.
+    memset(&tract, 0, sizeof(tract));
+    for(i=0; i<BATCH; ++i)
+    {
+        entries[i].tract = &tract;
+        entries[i].callback = tractTask;
+        entries[i].callbackData = (void *) i;
+    }
+    ASSERT(poThreadPool_runTasks(p, PO_LONGTIME, entries, BATCH) == BATCH);
+
+    ASSERT(poThreadPool_runTasks(p, 0, entries, 0) == 0);
+
+    // Wait for the tasks to finish, without destroying the pool.
+    while(poThreadPool_getStats(p, &stats),
+            stats.tasksRun < MAX_WORKERS + QUEUE_MAX + 2*BATCH)
+        usleep(10000); // microseconds sec/1,000,000
+    ASSERT(stats.queueLength == 0);
+
+    // This will block until all threads finish.
+    ASSERT(poThreadPool_tryDestroy(p, PO_LONGTIME) == 0);
+
+    VASSERT(count == MAX_WORKERS + QUEUE_MAX + 2*BATCH,
+            "ran %"PRIu32" tasks", count);
+    VASSERT(tractCount == BATCH && !tractFailures,
+            "ran %"PRIu32" tract tasks with %"PRIu32" out of order",
+            tractCount, tractFailures);
+
+    printf("%s SUCCESS\n", argv[0]);
+
+    return 0;
+}
@@ -0,0 +1,94 @@
+#include <unistd.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <time.h>
+#include <stdarg.h>
+#include <inttypes.h>
+
+#include "debug.h"
+#include "tIme.h"
+#include "define.h"
+#include "threadPool.h"
+
+/* This tests the tract quantum from poThreadPool_setTractQuantum().  With
+ * one worker thread, a tract with many queued tasks must take turns with
+ * the tasks in the General queue, and still run its tasks in order. */
+
+
+#define QUANTUM      2
+#define NUM_TRACT    8
+#define NUM_OTHER    4
+
+
+static struct POThreadPool_tract tract;
+
+static volatile bool go = false;
+
+// The order the tasks ran in.  There is one worker thread so only one
+// task at a time writes to these.
+static char ran[NUM_TRACT + NUM_OTHER + 1];
+static uint32_t numRan;
+
+
+static void *tractTask(void *ptr)
+{
+    if(ptr == 0)
+        // Keep the worker busy until all the tasks are queued.
+        while(!go)
+            usleep(1000); // microseconds sec/1,000,000
+
+    ran[numRan++] = 'a' + (uintptr_t) ptr;
+    return NULL;
+}
+
+
+static void *otherTask(void *ptr)
+{
+    ran[numRan++] = 'A' + (uintptr_t) ptr;
+    return NULL;
+}
+
+
+int main(int argc, char **argv)
+{
+    struct POThreadPool *p;
+    uintptr_t i;
+
+    poDebugInit();
+
+    p = poThreadPool_create(1 /*maxNumThreads*/,
+            NUM_TRACT + NUM_OTHER /*maxQueueLength*/,
+            1000 /*maxIdleTime milli-seconds 1s/1000*/);
+
+    ASSERT(poThreadPool_setTractQuantum(p, QUANTUM) == 0);
+
+    memset(&tract, 0, sizeof(tract));
+
+    for(i=0; i<NUM_TRACT; ++i)
+        ASSERT(poThreadPool_runTask(p, 0, &tract, tractTask,
+                    (void *) i) == 0);
+
+    for(i=0; i<NUM_OTHER; ++i)
+        ASSERT(poThreadPool_runTask(p, 0, 0, otherTask, (void *) i) == 0);
+
+    // It's too late to set it now.
+    ASSERT(poThreadPool_setTractQuantum(p, QUANTUM) != 0);
+
+    go = true;
+
+    // This will block until all threads finish.
+    ASSERT(poThreadPool_tryDestroy(p, PO_LONGTIME) == 0);
+
+    // QUANTUM tract tasks, then one of the other tasks, and so on.
+    VASSERT(strcmp(ran, "abAcdBefCghD") == 0, "ran tasks in order \"%s\"",
+            ran);
+
+    printf("%s SUCCESS\n", argv[0]);
+
+    return 0;
+}
@@ -0,0 +1,138 @@
+#include <unistd.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <time.h>
+#include <stdarg.h>
+#include <inttypes.h>
+
+#include "debug.h"
+#include "tIme.h"
+#include "define.h"
+#include "threadPool.h"
+
+/* This tests tracts from the pool tract slab, with
+ * poThreadPool_setTractSlab() and friends.  The drained callbacks must be
+ * called once for each tract, after all the tasks in the tract ran in
+ * order. */
+
+
+#define NUM_TRACTS  4
+#define N           200
+
+
+// Accessed only by the tasks in the tract with the same index.
+static uint32_t tractCounter[NUM_TRACTS];
+static uint32_t tractFailures[NUM_TRACTS];
+
+static uint32_t drained[NUM_TRACTS];
+
+
+struct Task
+{
+    uint32_t index, count;
+};
+
+static struct Task tasks[NUM_TRACTS][N];
+
+
+static void *task(struct Task *t)
+{
+    if(tractCounter[t->index] != t->count)
+        ++tractFailures[t->index];
+    ++tractCounter[t->index];
+    return NULL;
+}
+
+
+static void *drainedCallback(void *ptr)
+{
+    uintptr_t i = (uintptr_t) ptr;
+    // All the tasks in the tract must have run.
+    ASSERT(tractCounter[i] == N);
+    __sync_fetch_and_add(&drained[i], 1);
+    return NULL;
+}
+
+
+int main(int argc, char **argv)
+{
+    uint64_t handle[NUM_TRACTS];
+    struct POThreadPool *p;
+    uintptr_t i;
+    uint32_t j;
+
+    poDebugInit();
+
+    p = poThreadPool_create(3 /*maxNumThreads*/,
+            NUM_TRACTS*N /*maxQueueLength*/,
+            1000 /*maxIdleTime milli-seconds 1s/1000*/);
+
+    ASSERT(poThreadPool_setTractSlab(p, NUM_TRACTS) == 0);
+
+    for(i=0; i<NUM_TRACTS; ++i)
+    {
+        handle[i] = poThreadPool_tractAlloc(p, drainedCallback, (void *) i);
+        ASSERT(handle[i]);
+    }
+    // They are all used.
+    ASSERT(poThreadPool_tractAlloc(p, 0, 0) == 0);
+
+    for(j=0; j<N; ++j)
+        for(i=0; i<NUM_TRACTS; ++i)
+        {
+            tasks[i][j].index = i;
+            tasks[i][j].count = j;
+            ASSERT(poThreadPool_runTask(p, PO_LONGTIME,
+                    poThreadPool_tractGet(p, handle[i]),
+                    (void *(*)(void *)) task, &tasks[i][j]) == 0);
+        }
+
+    for(i=0; i<NUM_TRACTS; ++i)
+    {
+        poThreadPool_tractRetain(p, handle[i]);
+        poThreadPool_tractRelease(p, handle[i]);
+        // We still have a reference.
+        ASSERT(poThreadPool_tractGet(p, handle[i]));
+        poThreadPool_tractRelease(p, handle[i]);
+    }
+
+    // Wait for the tracts to drain, without destroying the pool.
+    for(i=0; i<NUM_TRACTS; ++i)
+        while(!__sync_fetch_and_add(&drained[i], 0))
+            usleep(1000); // microseconds sec/1,000,000
+
+    for(i=0; i<NUM_TRACTS; ++i)
+    {
+        // The handles went stale.
+        ASSERT(poThreadPool_tractGet(p, handle[i]) == NULL);
+        VASSERT(tractCounter[i] == N && !tractFailures[i],
+                "Tract %"PRIu32" ran %"PRIu32" tasks with %"PRIu32
+                " out of order", (uint32_t) i, tractCounter[i],
+                tractFailures[i]);
+    }
+
+    // A recycled tract with no tasks calls back as it's released.
+    i = 0;
+    tractCounter[0] = N;
+    handle[0] = poThreadPool_tractAlloc(p, drainedCallback, (void *) i);
+    ASSERT(handle[0]);
+    ASSERT(handle[0] != handle[1] && handle[0] != handle[2] &&
+            handle[0] != handle[3]);
+    poThreadPool_tractRelease(p, handle[0]);
+    ASSERT(drained[0] == 2);
+
+    // This will block until all threads finish.
+    ASSERT(poThreadPool_tryDestroy(p, PO_LONGTIME) == 0);
+
+    for(i=0; i<NUM_TRACTS; ++i)
+        ASSERT(drained[i] == 1 + (i == 0));
+
+    printf("%s SUCCESS\n", argv[0]);
+
+    return 0;
+}
@@ -0,0 +1,144 @@
+#include <unistd.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <time.h>
+#include <stdarg.h>
+#include <inttypes.h>
+
+#include "debug.h"
+#include "tIme.h"
+#include "define.h"
+#include "threadPool.h"
+
+/* This tests the hung task watchdog from poThreadPool_setWatchdog().
+ * Two tasks block until we open a gate.  The watchdog hook is called
+ * once for each of them, and it cancels the tasks that are queued
+ * behind the blocked task in its tract. */
+
+
+#define MAX_WORKERS  4
+#define QUEUE_MAX    10
+#define THRESHOLD    50 // milliseconds
+
+
+static uint32_t gate;
+
+static struct POThreadPool_tract tract;
+
+static uint32_t numHooks, numCancelled, numRun;
+
+
+static void *hangTask(void *ptr)
+{
+    while(!__atomic_load_n(&gate, __ATOMIC_ACQUIRE))
+        usleep(1000); // microseconds sec/1,000,000
+    return NULL;
+}
+
+
+static void *task(void *ptr)
+{
+    __sync_fetch_and_add(&numRun, 1);
+    return NULL;
+}
+
+
+static void cancelTask(void *ptr)
+{
+    ++numCancelled;
+}
+
+
+static void hook(struct POThreadPool *p,
+        const struct POThreadPool_hungTask *hungTask, void *hookData)
+{
+    ASSERT(hookData == &numHooks);
+    ASSERT(hungTask->callback == hangTask);
+    ASSERT(hungTask->runTime >= THRESHOLD/1000.0);
+    ASSERT(hungTask->worker < MAX_WORKERS);
+
+    if(hungTask->callbackData == (void *) 1)
+    {
+        // This is the blocked task in the tract, so the tasks behind it
+        // will not run any time soon.
+        ASSERT(hungTask->tract == &tract);
+        ASSERT(poThreadPool_cancelTract(p, hungTask->tract) == 3);
+    }
+    else
+        ASSERT(hungTask->callbackData == (void *) 2);
+
+    __atomic_add_fetch(&numHooks, 1, __ATOMIC_RELEASE);
+}
+
+
+int main(int argc, char **argv)
+{
+    struct POThreadPool_hungTask hungTasks[MAX_WORKERS];
+    struct POThreadPool *p;
+    uint32_t i;
+
+    poDebugInit();
+
+    memset(&tract, 0, sizeof(tract));
+
+    p = poThreadPool_create(MAX_WORKERS /*maxNumThreads*/,
+            QUEUE_MAX /*maxQueueLength*/,
+            1000 /*maxIdleTime milli-seconds 1s/1000*/);
+
+    ASSERT(poThreadPool_setWatchdog(p, 0, hook, &numHooks) != 0);
+    ASSERT(poThreadPool_setWatchdog(p, THRESHOLD, hook, &numHooks) == 0);
+    // Just once.
+    ASSERT(poThreadPool_setWatchdog(p, THRESHOLD, hook, &numHooks) != 0);
+
+    ASSERT(poThreadPool_runTask(p, 0, &tract, hangTask, (void *) 1) == 0);
+    ASSERT(poThreadPool_runTask(p, 0, 0, hangTask, (void *) 2) == 0);
+
+    // Wait for the tract task to start, so the next tract tasks queue
+    // behind it.
+    while(poThreadPool_getHungTasks(p, 0, hungTasks, MAX_WORKERS) < 2)
+        usleep(1000); // microseconds sec/1,000,000
+    for(i = 0; i < 3; ++i)
+        ASSERT(poThreadPool_runTaskCancelable(p, 0, &tract, task, 0,
+                    cancelTask, 0) == 0);
+
+    // Tasks that do not block do not bother the watchdog.
+    for(i = 0; i < 5; ++i)
+        ASSERT(poThreadPool_runTask(p, PO_LONGTIME, 0, task, 0) == 0);
+
+    // No task has run that long.
+    ASSERT(poThreadPool_getHungTasks(p, 100*THRESHOLD, hungTasks,
+                MAX_WORKERS) == 0);
+
+    while(__atomic_load_n(&numHooks, __ATOMIC_ACQUIRE) < 2)
+        usleep(1000); // microseconds sec/1,000,000
+
+    ASSERT(numCancelled == 3);
+
+    ASSERT(poThreadPool_getHungTasks(p, THRESHOLD, hungTasks,
+                MAX_WORKERS) == 2);
+    for(i = 0; i < 2; ++i)
+    {
+        ASSERT(hungTasks[i].callback == hangTask);
+        ASSERT(hungTasks[i].runTime >= THRESHOLD/1000.0);
+    }
+
+    // The hook is called once for a task.
+    usleep(4*THRESHOLD*1000); // microseconds sec/1,000,000
+    ASSERT(numHooks == 2);
+
+    __atomic_store_n(&gate, 1, __ATOMIC_RELEASE);
+
+    // This will block until all threads finish.
+    ASSERT(poThreadPool_tryDestroy(p, PO_LONGTIME) == 0);
+
+    VASSERT(numRun == 5, "numRun=%"PRIu32, numRun);
+
+    printf("%s SUCCESS\n", argv[0]);
+
+    return 0;
+}